@@ -0,0 +1,220 @@
+/* fsbench.c - Runs the kernel's filesystem code as a Linux program and times it
+ *
+ * Usage: fsbench [-n rounds] [-c chunk] [image]
+ *   rounds -- how many times each benchmark goes over the whole filesystem (default 200)
+ *   chunk  -- bytes per read call for the read benchmarks (default 1024, what cat uses)
+ *   image  -- filesystem image made by createfs, or fscompress for one with compressed files (default filesys_img)
+ *
+ * The kernel keeps addresses in uint32_t, so the image and the FS_RAM_LOC region have to be mapped below 4 GB.
+ * Build without PIE (the Makefile does) so the kernel's static buffers are down there too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fshost.h"
+
+#ifndef MAP_32BIT
+#define MAP_32BIT 0
+#endif
+
+#define MAX_FILES   64
+#define NAME_LEN    33      /* 32 char names plus the null terminator */
+#define MAX_CHUNK   (1 << 20)
+
+/* Regular files in the image, filled in after the mount */
+static struct {
+    char name[NAME_LEN];
+    int inode;
+    unsigned int size;
+} files[MAX_FILES];
+static int num_files;
+
+static unsigned char buf[MAX_CHUNK];
+
+/* Wall clock in nanoseconds */
+static double now_ns(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Map the image below 4 GB and the FS_RAM_LOC window at its kernel address, then mount */
+static int mount_image(const char* path){
+    int fd;
+    struct stat st;
+    void* image;
+    void* ram;
+    double start;
+
+    fd = open(path, O_RDONLY);
+    if(fd == -1 || fstat(fd, &st) == -1){
+        perror(path);
+        return -1;
+    }
+    image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_32BIT, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED || (unsigned long)image + st.st_size > 0xFFFFFFFFUL){
+        fprintf(stderr, "can't map %s below 4 GB\n", path);
+        return -1;
+    }
+    ram = mmap((void*)(unsigned long)fshost_ram_base(), fshost_ram_size(), PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ram != (void*)(unsigned long)fshost_ram_base()){
+        fprintf(stderr, "can't map the filesystem region at 0x%x\n", fshost_ram_base());
+        return -1;
+    }
+    start = now_ns();
+    fshost_mount(image, st.st_size);
+    printf("mount:           %8.1f us for a %ld KB image\n", (now_ns() - start) / 1e3, (long)st.st_size / 1024);
+    return 0;
+}
+
+/* Name lookups: every file by name plus a name that isn't there, hashed index against the old scan */
+static void bench_lookup(int rounds){
+    static const char* missing = "no_such_file";
+    double start, hashed, scan;
+    int r, i, lookups = rounds * (num_files + 1);
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        for(i = 0; i < num_files; i++)
+            fshost_lookup(files[i].name);
+        fshost_lookup(missing);
+    }
+    hashed = now_ns() - start;
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        for(i = 0; i < num_files; i++)
+            fshost_lookup_scan(files[i].name);
+        fshost_lookup_scan(missing);
+    }
+    scan = now_ns() - start;
+
+    printf("lookup:          %8.1f ns per name (hash index), %8.1f ns (linear scan)\n", hashed / lookups, scan / lookups);
+}
+
+/* Every file front to back through open/read/close, like cat */
+static void bench_seq_read(int rounds, int chunk){
+    double start, elapsed;
+    double bytes = 0;
+    int r, i, fd, cnt;
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        for(i = 0; i < num_files; i++){
+            fd = fshost_open(files[i].name);
+            while((cnt = fshost_file_read(fd, buf, chunk)) > 0)
+                bytes += cnt;
+            fshost_close(fd);
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("sequential read: %8.1f MB/s in %d byte reads\n", bytes / elapsed * 1e3, chunk);
+}
+
+/* Reads at random offsets (same ones every run) spread over every file */
+static void bench_rand_read(int rounds, int chunk){
+    double start, elapsed;
+    double bytes = 0;
+    unsigned int rng = 1;
+    int r, i, reads = 0;
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        for(i = 0; i < num_files; i++){
+            if(files[i].size == 0)
+                continue;
+            rng = rng * 1103515245 + 12345;
+            bytes += fshost_read(files[i].inode, (rng >> 8) % files[i].size, buf, chunk);
+            reads++;
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("random read:     %8.1f ns per %d byte read, %8.1f MB/s\n", elapsed / reads, chunk, bytes / elapsed * 1e3);
+}
+
+/* Read the whole directory, one name per dir_read (the old ls) and 16 entries per getdents */
+static void bench_dir_list(int rounds){
+    double start, one, batched;
+    int r, fd, names = 0;
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        fd = fshost_dir_open();
+        while(fshost_dir_read(fd, (char*)buf, NAME_LEN - 1) > 0)
+            names++;
+        fshost_close(fd);
+    }
+    one = now_ns() - start;
+
+    start = now_ns();
+    for(r = 0; r < rounds; r++){
+        fd = fshost_dir_open();
+        while(fshost_getdents(fd, buf, 16 * fshost_dirent_size()) > 0)
+            ;
+        fshost_close(fd);
+    }
+    batched = now_ns() - start;
+
+    printf("directory list:  %8.1f ns per listing (dir_read), %8.1f ns (getdents), %d entries\n",
+           one / rounds, batched / rounds, names / rounds);
+}
+
+int main(int argc, char** argv){
+    const char* path = "filesys_img";
+    int rounds = 200;
+    int chunk = 1024;
+    int opt, i, inode;
+    unsigned int hits, misses, direct;
+
+    while((opt = getopt(argc, argv, "n:c:")) != -1){
+        switch(opt){
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'c':
+            chunk = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n rounds] [-c chunk] [image]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(optind < argc)
+        path = argv[optind];
+    if(rounds <= 0 || chunk <= 0 || chunk > MAX_CHUNK){
+        fprintf(stderr, "rounds has to be positive and chunk between 1 and %d\n", MAX_CHUNK);
+        return 1;
+    }
+
+    if(mount_image(path) == -1)
+        return 1;
+    for(i = 0; i < fshost_num_entries() && num_files < MAX_FILES; i++){
+        inode = fshost_entry(i, files[num_files].name, NAME_LEN);
+        if(inode == -1)
+            continue;
+        files[num_files].inode = inode;
+        files[num_files].size = fshost_file_size(inode);
+        num_files++;
+    }
+    printf("%s: %d files, %d rounds\n", path, num_files, rounds);
+
+    bench_lookup(rounds);
+    bench_seq_read(rounds, chunk);
+    bench_rand_read(rounds, chunk);
+    bench_dir_list(rounds);
+    fshost_compress_stats(&hits, &misses, &direct);
+    if(hits + misses + direct > 0)
+        printf("compressed:      %u chunk cache hits, %u misses, %u whole chunk reads\n", hits, misses, direct);
+    return 0;
+}
@@ -0,0 +1,197 @@
+/* fscompress.c - Makes a copy of a filesystem image with its files compressed (see student-distrib/compress.h)
+ *
+ * Usage: fscompress [-v] in_image out_image
+ *   -v -- print every file and what it compressed to
+ *
+ * Every regular file is split into BLOCK_SIZE chunks that are compressed on their own with LZ4 (../mkfs/lz.c, which
+ * createfs -z uses too), and the file is stored compressed if that saves at least one data block. Directories, and
+ * files that don't get smaller, are copied as they are. The data blocks of the new image are packed in inode order.
+ * Only flat (version 0) images, which is what createfs makes, can be read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "lz.h"
+
+#define BLOCK_SIZE          4096
+#define DENTRY_SIZE         64
+#define MAX_DENTRY_NUM      63
+#define INODE_BLOCKS        1023
+#define INODE_COMPRESSED    0x80000000
+#define VERSION_OFFSET      12
+
+typedef struct dentry {
+    char fname[32];
+    uint32_t ftype;
+    uint32_t inode_num;
+    uint32_t reserved[6];
+} dentry_t;
+
+typedef struct inode {
+    uint32_t length;
+    uint32_t data_blocks[INODE_BLOCKS];
+} inode_t;
+
+static uint8_t* image;
+static uint32_t num_dentries, num_inodes, num_blocks;
+static int verbose;
+
+static inode_t* get_inode(uint32_t i){
+    return (inode_t*)(image + BLOCK_SIZE + i * BLOCK_SIZE);
+}
+
+static uint8_t* get_block(uint32_t b){
+    return image + BLOCK_SIZE * (1 + num_inodes + b);
+}
+
+/* Copy a file's stored bytes out of the image, NULL if one of its block numbers is bad */
+static uint8_t* read_file(inode_t* inode, uint32_t len){
+    uint8_t* data = malloc(len + BLOCK_SIZE);
+    uint32_t i;
+
+    for(i = 0; i * BLOCK_SIZE < len; i++){
+        if(i >= INODE_BLOCKS || inode->data_blocks[i] >= num_blocks){
+            free(data);
+            return NULL;
+        }
+        memcpy(data + i * BLOCK_SIZE, get_block(inode->data_blocks[i]), BLOCK_SIZE);
+    }
+    return data;
+}
+
+/* Mark every inode a subdirectory entry points at, starting from the root in the boot block */
+static void find_dirs(const uint8_t* entries, uint32_t count, uint8_t* is_dir, char (*names)[33]){
+    const dentry_t* d;
+    inode_t* inode;
+    uint8_t* data;
+    uint32_t i;
+
+    for(i = 0; i < count; i++){
+        d = (const dentry_t*)(entries + i * DENTRY_SIZE);
+        /* rtc, and "." in the root, which is the root itself */
+        if(d->ftype == 0 || (d->ftype == 1 && d->inode_num == 0) || d->inode_num >= num_inodes)
+            continue;
+        memcpy(names[d->inode_num], d->fname, 32);
+        if(d->ftype != 1 || is_dir[d->inode_num])
+            continue;
+        is_dir[d->inode_num] = 1;
+        inode = get_inode(d->inode_num);
+        if(inode->length & INODE_COMPRESSED)
+            continue;
+        data = read_file(inode, inode->length);
+        if(data != NULL){
+            find_dirs(data, inode->length / DENTRY_SIZE, is_dir, names);
+            free(data);
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    FILE* f;
+    long size;
+    uint8_t* out;
+    uint8_t* is_dir;
+    char (*names)[33];
+    uint8_t* data;
+    uint8_t* packed;
+    inode_t* src;
+    inode_t* dst;
+    uint32_t i, j, len, stored, blocks, next = 0, files = 0, compressed = 0;
+    uint64_t bytes_in = 0, bytes_out = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "v")) != -1){
+        if(opt != 'v'){
+            fprintf(stderr, "usage: %s [-v] in_image out_image\n", argv[0]);
+            return 1;
+        }
+        verbose = 1;
+    }
+    if(argc - optind != 2){
+        fprintf(stderr, "usage: %s [-v] in_image out_image\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[optind], "rb");
+    if(f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < BLOCK_SIZE){
+        perror(argv[optind]);
+        return 1;
+    }
+    rewind(f);
+    image = malloc(size);
+    if(fread(image, 1, size, f) != (size_t)size){
+        perror(argv[optind]);
+        return 1;
+    }
+    fclose(f);
+    num_dentries = ((uint32_t*)image)[0];
+    num_inodes = ((uint32_t*)image)[1];
+    num_blocks = ((uint32_t*)image)[2];
+    if(((uint32_t*)image)[VERSION_OFFSET / 4] != 0 || num_dentries > MAX_DENTRY_NUM ||
+       (uint64_t)BLOCK_SIZE * (1 + num_inodes + num_blocks) > (uint64_t)size){
+        fprintf(stderr, "%s: not a flat filesystem image\n", argv[optind]);
+        return 1;
+    }
+
+    is_dir = calloc(num_inodes, 1);
+    names = calloc(num_inodes, sizeof(*names));
+    find_dirs(image + DENTRY_SIZE, num_dentries, is_dir, names);
+
+    /* Big enough for every file stored as is (or bigger than that, for files that don't compress) */
+    out = calloc(1 + num_inodes + num_blocks + num_inodes, BLOCK_SIZE);
+    packed = malloc(LZ_FILE_BOUND(INODE_BLOCKS * BLOCK_SIZE));
+    memcpy(out, image, BLOCK_SIZE);
+    for(i = 0; i < num_inodes; i++){
+        src = get_inode(i);
+        dst = (inode_t*)(out + BLOCK_SIZE + i * BLOCK_SIZE);
+        len = src->length & ~INODE_COMPRESSED;
+        if(len == 0)
+            continue;
+        if(len > INODE_BLOCKS * BLOCK_SIZE || (data = read_file(src, len)) == NULL){
+            fprintf(stderr, "inode %u has a bad block number\n", i);
+            return 1;
+        }
+        stored = len;
+        dst->length = src->length;
+        if(!is_dir[i] && !(src->length & INODE_COMPRESSED)){
+            files++;
+            stored = lz_compress_file(data, len, packed);
+            /* Only worth it if it saves a block, and it still has to fit in a flat inode */
+            if((stored + BLOCK_SIZE - 1) / BLOCK_SIZE < (len + BLOCK_SIZE - 1) / BLOCK_SIZE){
+                memcpy(data, packed, stored);
+                dst->length = stored | INODE_COMPRESSED;
+                compressed++;
+            }
+            else{
+                stored = len;
+            }
+            if(verbose)
+                printf("%-32.32s %8u -> %8u%s\n", names[i][0] ? names[i] : "?", len, stored,
+                       (dst->length & INODE_COMPRESSED) ? "" : " (not compressed)");
+            bytes_in += len;
+            bytes_out += stored;
+        }
+        blocks = (stored + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        for(j = 0; j < blocks; j++){
+            dst->data_blocks[j] = next;
+            memcpy(out + BLOCK_SIZE * (1 + num_inodes + next), data + j * BLOCK_SIZE,
+                   (stored - j * BLOCK_SIZE < BLOCK_SIZE) ? stored - j * BLOCK_SIZE : BLOCK_SIZE);
+            next++;
+        }
+        free(data);
+    }
+    ((uint32_t*)out)[2] = next;
+
+    f = fopen(argv[optind + 1], "wb");
+    if(f == NULL || fwrite(out, BLOCK_SIZE, 1 + num_inodes + next, f) != 1 + num_inodes + next || fclose(f) != 0){
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    printf("%s: %u of %u files compressed, file data %llu KB -> %llu KB, image %ld KB -> %u KB\n", argv[optind + 1],
+           compressed, files, (unsigned long long)bytes_in / 1024, (unsigned long long)bytes_out / 1024, size / 1024,
+           (1 + num_inodes + next) * BLOCK_SIZE / 1024);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/* fshost.c - Kernel side of the host build of the filesystem code.
+ * Compiled like the kernel sources (FS_HOST, kernel headers, no C library), see fshost.h
+ */
+
+#include "types.h"
+#include "filesys.h"
+#include "paging.h"
+#include "lib.h"
+#include "compress.h"
+#include "wait.h"
+#include "fshost.h"
+
+/* From the C library, the only thing the kernel side calls out to */
+int putchar(int c);
+
+/* Stubbed PCB for the "process" doing the file operations */
+static pcb_t fshost_pcb;
+
+/* Operations tables, the real ones are in syscall.c which isn't part of the host build */
+file_optbl_t regfile_optbl = {
+    .open = file_open,
+    .read = file_read,
+    .write = file_write,
+    .close = file_close,
+};
+file_optbl_t dir_optbl = {
+    .open = dir_open,
+    .read = dir_read,
+    .write = dir_write,
+    .close = dir_close,
+};
+
+/* The console "driver" is stdout, so kernel printf works */
+bool console_isinit(){
+    return true;
+}
+fastcall int console_putchar(char c){
+    putchar(c);
+    return 0;
+}
+
+/* Wait queues, for the block queue's busy flag. The host build is a single task, so nothing ever has to wait. */
+void wq_sleep(wait_queue_t* wq){
+}
+void wq_wake_all(wait_queue_t* wq){
+}
+
+unsigned int fshost_ram_base(void){
+    return FS_RAM_LOC;
+}
+
+unsigned int fshost_ram_size(void){
+    return FS_RAM_SIZE;
+}
+
+void fshost_mount(void* image, unsigned int size){
+    memset(&fshost_pcb, 0, sizeof(fshost_pcb));
+    fshost_pcb.file_array[0].flags.in_use = 1;
+    fshost_pcb.file_array[1].flags.in_use = 1;
+    cur_pcb = &fshost_pcb;
+    fs_mount((uint32_t*)image, size);
+}
+
+int fshost_num_entries(void){
+    return get_num_dir_entries();
+}
+
+int fshost_entry(int idx, char* name, unsigned int name_len){
+    dentry_t dentry;
+
+    if(read_dentry_by_index(idx, &dentry) != 0 || dentry.ftype != 2 || name_len == 0)
+        return -1;
+    if(name_len > MAX_FNAME_SIZE + 1)
+        name_len = MAX_FNAME_SIZE + 1;
+    strncpy((int8_t*)name, (int8_t*)dentry.fname, name_len - 1);
+    name[name_len - 1] = '\0';
+    return dentry.inode_num;
+}
+
+int fshost_lookup(const char* name){
+    dentry_t dentry;
+
+    if(read_dentry_by_name((const uint8_t*)name, &dentry) != 0)
+        return -1;
+    return dentry.inode_num;
+}
+
+int fshost_lookup_scan(const char* name){
+    dentry_t dentry;
+
+    if(read_dentry_by_name_scan((const uint8_t*)name, &dentry) != 0)
+        return -1;
+    return dentry.inode_num;
+}
+
+unsigned int fshost_file_size(int inode){
+    return get_inode_len(inode);
+}
+
+int fshost_read(int inode, unsigned int offset, void* buf, unsigned int len){
+    return read_data(inode, offset, buf, len);
+}
+
+int fshost_open(const char* name){
+    return file_open((const uint8_t*)name);
+}
+
+int fshost_file_read(int fd, void* buf, int nbytes){
+    return file_read(fd, buf, nbytes);
+}
+
+int fshost_dir_open(void){
+    return dir_open((const uint8_t*)".");
+}
+
+int fshost_dir_read(int fd, char* buf, int nbytes){
+    return dir_read(fd, buf, nbytes);
+}
+
+int fshost_getdents(int fd, void* buf, int nbytes){
+    return dir_getdents(fd, buf, nbytes);
+}
+
+unsigned int fshost_dirent_size(void){
+    return sizeof(dirent_t);
+}
+
+void fshost_close(int fd){
+    if(fd < 2 || fd >= MAX_OPEN_FILES)
+        return;
+    syscall_getfdptr(fd)->flags.in_use = 0;
+}
+
+void fshost_compress_stats(unsigned int* hits, unsigned int* misses, unsigned int* direct){
+    compress_stats_t stats;
+
+    compress_get_stats(&stats);
+    *hits = stats.hits;
+    *misses = stats.misses;
+    *direct = stats.direct;
+}
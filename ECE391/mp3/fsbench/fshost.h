@@ -0,0 +1,40 @@
+#ifndef _FSHOST_H
+#define _FSHOST_H
+
+/* Interface between the Linux benchmark driver and the kernel filesystem code built with FS_HOST.
+ * The kernel side is compiled against its own types.h, which can't be mixed with the C library headers,
+ * so only plain C types cross this line. Everything else in the kernel objects is made local at link time. */
+#define FSHOST_API __attribute__((visibility("default")))
+
+/* Where the writable copy of the image goes (FS_RAM_LOC / FS_RAM_SIZE), the driver has to map it before mounting */
+FSHOST_API unsigned int fshost_ram_base(void);
+FSHOST_API unsigned int fshost_ram_size(void);
+
+/* Mount an image (fs_mount) and give the filesystem a PCB with stdin and stdout taken */
+FSHOST_API void fshost_mount(void* image, unsigned int size);
+
+/* Directory entries: count, and the name/inode of a regular file (-1 if the entry is not a regular file) */
+FSHOST_API int fshost_num_entries(void);
+FSHOST_API int fshost_entry(int idx, char* name, unsigned int name_len);
+
+/* Name lookup through the hash index and through the old linear scan, inode number or -1 */
+FSHOST_API int fshost_lookup(const char* name);
+FSHOST_API int fshost_lookup_scan(const char* name);
+
+/* Direct reads (read_data) */
+FSHOST_API unsigned int fshost_file_size(int inode);
+FSHOST_API int fshost_read(int inode, unsigned int offset, void* buf, unsigned int len);
+
+/* File descriptor path, what the read and close system calls end up in */
+FSHOST_API int fshost_open(const char* name);
+FSHOST_API int fshost_file_read(int fd, void* buf, int nbytes);
+FSHOST_API int fshost_dir_open(void);
+FSHOST_API int fshost_dir_read(int fd, char* buf, int nbytes);
+FSHOST_API int fshost_getdents(int fd, void* buf, int nbytes);
+FSHOST_API unsigned int fshost_dirent_size(void);
+FSHOST_API void fshost_close(int fd);
+
+/* Decompressed chunk cache counters (compress_get_stats) */
+FSHOST_API void fshost_compress_stats(unsigned int* hits, unsigned int* misses, unsigned int* direct);
+
+#endif
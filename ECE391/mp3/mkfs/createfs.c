@@ -0,0 +1,491 @@
+/* createfs.c - Builds a filesystem image from a directory, replaces the prebuilt createfs
+ *
+ * Usage: createfs -i dir -o image [-n inodes] [-a name,name,...] [-z] [-j threads] [-r report]
+ *   -i -- directory to put in the image, subdirectories become subdirectories of the image
+ *   -o -- image to write, only written if every check passes
+ *   -n -- number of inodes (default 64, what the old createfs made)
+ *   -a -- files to put first, in this order (paths from the top of dir, default shell,ls)
+ *   -z -- store files compressed when that saves a data block (see student-distrib/compress.h)
+ *   -j -- threads to run the checks on (default one per CPU)
+ *   -r -- write the layout report here instead of stdout
+ *
+ * The image is the flat (version 0) format every kernel reads: the boot block with ".", "rtc" and the top level
+ * entries, the inodes, then the data blocks. Inode 0 stays empty for "." and rtc. Every file (and directory) gets one
+ * run of consecutive data blocks, directories first since the kernel walks them at mount, then the files in -a order,
+ * then the rest in the order they were found. Directory entries are sorted by name.
+ *
+ * Before the image is written every file is read back out of it and compared with its source, on -j threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "lz.h"
+
+#define BLOCK_SIZE          4096
+#define DENTRY_SIZE         64
+#define MAX_FNAME_SIZE      32
+#define MAX_DENTRY_NUM      63
+#define INODE_BLOCKS        1023
+#define INODE_COMPRESSED    0x80000000
+#define DEFAULT_INODES      64
+#define DEFAULT_FIRST       "shell,ls"
+#define MAX_NODES           4096
+#define MAX_PATH            1024
+#define MAX_THREADS         64
+#define MSG_SIZE            128
+
+/* One file or directory from the source directory */
+typedef struct node {
+    char path[MAX_PATH];        /* Path from the top of the source directory, "" for the top itself */
+    char name[MAX_FNAME_SIZE + 1];
+    int is_dir;
+    int parent;                 /* Index of the directory it is in, -1 for the top */
+    int rank;                   /* Place in the -a list, or -1 */
+    uint32_t inode;
+    uint8_t* data;              /* Contents (a directory's entries once they are made) */
+    uint32_t size;
+    uint8_t* stored;            /* What goes in the data blocks, data itself unless it was compressed */
+    uint32_t stored_len;
+    uint32_t first_block;
+    uint32_t blocks;
+    char msg[MSG_SIZE];         /* Why the check failed, empty if it passed */
+} node_t;
+
+static node_t nodes[MAX_NODES];
+static int num_nodes;
+static uint8_t* image;
+static uint32_t num_inodes = DEFAULT_INODES;
+static uint32_t num_blocks;
+static uint32_t* block_owner;   /* Inode each data block was given to */
+static int next_check;          /* Next node a check thread takes */
+
+/* Directory entry as the kernel reads it */
+typedef struct dentry {
+    char fname[MAX_FNAME_SIZE];
+    uint32_t ftype;
+    uint32_t inode_num;
+    uint32_t reserved[6];
+} dentry_t;
+
+static double now_ms(void){
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e3 + tv.tv_usec / 1e3;
+}
+
+static uint32_t* get_inode(uint32_t i){
+    return (uint32_t*)(image + BLOCK_SIZE * (1 + i));
+}
+
+static uint8_t* get_block(uint32_t b){
+    return image + BLOCK_SIZE * (1 + num_inodes + b);
+}
+
+static int cmp_names(const void* a, const void* b){
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Read the whole file at path, NULL on failure */
+static uint8_t* read_source(const char* path, uint32_t* size){
+    FILE* f = fopen(path, "rb");
+    struct stat st;
+    uint8_t* data;
+
+    if(f == NULL || fstat(fileno(f), &st) == -1){
+        perror(path);
+        return NULL;
+    }
+    data = malloc(st.st_size + 1);
+    if(data == NULL || fread(data, 1, st.st_size, f) != (size_t)st.st_size){
+        perror(path);
+        return NULL;
+    }
+    fclose(f);
+    *size = st.st_size;
+    return data;
+}
+
+/* Add everything in a source directory (sorted by name) and below it, -1 on failure */
+static int scan(const char* top, int dir){
+    char full[2 * MAX_PATH];
+    char prefix[MAX_PATH];
+    char* names[MAX_NODES];
+    struct dirent* ent;
+    struct stat st;
+    node_t* n;
+    DIR* d;
+    int count = 0, i, j, ret = 0;
+
+    snprintf(prefix, sizeof(prefix), "%s%s", nodes[dir].path, nodes[dir].path[0] ? "/" : "");
+    snprintf(full, sizeof(full), "%s/%s", top, nodes[dir].path);
+    d = opendir(full);
+    if(d == NULL){
+        perror(full);
+        return -1;
+    }
+    while((ent = readdir(d)) != NULL && count < MAX_NODES){
+        if(strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+            names[count++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    qsort(names, count, sizeof(names[0]), cmp_names);
+
+    for(i = 0; i < count && ret == 0; i++){
+        if(num_nodes == MAX_NODES){
+            fprintf(stderr, "more than %d files\n", MAX_NODES);
+            return -1;
+        }
+        n = &nodes[num_nodes];
+        snprintf(n->path, sizeof(n->path), "%s%s", prefix, names[i]);
+        snprintf(full, sizeof(full), "%s/%s", top, n->path);
+        if(stat(full, &st) == -1){
+            perror(full);
+            return -1;
+        }
+        if(!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)){
+            fprintf(stderr, "%s: skipped, not a file or directory\n", full);
+            continue;
+        }
+        strncpy(n->name, names[i], MAX_FNAME_SIZE);
+        if(strlen(names[i]) > MAX_FNAME_SIZE)
+            fprintf(stderr, "%s: name cut to %d chars\n", n->path, MAX_FNAME_SIZE);
+        /* "." and ".." are how paths go up and down, and the root already has "." and rtc */
+        if(dir == 0 && !strcmp(n->name, "rtc")){
+            fprintf(stderr, "%s: rtc is the real time clock's entry\n", full);
+            return -1;
+        }
+        for(j = 1; j < num_nodes; j++){
+            if(nodes[j].parent == dir && !strcmp(nodes[j].name, n->name)){
+                fprintf(stderr, "%s: same name as %s once cut to %d chars\n", n->path, nodes[j].path, MAX_FNAME_SIZE);
+                return -1;
+            }
+        }
+        n->parent = dir;
+        n->rank = -1;
+        n->is_dir = S_ISDIR(st.st_mode);
+        num_nodes++;
+        if(n->is_dir)
+            ret = scan(top, n - nodes);
+        else if((n->data = read_source(full, &n->size)) == NULL)
+            ret = -1;
+    }
+    for(i = 0; i < count; i++)
+        free(names[i]);
+    return ret;
+}
+
+/* Placement order: directories, then the -a files, then everything else as found */
+static int cmp_place(const void* a, const void* b){
+    const node_t* x = &nodes[*(const int*)a];
+    const node_t* y = &nodes[*(const int*)b];
+
+    if(x->is_dir != y->is_dir)
+        return y->is_dir - x->is_dir;
+    if((x->rank == -1) != (y->rank == -1))
+        return (x->rank == -1) ? 1 : -1;
+    if(x->rank != y->rank)
+        return x->rank - y->rank;
+    return *(const int*)a - *(const int*)b;
+}
+
+/* Entries of directory dir as the kernel reads them, sorted by name. Returns the number of entries. */
+static uint32_t make_entries(int dir, uint8_t* out){
+    dentry_t* ent = (dentry_t*)out;
+    uint32_t count = 0;
+    int i;
+
+    for(i = 1; i < num_nodes; i++){
+        if(nodes[i].parent != dir)
+            continue;
+        memset(&ent[count], 0, sizeof(dentry_t));
+        memcpy(ent[count].fname, nodes[i].name, strlen(nodes[i].name));
+        ent[count].ftype = nodes[i].is_dir ? 1 : 2;
+        ent[count].inode_num = nodes[i].inode;
+        count++;
+    }
+    return count;
+}
+
+/* Read a node back out of the image and compare it with what it should be, sets msg if something is wrong */
+static void check_node(node_t* n){
+    uint32_t* inode = get_inode(n->inode);
+    uint32_t len = inode[0] & ~INODE_COMPRESSED;
+    uint32_t i, b, extents = 0;
+    uint8_t* stored;
+    uint8_t* data;
+
+    if(len != n->stored_len || ((inode[0] & INODE_COMPRESSED) != 0) != (n->stored != n->data)){
+        snprintf(n->msg, MSG_SIZE, "inode %u has length 0x%x", n->inode, inode[0]);
+        return;
+    }
+    stored = malloc(n->blocks * BLOCK_SIZE + 1);
+    for(i = 0; i < n->blocks; i++){
+        b = inode[1 + i];
+        if(b >= num_blocks || block_owner[b] != n->inode){
+            snprintf(n->msg, MSG_SIZE, "block %u of inode %u is %u, which isn't its own", i, n->inode, b);
+            free(stored);
+            return;
+        }
+        if(i == 0 || b != inode[i] + 1)
+            extents++;
+        memcpy(stored + i * BLOCK_SIZE, get_block(b), BLOCK_SIZE);
+    }
+    if(n->blocks > 1 && extents != 1)
+        snprintf(n->msg, MSG_SIZE, "inode %u is in %u pieces", n->inode, extents);
+
+    data = stored;
+    if(inode[0] & INODE_COMPRESSED){
+        data = malloc(n->size + 1);
+        if(lz_decompress_file(stored, len, data, n->size) != (int32_t)n->size)
+            snprintf(n->msg, MSG_SIZE, "inode %u doesn't decompress", n->inode);
+        len = n->size;
+    }
+    if(n->msg[0] == '\0' && (len != n->size || memcmp(data, n->data, n->size) != 0))
+        snprintf(n->msg, MSG_SIZE, "inode %u doesn't read back the same", n->inode);
+    if(data != stored)
+        free(data);
+    free(stored);
+}
+
+static void* check_thread(void* arg){
+    int i;
+
+    (void)arg;
+    while((i = __sync_fetch_and_add(&next_check, 1)) < num_nodes){
+        if(i > 0)
+            check_node(&nodes[i]);
+    }
+    return NULL;
+}
+
+/* Checks of the boot block: counts, and that every top level entry is there and points at the right inode */
+static int check_boot(void){
+    uint32_t* boot = (uint32_t*)image;
+    dentry_t* ent = (dentry_t*)(image + DENTRY_SIZE);
+    uint32_t i, j;
+
+    if(boot[0] > MAX_DENTRY_NUM || boot[1] != num_inodes || boot[2] != num_blocks || boot[3] != 0){
+        fprintf(stderr, "boot block counts are wrong\n");
+        return -1;
+    }
+    if(strcmp(ent[0].fname, ".") != 0 || ent[0].ftype != 1 || strcmp(ent[1].fname, "rtc") != 0 || ent[1].ftype != 0){
+        fprintf(stderr, "boot block doesn't start with . and rtc\n");
+        return -1;
+    }
+    for(i = 2; i < boot[0]; i++){
+        for(j = 0; j < i; j++){
+            if(!strncmp(ent[i].fname, ent[j].fname, MAX_FNAME_SIZE)){
+                fprintf(stderr, "%.32s is in the boot block twice\n", ent[i].fname);
+                return -1;
+            }
+        }
+        if(ent[i].inode_num == 0 || ent[i].inode_num >= num_inodes){
+            fprintf(stderr, "%.32s has inode %u\n", ent[i].fname, ent[i].inode_num);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char* prog){
+    fprintf(stderr, "usage: %s -i dir -o image [-n inodes] [-a name,name,...] [-z] [-j threads] [-r report]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char** argv){
+    const char* in = NULL;
+    const char* out = NULL;
+    const char* report_path = NULL;
+    char first[MAX_PATH * 4] = DEFAULT_FIRST;
+    int compress = 0;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int order[MAX_NODES];
+    pthread_t tids[MAX_THREADS];
+    uint8_t* packed;
+    uint32_t* inode;
+    uint32_t next, i, j, root_entries, failed = 0, dirs = 0, compressed = 0;
+    uint64_t file_bytes = 0, stored_bytes = 0;
+    double start, check_ms;
+    char* name;
+    FILE* report;
+    FILE* f;
+    int opt, rank = 0;
+
+    while((opt = getopt(argc, argv, "i:o:n:a:zj:r:")) != -1){
+        switch(opt){
+        case 'i': in = optarg; break;
+        case 'o': out = optarg; break;
+        case 'n': num_inodes = atoi(optarg); break;
+        case 'a': snprintf(first, sizeof(first), "%s", optarg); break;
+        case 'z': compress = 1; break;
+        case 'j': threads = atoi(optarg); break;
+        case 'r': report_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(in == NULL || out == NULL || optind != argc)
+        usage(argv[0]);
+    if(threads < 1)
+        threads = 1;
+    if(threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    /* Node 0 is the top directory, which is the root in the boot block */
+    nodes[0].is_dir = 1;
+    nodes[0].parent = -1;
+    nodes[0].rank = -1;
+    num_nodes = 1;
+    if(scan(in, 0) == -1)
+        return 1;
+    for(name = strtok(first, ","); name != NULL; name = strtok(NULL, ","), rank++){
+        for(i = 1; i < num_nodes && strcmp(nodes[i].path, name) != 0; i++);
+        if(i < num_nodes && nodes[i].rank == -1 && !nodes[i].is_dir)
+            nodes[i].rank = rank;
+        else
+            fprintf(stderr, "-a %s: no such file\n", name);
+    }
+
+    for(i = 1, root_entries = 2; i < num_nodes; i++)
+        root_entries += (nodes[i].parent == 0);
+    if(root_entries > MAX_DENTRY_NUM){
+        fprintf(stderr, "%u entries at the top, the boot block holds %d (use subdirectories)\n", root_entries, MAX_DENTRY_NUM);
+        return 1;
+    }
+    if((uint32_t)num_nodes > num_inodes){
+        fprintf(stderr, "%d files and directories need -n %d or more\n", num_nodes - 1, num_nodes);
+        return 1;
+    }
+
+    /* Inodes and blocks in placement order */
+    for(i = 0; i < (uint32_t)num_nodes - 1; i++)
+        order[i] = i + 1;
+    qsort(order, num_nodes - 1, sizeof(order[0]), cmp_place);
+    for(i = 0; i < (uint32_t)num_nodes - 1; i++)
+        nodes[order[i]].inode = i + 1;
+
+    /* Contents: directory entries now that every inode is known, files compressed if that is worth a block */
+    for(i = 1; i < (uint32_t)num_nodes; i++){
+        node_t* n = &nodes[i];
+
+        if(n->is_dir){
+            n->data = calloc(num_nodes, DENTRY_SIZE);
+            n->size = make_entries(i, n->data) * DENTRY_SIZE;
+            dirs++;
+        }
+        n->stored = n->data;
+        n->stored_len = n->size;
+        if(compress && !n->is_dir && n->size > 0){
+            packed = malloc(LZ_FILE_BOUND(n->size));
+            j = lz_compress_file(n->data, n->size, packed);
+            if((j + BLOCK_SIZE - 1) / BLOCK_SIZE < (n->size + BLOCK_SIZE - 1) / BLOCK_SIZE){
+                n->stored = packed;
+                n->stored_len = j;
+                compressed++;
+            }
+            else{
+                free(packed);
+            }
+        }
+        n->blocks = (n->stored_len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if(n->blocks > INODE_BLOCKS){
+            fprintf(stderr, "%s: %u blocks, an inode holds %d\n", n->path, n->blocks, INODE_BLOCKS);
+            return 1;
+        }
+        if(!n->is_dir){
+            file_bytes += n->size;
+            stored_bytes += n->stored_len;
+        }
+    }
+    for(i = 0, next = 0; i < (uint32_t)num_nodes - 1; i++){
+        nodes[order[i]].first_block = next;
+        next += nodes[order[i]].blocks;
+    }
+    num_blocks = next;
+
+    image = calloc(1 + num_inodes + num_blocks, BLOCK_SIZE);
+    block_owner = calloc(num_blocks + 1, sizeof(uint32_t));
+    ((uint32_t*)image)[0] = root_entries;
+    ((uint32_t*)image)[1] = num_inodes;
+    ((uint32_t*)image)[2] = num_blocks;
+    {
+        dentry_t* ent = (dentry_t*)(image + DENTRY_SIZE);
+
+        strcpy(ent[0].fname, ".");
+        ent[0].ftype = 1;
+        strcpy(ent[1].fname, "rtc");
+        ent[1].ftype = 0;
+        make_entries(0, (uint8_t*)&ent[2]);
+    }
+    for(i = 1; i < (uint32_t)num_nodes; i++){
+        node_t* n = &nodes[i];
+
+        inode = get_inode(n->inode);
+        inode[0] = n->stored_len | ((n->stored != n->data) ? INODE_COMPRESSED : 0);
+        for(j = 0; j < n->blocks; j++){
+            inode[1 + j] = n->first_block + j;
+            block_owner[n->first_block + j] = n->inode;
+        }
+        if(n->stored_len > 0)
+            memcpy(get_block(n->first_block), n->stored, n->stored_len);
+    }
+
+    start = now_ms();
+    next_check = 0;
+    for(i = 0; i < (uint32_t)threads; i++)
+        pthread_create(&tids[i], NULL, check_thread, NULL);
+    for(i = 0; i < (uint32_t)threads; i++)
+        pthread_join(tids[i], NULL);
+    if(check_boot() == -1)
+        failed++;
+    check_ms = now_ms() - start;
+
+    report = stdout;
+    if(report_path != NULL && (report = fopen(report_path, "w")) == NULL){
+        perror(report_path);
+        return 1;
+    }
+    fprintf(report, "inode  blocks        size    stored  path\n");
+    for(i = 0; i < (uint32_t)num_nodes - 1; i++){
+        node_t* n = &nodes[order[i]];
+        char blocks[32];
+
+        if(n->blocks == 0)
+            snprintf(blocks, sizeof(blocks), "-");
+        else
+            snprintf(blocks, sizeof(blocks), "%u-%u", n->first_block, n->first_block + n->blocks - 1);
+        fprintf(report, "%5u  %-11s %8u  %8u  %s%s%s\n", n->inode, blocks, n->size, n->stored_len, n->path,
+                n->is_dir ? "/" : "", (n->stored != n->data) ? " (compressed)" : "");
+        if(n->msg[0] != '\0'){
+            fprintf(stderr, "%s: %s\n", n->path, n->msg);
+            failed++;
+        }
+    }
+    fprintf(report, "image: %u KB, %u inodes (%d used), %u data blocks, %d files in %u directories, one extent each\n",
+            (1 + num_inodes + num_blocks) * BLOCK_SIZE / 1024, num_inodes, num_nodes - 1, num_blocks,
+            num_nodes - 1 - dirs, dirs + 1);
+    if(compress)
+        fprintf(report, "compressed: %u files, file data %llu KB -> %llu KB\n", compressed,
+                (unsigned long long)file_bytes / 1024, (unsigned long long)stored_bytes / 1024);
+    fprintf(report, "checks: %d files read back on %d threads in %.2f ms, %u failed\n", num_nodes - 1, threads, check_ms,
+            failed);
+    if(report != stdout)
+        fclose(report);
+    if(failed > 0)
+        return 1;
+
+    f = fopen(out, "wb");
+    if(f == NULL || fwrite(image, BLOCK_SIZE, 1 + num_inodes + num_blocks, f) != 1 + num_inodes + num_blocks ||
+       fclose(f) != 0){
+        perror(out);
+        return 1;
+    }
+    return 0;
+}
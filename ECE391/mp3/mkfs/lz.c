@@ -0,0 +1,152 @@
+/* lz.c - LZ4 block compression for the image tools (createfs -z, fscompress) */
+
+#include <string.h>
+#include "lz.h"
+
+#define HASH_BITS           12
+
+/* Length bytes of LZ4, 15 in the token then 255s and the rest */
+static uint8_t* lz_put_len(uint8_t* op, uint32_t len){
+    for(len -= 15; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* One LZ4 sequence: literals, then a match (match_len 0 for the last sequence, which has no match) */
+static uint8_t* lz_put_seq(uint8_t* op, const uint8_t* lit, uint32_t lit_len, uint32_t offset, uint32_t match_len){
+    uint8_t* token = op++;
+    uint32_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+    *token = ((lit_len < 15) ? lit_len : 15) << 4;
+    if(lit_len >= 15)
+        op = lz_put_len(op, lit_len);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if(match_len == 0)
+        return op;
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    *token |= (ml < 15) ? ml : 15;
+    if(ml >= 15)
+        op = lz_put_len(op, ml);
+    return op;
+}
+
+/* Greedy, with a hash of the last place each 4 byte string was seen */
+uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst){
+    int32_t table[1 << HASH_BITS];
+    uint32_t ip = 0, anchor = 0, ref, ml, h, v;
+    uint8_t* op = dst;
+
+    memset(table, -1, sizeof(table));
+    while(ip + LZ_MIN_MATCH <= len){
+        memcpy(&v, src + ip, 4);
+        h = (v * 2654435761U) >> (32 - HASH_BITS);
+        ref = table[h];
+        table[h] = ip;
+        if(ref == (uint32_t)-1 || ip - ref > LZ_MAX_OFFSET || memcmp(src + ref, src + ip, LZ_MIN_MATCH) != 0){
+            ip++;
+            continue;
+        }
+        for(ml = LZ_MIN_MATCH; ip + ml < len && src[ref + ml] == src[ip + ml]; ml++);
+        op = lz_put_seq(op, src + anchor, ip - anchor, ip - ref, ml);
+        ip += ml;
+        anchor = ip;
+    }
+    op = lz_put_seq(op, src + anchor, len - anchor, 0, 0);
+    return op - dst;
+}
+
+/* Same checks as the kernel's lz_decompress, a bad block never writes outside dst */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len){
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+    uint32_t token, len, off, b;
+
+    while(ip < iend){
+        token = *ip++;
+        len = token >> 4;
+        if(len == 15){
+            do{
+                if(ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        if(len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if(ip == iend)
+            break;
+
+        if(iend - ip < 2)
+            return -1;
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(off == 0 || off > (uint32_t)(op - dst))
+            return -1;
+        len = (token & 0xF) + LZ_MIN_MATCH;
+        if((token & 0xF) == 15){
+            do{
+                if(ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        if(len > (uint32_t)(oend - op))
+            return -1;
+        for(; len > 0; len--, op++)
+            *op = *(op - off);
+    }
+    return op - dst;
+}
+
+uint32_t lz_compress_file(const uint8_t* data, uint32_t size, uint8_t* out){
+    uint32_t chunks = (size + LZ_CHUNK_SIZE - 1) / LZ_CHUNK_SIZE;
+    uint32_t pos = 4 * (chunks + 2);
+    uint32_t i, n, clen;
+
+    memcpy(out, &size, 4);
+    for(i = 0; i < chunks; i++){
+        memcpy(out + 4 * (1 + i), &pos, 4);
+        n = (size - i * LZ_CHUNK_SIZE < LZ_CHUNK_SIZE) ? size - i * LZ_CHUNK_SIZE : LZ_CHUNK_SIZE;
+        clen = lz_compress(data + i * LZ_CHUNK_SIZE, n, out + pos);
+        /* A chunk that doesn't get smaller is stored as is, the kernel tells them apart by length */
+        if(clen >= n){
+            memcpy(out + pos, data + i * LZ_CHUNK_SIZE, n);
+            clen = n;
+        }
+        pos += clen;
+    }
+    memcpy(out + 4 * (1 + chunks), &pos, 4);
+    return pos;
+}
+
+int32_t lz_decompress_file(const uint8_t* stored, uint32_t stored_len, uint8_t* data, uint32_t size){
+    uint32_t file_size, chunks, i, n, range[2];
+
+    if(stored_len < 4)
+        return -1;
+    memcpy(&file_size, stored, 4);
+    chunks = (file_size + LZ_CHUNK_SIZE - 1) / LZ_CHUNK_SIZE;
+    if(file_size > size || stored_len < 4 * (chunks + 2))
+        return -1;
+    for(i = 0; i < chunks; i++){
+        memcpy(range, stored + 4 * (1 + i), 8);
+        n = (file_size - i * LZ_CHUNK_SIZE < LZ_CHUNK_SIZE) ? file_size - i * LZ_CHUNK_SIZE : LZ_CHUNK_SIZE;
+        if(range[1] < range[0] || range[1] > stored_len || range[1] - range[0] > LZ_CHUNK_SIZE)
+            return -1;
+        if(range[1] - range[0] == n)
+            memcpy(data + i * LZ_CHUNK_SIZE, stored + range[0], n);
+        else if(lz_decompress(stored + range[0], range[1] - range[0], data + i * LZ_CHUNK_SIZE, n) != (int32_t)n)
+            return -1;
+    }
+    return file_size;
+}
@@ -0,0 +1,26 @@
+#ifndef _LZ_H
+#define _LZ_H
+
+/* LZ4 block compression for the image tools, the kernel side (decompression only) is student-distrib/compress.c.
+ * See student-distrib/compress.h for how a compressed file is stored. */
+
+#include <stdint.h>
+
+#define LZ_CHUNK_SIZE       4096    /* Files are compressed in chunks this big, one data block each */
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       65535
+
+/* Most bytes lz_compress_file can write for a file of size bytes (a header plus every chunk stored as is) */
+#define LZ_FILE_BOUND(size) (4 * (((size) + LZ_CHUNK_SIZE - 1) / LZ_CHUNK_SIZE + 2) + (size) + LZ_CHUNK_SIZE)
+
+/* Compress one chunk, dst needs room for len + len / 255 + 16 bytes. Returns the compressed length. */
+uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst);
+/* Decompress one chunk, returns the number of bytes written or -1 if src is bad */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+/* Turn a whole file into its stored form (header and chunks), returns the stored length */
+uint32_t lz_compress_file(const uint8_t* data, uint32_t size, uint8_t* out);
+/* And back: fills data with the file (up to size bytes), returns the file's size or -1 if the stored form is bad */
+int32_t lz_decompress_file(const uint8_t* stored, uint32_t stored_len, uint8_t* data, uint32_t size);
+
+#endif
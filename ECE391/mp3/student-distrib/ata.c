@@ -0,0 +1,445 @@
+#include "ata.h"
+#include "lib.h"
+#include "i8259.h"
+#include "interrupts.h"
+
+/* One PRD entry: a physical buffer the bus master moves data to or from */
+typedef struct ata_prd {
+    uint32_t addr;
+    uint32_t count;         /* Byte count in the low 16 bits (0 means 64 KB), ATA_PRD_LAST in the last entry */
+} ata_prd_t;
+
+/* The PRD table can't cross a 64 KB boundary, aligning it to its own size keeps it inside one */
+static ata_prd_t ata_prdt[ATA_PRD_ENTRIES] __attribute__((aligned (ATA_PRD_ENTRIES * sizeof(ata_prd_t))));
+static uint32_t ata_drive;          /* ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE */
+static uint32_t ata_sectors;        /* Size of the disk, 0 if there is no disk */
+static uint32_t ata_bm_base;        /* I/O base of the bus master registers, 0 if there is no bus master */
+static uint32_t ata_mode;
+static volatile bool ata_busy;      /* A task is in the middle of a command, see ata_lock */
+static ata_stats_t ata_stats;
+
+static int32_t ata_blk_read(uint32_t blk, uint8_t* buf);
+static int32_t ata_blk_write(uint32_t blk, const uint8_t* buf);
+static int32_t ata_blk_read_many(uint32_t blk, uint32_t count, uint8_t* buf);
+static int32_t ata_blk_write_many(uint32_t blk, uint32_t count, const uint8_t* buf);
+static int32_t ata_transfer(uint32_t lba, uint32_t count, uint8_t* buf, bool write);
+
+blkdev_t ata_blkdev = {
+    .read = ata_blk_read,
+    .write = ata_blk_write,
+    .read_many = ata_blk_read_many,
+    .write_many = ata_blk_write_many,
+    .nblocks = 0,
+};
+
+/*
+ * pci_read
+ *   DESCRIPTION: Reads a 32 bit register from a PCI function's configuration space
+ *   INPUTS: bus, dev, fn -- the function
+ *           reg -- register offset, a multiple of 4
+ *   OUTPUTS: none
+ *   RETURN VALUE: the register, 0xFFFFFFFF if there is no such function
+ *   SIDE EFFECTS: none
+ */
+static uint32_t pci_read(uint32_t bus, uint32_t dev, uint32_t fn, uint32_t reg){
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (fn << 8) | reg, PCI_CONFIG_ADDR);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* See above */
+static void pci_write(uint32_t bus, uint32_t dev, uint32_t fn, uint32_t reg, uint32_t val){
+    outl(PCI_ENABLE | (bus << 16) | (dev << 11) | (fn << 8) | reg, PCI_CONFIG_ADDR);
+    outl(val, PCI_CONFIG_DATA);
+}
+
+/*
+ * ata_find_bus_master
+ *   DESCRIPTION: Looks for the IDE controller on PCI bus 0 and turns on bus mastering for it
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: I/O base of the primary channel's bus master registers, 0 if there is no IDE controller or it can't
+ *                 do DMA
+ *   SIDE EFFECTS: changes the controller's PCI command register
+ */
+static uint32_t ata_find_bus_master(){
+    uint32_t dev, fn, bar;
+
+    for(dev = 0; dev < 32; dev++){
+        for(fn = 0; fn < 8; fn++){
+            if((pci_read(0, dev, fn, PCI_CLASS_REG) >> 16) != PCI_CLASS_IDE)
+                continue;
+            bar = pci_read(0, dev, fn, PCI_BAR4_REG);
+            /* Has to be an I/O BAR */
+            if(!(bar & 1) || (bar & ~0x3) == 0)
+                return 0;
+            pci_write(0, dev, fn, PCI_COMMAND_REG, pci_read(0, dev, fn, PCI_COMMAND_REG) | PCI_CMD_IO | PCI_CMD_MASTER);
+            return bar & ~0x3;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ata_interrupt
+ *   DESCRIPTION: IRQ 14 handler. A transfer waiting with hlt is woken by this, it checks the status itself, so all we
+ *                do is acknowledge the interrupt at the disk, the bus master and the PIC.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reads the status register
+ */
+DECLARE_ISR(ata_interrupt){
+    inb(ATA_STATUS_PORT);
+    if(ata_bm_base != 0)
+        outb(inb(ata_bm_base + ATA_BM_STATUS) | ATA_BM_IRQ, ata_bm_base + ATA_BM_STATUS);
+    ata_stats.irqs++;
+    send_eoi(ATA_INT_NUM);
+}
+
+/*
+ * ata_wait
+ *   DESCRIPTION: Waits until the disk isn't busy and, for a DMA transfer, the bus master is done. With interrupts on we
+ *                hlt between checks, so IRQ 14 wakes us when the disk finishes and the PIT can switch to another task
+ *                in the meantime. With interrupts off (a system call made through an interrupt gate, a cli section) we
+ *                poll.
+ *   INPUTS: dma -- wait for the bus master too
+ *           drq -- also wait for the disk to want data (the next sector of a PIO transfer)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 when done, -1 on a disk or bus master error or timeout
+ *   SIDE EFFECTS: may hlt
+ */
+static int32_t ata_wait(bool dma, bool drq){
+    uint32_t flags;
+    uint32_t status, bm_status;
+    uint32_t tries;
+
+    cli_and_save(flags);
+    for(tries = 0; tries < ATA_TIMEOUT; tries++){
+        status = inb(ATA_ALT_STATUS_PORT);
+        bm_status = dma ? inb(ata_bm_base + ATA_BM_STATUS) : 0;
+        if((status & (ATA_SR_ERR | ATA_SR_DF)) || (bm_status & ATA_BM_ERROR))
+            break;
+        if(!(status & ATA_SR_BSY) && (!drq || (status & ATA_SR_DRQ)) && !(bm_status & ATA_BM_ACTIVE)){
+            restore_flags(flags);
+            return 0;
+        }
+        /* sti only takes effect after the next instruction, so an interrupt can't sneak in before the hlt */
+        if(flags & ATA_IF_FLAG){
+            ata_stats.sleeps++;
+            asm volatile("sti; hlt; cli" : : : "memory");
+        }
+    }
+    restore_flags(flags);
+    ata_stats.errors++;
+    return -1;
+}
+
+/*
+ * ata_lock and ata_unlock
+ *   DESCRIPTION: Only one command can be on the channel at a time. A task that finds it taken waits with hlt, the task
+ *                that has it gets to run again at some PIT tick and finishes its command.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: ata_lock: 0 once we have the channel, -1 if it is taken and interrupts are off (waiting would never
+ *                 end)
+ *   SIDE EFFECTS: may hlt
+ */
+static int32_t ata_lock(){
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(ata_busy){
+        if(!(flags & ATA_IF_FLAG)){
+            restore_flags(flags);
+            return -1;
+        }
+        asm volatile("sti; hlt; cli" : : : "memory");
+    }
+    ata_busy = true;
+    restore_flags(flags);
+    return 0;
+}
+/* See above */
+static void ata_unlock(){
+    ata_busy = false;
+}
+
+/*
+ * ata_command
+ *   DESCRIPTION: Sends a command with a 28 bit LBA and a sector count to the master
+ *   INPUTS: cmd -- command
+ *           lba -- first sector
+ *           count -- number of sectors, 1 to ATA_MAX_SECTORS
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the disk took it, -1 if it stayed busy
+ *   SIDE EFFECTS: starts the command
+ */
+static int32_t ata_command(uint32_t cmd, uint32_t lba, uint32_t count){
+    if(ata_wait(false, false) == -1)
+        return -1;
+    outb(ata_drive | ((lba >> 24) & 0x0F), ATA_DRIVE_PORT);
+    outb(count, ATA_COUNT_PORT);
+    outb(lba & 0xFF, ATA_LBA_LO_PORT);
+    outb((lba >> 8) & 0xFF, ATA_LBA_MID_PORT);
+    outb((lba >> 16) & 0xFF, ATA_LBA_HI_PORT);
+    outb(cmd, ATA_CMD_PORT);
+    /* The status isn't good until 400 ns after the command, 4 reads of the alternate status take that long */
+    inb(ATA_ALT_STATUS_PORT);
+    inb(ATA_ALT_STATUS_PORT);
+    inb(ATA_ALT_STATUS_PORT);
+    inb(ATA_ALT_STATUS_PORT);
+    return 0;
+}
+
+/*
+ * ata_init
+ *   DESCRIPTION: Looks for a disk on the primary channel with IDENTIFY, and for the IDE controller's bus master. DMA is
+ *                used if there is one, PIO otherwise.
+ *   INPUTS: drive -- ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if there is a disk, -1 if not
+ *   SIDE EFFECTS: installs and unmasks the IRQ 14 handler
+ */
+int32_t ata_init(uint32_t drive){
+    uint16_t id[ATA_SECTOR_SIZE / 2];
+    uint32_t i;
+
+    ata_drive = drive;
+    ata_sectors = 0;
+    ata_blkdev.nblocks = 0;
+    ata_busy = false;
+    ata_stats.commands = 0;
+    ata_stats.sectors_read = 0;
+    ata_stats.sectors_written = 0;
+    ata_stats.irqs = 0;
+    ata_stats.sleeps = 0;
+    ata_stats.errors = 0;
+    load_int(ATA_INT_NUM, &ata_interrupt, KERNEL_SEGMENT, INTERRUPT_DPL);
+    enable_irq(ATA_INT_NUM);
+
+    /* A floating bus reads back all ones */
+    if(inb(ATA_STATUS_PORT) == 0xFF)
+        return -1;
+    outb(ata_drive, ATA_DRIVE_PORT);
+    /* Selecting a drive takes 400 ns to show in the status */
+    for(i = 0; i < 4; i++)
+        inb(ATA_ALT_STATUS_PORT);
+    outb(0, ATA_COUNT_PORT);
+    outb(0, ATA_LBA_LO_PORT);
+    outb(0, ATA_LBA_MID_PORT);
+    outb(0, ATA_LBA_HI_PORT);
+    outb(ATA_CMD_IDENTIFY, ATA_CMD_PORT);
+    if(inb(ATA_STATUS_PORT) == 0)
+        return -1;
+    /* An ATAPI drive (a CD) sets the LBA registers instead of answering, we only want disks */
+    for(i = 0; i < ATA_TIMEOUT && (inb(ATA_STATUS_PORT) & ATA_SR_BSY); i++);
+    if(inb(ATA_LBA_MID_PORT) != 0 || inb(ATA_LBA_HI_PORT) != 0)
+        return -1;
+    for(i = 0; i < ATA_TIMEOUT && !(inb(ATA_STATUS_PORT) & (ATA_SR_DRQ | ATA_SR_ERR)); i++);
+    if(!(inb(ATA_STATUS_PORT) & ATA_SR_DRQ))
+        return -1;
+    for(i = 0; i < ATA_SECTOR_SIZE / 2; i++)
+        id[i] = inw(ATA_DATA_PORT);
+
+    /* Words 60 and 61 are the number of LBA28 sectors */
+    ata_sectors = id[60] | ((uint32_t)id[61] << 16);
+    ata_blkdev.nblocks = ata_sectors / ATA_BLOCK_SECTORS;
+    ata_bm_base = ata_find_bus_master();
+    ata_mode = (ata_bm_base != 0) ? ATA_MODE_DMA : ATA_MODE_PIO;
+    return (ata_sectors > 0) ? 0 : -1;
+}
+
+/* Here to make code more readable
+Description: number of sectors on the disk, 0 if there is no disk */
+uint32_t ata_num_sectors(){
+    return ata_sectors;
+}
+
+/*
+ * ata_set_mode
+ *   DESCRIPTION: Picks how later transfers move their data: PIO (the CPU copies every word through the data port) or
+ *                DMA (the bus master copies it to memory while the CPU does something else)
+ *   INPUTS: mode -- ATA_MODE_PIO or ATA_MODE_DMA
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the mode is bad or DMA was asked for without a bus master
+ *   SIDE EFFECTS: none
+ */
+int32_t ata_set_mode(uint32_t mode){
+    if(mode != ATA_MODE_PIO && (mode != ATA_MODE_DMA || ata_bm_base == 0))
+        return -1;
+    ata_mode = mode;
+    return 0;
+}
+
+/* Here to make code more readable
+Description: mode transfers use now, ATA_MODE_PIO or ATA_MODE_DMA */
+uint32_t ata_get_mode(){
+    return ata_mode;
+}
+
+/*
+ * ata_read and ata_write
+ *   DESCRIPTION: Reads or writes sectors, ATA_MAX_SECTORS per command. Writes are flushed out of the disk's cache
+ *                before we return.
+ *   INPUTS: lba -- first sector
+ *           count -- number of sectors
+ *           buf -- count * ATA_SECTOR_SIZE bytes, identity mapped for DMA
+ *   OUTPUTS: ata_read fills buf
+ *   RETURN VALUE: 0 on success, -1 if there is no disk, the sectors run past its end, or a command failed
+ *   SIDE EFFECTS: may hlt while the disk works, so other tasks can run
+ */
+int32_t ata_read(uint32_t lba, uint32_t count, uint8_t* buf){
+    return ata_transfer(lba, count, buf, false);
+}
+/* See above */
+int32_t ata_write(uint32_t lba, uint32_t count, const uint8_t* buf){
+    return ata_transfer(lba, count, (uint8_t*)buf, true);
+}
+
+/*
+ * ata_pio
+ *   DESCRIPTION: One PIO command, the data goes through the data port a word at a time
+ *   INPUTS: lba, count, buf, write -- see ata_transfer, count is at most ATA_MAX_SECTORS
+ *   OUTPUTS: fills buf on a read
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may hlt
+ */
+static int32_t ata_pio(uint32_t lba, uint32_t count, uint8_t* buf, bool write){
+    uint32_t i, words;
+
+    if(ata_command(write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO, lba, count) == -1)
+        return -1;
+    /* The disk raises DRQ (and IRQ 14) for every sector, rep insw/outsw moves the 256 words of one */
+    for(i = 0; i < count; i++){
+        if(ata_wait(false, true) == -1)
+            return -1;
+        words = ATA_SECTOR_SIZE / 2;
+        if(write)
+            asm volatile("cld; rep outsw" : "+S"(buf), "+c"(words) : "d"(ATA_DATA_PORT) : "memory");
+        else
+            asm volatile("cld; rep insw" : "+D"(buf), "+c"(words) : "d"(ATA_DATA_PORT) : "memory");
+    }
+    return ata_wait(false, false);
+}
+
+/*
+ * ata_dma
+ *   DESCRIPTION: One DMA command. The buffer is described to the bus master in the PRD table, split wherever it crosses
+ *                a 64 KB boundary, and the bus master moves all of it while we wait for IRQ 14.
+ *   INPUTS: lba, count, buf, write -- see ata_transfer, count is at most ATA_MAX_SECTORS
+ *   OUTPUTS: fills buf on a read
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may hlt
+ */
+static int32_t ata_dma(uint32_t lba, uint32_t count, uint8_t* buf, bool write){
+    uint32_t addr = (uint32_t)buf;
+    uint32_t left = count * ATA_SECTOR_SIZE;
+    uint32_t span;
+    uint32_t dir = write ? 0 : ATA_BM_READ;
+    int32_t n = 0, ret;
+
+    while(left > 0){
+        span = ATA_PRD_MAX - (addr & (ATA_PRD_MAX - 1));
+        if(span > left)
+            span = left;
+        ata_prdt[n].addr = addr;
+        ata_prdt[n].count = span & 0xFFFF;
+        addr += span;
+        left -= span;
+        n++;
+    }
+    ata_prdt[n - 1].count |= ATA_PRD_LAST;
+
+    outb(dir, ata_bm_base + ATA_BM_CMD);
+    outl((uint32_t)ata_prdt, ata_bm_base + ATA_BM_PRDT);
+    outb(inb(ata_bm_base + ATA_BM_STATUS) | ATA_BM_ERROR | ATA_BM_IRQ, ata_bm_base + ATA_BM_STATUS);
+    if(ata_command(write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, lba, count) == -1)
+        return -1;
+    outb(dir | ATA_BM_START, ata_bm_base + ATA_BM_CMD);
+    ret = ata_wait(true, false);
+    outb(dir, ata_bm_base + ATA_BM_CMD);
+    return ret;
+}
+
+/*
+ * ata_transfer
+ *   DESCRIPTION: Splits a transfer into commands of ATA_MAX_SECTORS and runs them in the current mode
+ *   INPUTS: lba -- first sector
+ *           count -- number of sectors
+ *           buf -- the data
+ *           write -- true to write buf to the disk
+ *   OUTPUTS: fills buf on a read
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may hlt, updates the counters
+ */
+static int32_t ata_transfer(uint32_t lba, uint32_t count, uint8_t* buf, bool write){
+    uint32_t n;
+    int32_t ret = 0;
+
+    if(ata_sectors == 0 || lba >= ata_sectors || count > ata_sectors - lba)
+        return -1;
+    if(ata_lock() == -1)
+        return -1;
+    while(count > 0 && ret == 0){
+        n = (count < ATA_MAX_SECTORS) ? count : ATA_MAX_SECTORS;
+        ata_stats.commands++;
+        if(ata_mode == ATA_MODE_DMA)
+            ret = ata_dma(lba, n, buf, write);
+        else
+            ret = ata_pio(lba, n, buf, write);
+        if(ret == 0 && write)
+            ata_stats.sectors_written += n;
+        else if(ret == 0)
+            ata_stats.sectors_read += n;
+        lba += n;
+        count -= n;
+        buf += n * ATA_SECTOR_SIZE;
+    }
+    /* Make sure the writes are on the disk and not just in its cache */
+    if(ret == 0 && write && (ata_command(ATA_CMD_FLUSH, 0, 0) == -1 || ata_wait(false, false) == -1))
+        ret = -1;
+    ata_unlock();
+    return ret;
+}
+
+/*
+ * ata_blk_read, ata_blk_write, ata_blk_read_many and ata_blk_write_many
+ *   DESCRIPTION: Block device ops for the disk, block blk is sectors blk * ATA_BLOCK_SECTORS and up
+ *   INPUTS: blk -- block number
+ *           count -- number of blocks (the _many ones)
+ *           buf -- BLOCK_SIZE bytes per block
+ *   OUTPUTS: the reads fill buf
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: see ata_transfer
+ */
+static int32_t ata_blk_read(uint32_t blk, uint8_t* buf){
+    return ata_blk_read_many(blk, 1, buf);
+}
+/* See above */
+static int32_t ata_blk_write(uint32_t blk, const uint8_t* buf){
+    return ata_blk_write_many(blk, 1, buf);
+}
+/* See above */
+static int32_t ata_blk_read_many(uint32_t blk, uint32_t count, uint8_t* buf){
+    if(blk >= ata_blkdev.nblocks || count > ata_blkdev.nblocks - blk)
+        return -1;
+    return ata_read(blk * ATA_BLOCK_SECTORS, count * ATA_BLOCK_SECTORS, buf);
+}
+/* See above */
+static int32_t ata_blk_write_many(uint32_t blk, uint32_t count, const uint8_t* buf){
+    if(blk >= ata_blkdev.nblocks || count > ata_blkdev.nblocks - blk)
+        return -1;
+    return ata_write(blk * ATA_BLOCK_SECTORS, count * ATA_BLOCK_SECTORS, buf);
+}
+
+/*
+ * ata_get_stats
+ *   DESCRIPTION: Copies out the driver counters
+ *   INPUTS: stats -- filled with the counters
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void ata_get_stats(ata_stats_t* stats){
+    *stats = ata_stats;
+}
@@ -0,0 +1,96 @@
+#ifndef _ATA_H
+#define _ATA_H
+
+#include "types.h"
+#include "bcache.h"
+
+/* Primary channel of the IDE controller. GRUB boots from its master (mp3.img, QEMU's -hda), the filesystem disk is
+ * normally the slave (-hdb filesys_img). */
+#define ATA_DATA_PORT         0x1F0
+#define ATA_ERROR_PORT        0x1F1
+#define ATA_COUNT_PORT        0x1F2
+#define ATA_LBA_LO_PORT       0x1F3
+#define ATA_LBA_MID_PORT      0x1F4
+#define ATA_LBA_HI_PORT       0x1F5
+#define ATA_DRIVE_PORT        0x1F6
+#define ATA_STATUS_PORT       0x1F7     /* Reading it acknowledges the interrupt */
+#define ATA_CMD_PORT          0x1F7
+#define ATA_ALT_STATUS_PORT   0x3F6     /* Same as the status port without acknowledging anything */
+#define ATA_INT_NUM           0x2E      /* IRQ 14 */
+
+#define ATA_CMD_READ_PIO      0x20
+#define ATA_CMD_WRITE_PIO     0x30
+#define ATA_CMD_READ_DMA      0xC8
+#define ATA_CMD_WRITE_DMA     0xCA
+#define ATA_CMD_FLUSH         0xE7
+#define ATA_CMD_IDENTIFY      0xEC
+#define ATA_DRIVE_MASTER      0xE0      /* Drive select with LBA addressing, OR'd with bits 24-27 of the LBA */
+#define ATA_DRIVE_SLAVE       0xF0
+
+#define ATA_SR_BSY            0x80
+#define ATA_SR_DF             0x20
+#define ATA_SR_DRQ            0x08
+#define ATA_SR_ERR            0x01
+
+/* Bus master registers, at the I/O base in BAR4 of the controller's PCI config space */
+#define ATA_BM_CMD            0x0       /* Bit 0 starts the transfer, bit 3 set means disk to memory */
+#define ATA_BM_STATUS         0x2       /* Bit 0 active, bit 1 error, bit 2 interrupt (write 1 to clear 1 and 2) */
+#define ATA_BM_PRDT           0x4       /* Physical address of the PRD table */
+#define ATA_BM_START          0x01
+#define ATA_BM_READ           0x08
+#define ATA_BM_ACTIVE         0x01
+#define ATA_BM_ERROR          0x02
+#define ATA_BM_IRQ            0x04
+#define ATA_PRD_LAST          0x80000000    /* Set in the last PRD entry */
+#define ATA_PRD_ENTRIES       4         /* A 64 KB transfer can cross at most one 64 KB boundary, so 2 would do */
+#define ATA_PRD_MAX           0x10000   /* Bytes one PRD entry can describe, it can't cross a 64 KB boundary either */
+
+/* PCI configuration space, mechanism 1 */
+#define PCI_CONFIG_ADDR       0xCF8
+#define PCI_CONFIG_DATA       0xCFC
+#define PCI_ENABLE            0x80000000
+#define PCI_CLASS_REG         0x08
+#define PCI_COMMAND_REG       0x04
+#define PCI_BAR4_REG          0x20
+#define PCI_CLASS_IDE         0x0101    /* Mass storage, IDE */
+#define PCI_CMD_IO            0x01
+#define PCI_CMD_MASTER        0x04
+
+#define ATA_SECTOR_SIZE       512
+#define ATA_BLOCK_SECTORS     (BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define ATA_MAX_SECTORS       128       /* Sectors per command, 64 KB (and one PRD entry's worth) */
+#define ATA_TIMEOUT           10000000  /* Status reads (or wakeups) before we give up on the disk */
+#define ATA_IF_FLAG           0x200     /* Interrupt flag in EFLAGS, tells ata_wait if it can hlt */
+
+#define ATA_MODE_PIO          0
+#define ATA_MODE_DMA          1
+
+/* Driver counters, read with ata_get_stats */
+typedef struct ata_stats {
+    uint32_t commands;      /* Read and write commands sent to the disk */
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t irqs;          /* IRQ 14s taken */
+    uint32_t sleeps;        /* Times a transfer waited with hlt (so other tasks could run) instead of polling */
+    uint32_t errors;        /* Commands the disk or the bus master failed, or that timed out */
+} ata_stats_t;
+
+/* Find the disk (ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE) and the bus master, install the IRQ 14 handler. Returns 0 if
+ * there is a disk. */
+int32_t ata_init(uint32_t drive);
+/* Number of sectors on the disk, 0 if there isn't one */
+uint32_t ata_num_sectors();
+/* Pick PIO or DMA for the transfers after this, -1 if DMA was asked for and there is no bus master */
+int32_t ata_set_mode(uint32_t mode);
+uint32_t ata_get_mode();
+
+/* Read or write count sectors starting at lba. buf has to be identity mapped for DMA (kernel memory is). */
+int32_t ata_read(uint32_t lba, uint32_t count, uint8_t* buf);
+int32_t ata_write(uint32_t lba, uint32_t count, const uint8_t* buf);
+
+/* The disk as a block device of BLOCK_SIZE blocks, for fs_mount_dev and the buffer cache */
+extern blkdev_t ata_blkdev;
+
+void ata_get_stats(ata_stats_t* stats);
+
+#endif
@@ -0,0 +1,403 @@
+#include "bcache.h"
+#include "blk.h"
+#include "lib.h"
+
+/* Block buffers and their bookkeeping, bcache_bufs[i] describes bcache_data[i] */
+static uint8_t bcache_data[BCACHE_SIZE][BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static bcache_buf_t bcache_bufs[BCACHE_SIZE];
+static int32_t bcache_hash[BCACHE_HASH_SIZE];   /* First buffer on each hash chain */
+static int32_t bcache_lru_head;     /* Most recently used buffer */
+static int32_t bcache_lru_tail;     /* Least recently used buffer, eviction starts looking here */
+static blkdev_t* bcache_dev;
+static blk_queue_t bcache_queue;    /* Every device access goes through here */
+static blk_request_t bcache_reqs[BCACHE_SIZE];  /* bcache_flush's write for bcache_data[i] */
+static bcache_stats_t bcache_stats;
+static bool bcache_writethrough;
+static uint32_t bcache_gen;         /* Bumped whenever a buffer changes contents or block, see bcache_generation */
+
+#define BCACHE_HASH(blk)    ((blk) & (BCACHE_HASH_SIZE - 1))
+
+static int32_t bcache_writeback(int i);
+static void bcache_flush_done(blk_request_t* req, int32_t status);
+static void bcache_lru_remove(int i);
+static void bcache_lru_add(int i, bool front);
+static void bcache_hash_remove(int i);
+
+/*
+ * bcache_init
+ *   DESCRIPTION: Empties the buffer cache and puts it in front of a block device
+ *   INPUTS: dev -- device the cached blocks are read from and written back to
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: drops anything that was cached (without writing it back) and clears the counters
+ */
+void bcache_init(blkdev_t* dev){
+    int i;
+
+    for(i = 0; i < BCACHE_HASH_SIZE; i++)
+        bcache_hash[i] = BCACHE_NONE;
+    bcache_lru_head = bcache_lru_tail = BCACHE_NONE;
+    for(i = 0; i < BCACHE_SIZE; i++){
+        bcache_bufs[i].blk = BCACHE_NO_BLOCK;
+        bcache_bufs[i].hash_next = BCACHE_NONE;
+        bcache_bufs[i].pins = 0;
+        bcache_bufs[i].dirty = false;
+        bcache_lru_add(i, false);
+    }
+    bcache_dev = dev;
+    blk_queue_init(&bcache_queue, dev);
+    bcache_gen++;
+    bcache_writethrough = false;
+    bcache_stats.hits = 0;
+    bcache_stats.misses = 0;
+    bcache_stats.writebacks = 0;
+    bcache_stats.evictions = 0;
+    bcache_stats.read_hits = 0;
+    bcache_stats.read_misses = 0;
+}
+
+/*
+ * bcache_find
+ *   DESCRIPTION: Finds the buffer holding a block by walking its hash chain
+ *   INPUTS: blk -- block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the buffer, -1 if the block isn't cached
+ *   SIDE EFFECTS: none
+ */
+static int bcache_find(uint32_t blk){
+    int i;
+
+    for(i = bcache_hash[BCACHE_HASH(blk)]; i != BCACHE_NONE; i = bcache_bufs[i].hash_next){
+        if(bcache_bufs[i].blk == blk)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * bcache_lru_remove
+ *   DESCRIPTION: Takes a buffer off the LRU list
+ *   INPUTS: i -- index of the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void bcache_lru_remove(int i){
+    if(bcache_bufs[i].lru_prev == BCACHE_NONE)
+        bcache_lru_head = bcache_bufs[i].lru_next;
+    else
+        bcache_bufs[bcache_bufs[i].lru_prev].lru_next = bcache_bufs[i].lru_next;
+    if(bcache_bufs[i].lru_next == BCACHE_NONE)
+        bcache_lru_tail = bcache_bufs[i].lru_prev;
+    else
+        bcache_bufs[bcache_bufs[i].lru_next].lru_prev = bcache_bufs[i].lru_prev;
+}
+
+/*
+ * bcache_lru_add
+ *   DESCRIPTION: Puts a buffer on the LRU list, at the front (just used) or the end (free, reused first)
+ *   INPUTS: i -- index of the buffer, not on the list
+ *           front -- true for the front
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void bcache_lru_add(int i, bool front){
+    if(front){
+        bcache_bufs[i].lru_prev = BCACHE_NONE;
+        bcache_bufs[i].lru_next = bcache_lru_head;
+        if(bcache_lru_head == BCACHE_NONE)
+            bcache_lru_tail = i;
+        else
+            bcache_bufs[bcache_lru_head].lru_prev = i;
+        bcache_lru_head = i;
+    }
+    else{
+        bcache_bufs[i].lru_next = BCACHE_NONE;
+        bcache_bufs[i].lru_prev = bcache_lru_tail;
+        if(bcache_lru_tail == BCACHE_NONE)
+            bcache_lru_head = i;
+        else
+            bcache_bufs[bcache_lru_tail].lru_next = i;
+        bcache_lru_tail = i;
+    }
+}
+
+/*
+ * bcache_hash_remove
+ *   DESCRIPTION: Takes a buffer off the hash chain of the block it holds
+ *   INPUTS: i -- index of the buffer, holding a block
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void bcache_hash_remove(int i){
+    int32_t* link = &bcache_hash[BCACHE_HASH(bcache_bufs[i].blk)];
+
+    while(*link != i)
+        link = &bcache_bufs[*link].hash_next;
+    *link = bcache_bufs[i].hash_next;
+    bcache_bufs[i].hash_next = BCACHE_NONE;
+}
+
+/*
+ * bcache_get
+ *   DESCRIPTION: Gets the buffer for a block. If the block isn't cached we take the least recently used buffer that
+ *                isn't pinned (free buffers are at the end of the list, so those go first), writing it back if it is
+ *                dirty. The buffer is pinned while it is filled, in case the device lets other tasks run.
+ *   INPUTS: blk -- block number
+ *           fill -- read the block's current contents from the device on a miss. Callers that are about to overwrite
+ *                   the whole block (or that just allocated it) can skip the read.
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the BLOCK_SIZE buffer for the block, NULL on failure (or if every buffer is pinned)
+ *   SIDE EFFECTS: may write back another block, updates the counters
+ */
+uint8_t* bcache_get(uint32_t blk, bool fill){
+    int i;
+    int32_t status = 0;
+
+    if(bcache_dev == NULL || blk >= bcache_dev->nblocks)
+        return NULL;
+
+    i = bcache_find(blk);
+    if(i != -1){
+        bcache_stats.hits++;
+        bcache_lru_remove(i);
+        bcache_lru_add(i, true);
+        return bcache_data[i];
+    }
+    bcache_stats.misses++;
+
+    for(i = bcache_lru_tail; i != BCACHE_NONE && bcache_bufs[i].pins != 0; i = bcache_bufs[i].lru_prev);
+    if(i == BCACHE_NONE)
+        return NULL;
+    if(bcache_bufs[i].blk != BCACHE_NO_BLOCK){
+        if(bcache_bufs[i].dirty && bcache_writeback(i) == -1)
+            return NULL;
+        bcache_hash_remove(i);
+        bcache_stats.evictions++;
+    }
+
+    bcache_gen++;
+    bcache_bufs[i].blk = blk;
+    bcache_bufs[i].dirty = false;
+    bcache_bufs[i].hash_next = bcache_hash[BCACHE_HASH(blk)];
+    bcache_hash[BCACHE_HASH(blk)] = i;
+    bcache_lru_remove(i);
+    bcache_lru_add(i, true);
+    if(fill){
+        bcache_bufs[i].pins++;
+        status = blk_rw(&bcache_queue, blk, 1, bcache_data[i], false);
+        bcache_bufs[i].pins--;
+    }
+    if(status == -1){
+        bcache_forget(blk);
+        return NULL;
+    }
+    return bcache_data[i];
+}
+
+/*
+ * bcache_lookup
+ *   DESCRIPTION: Gets the buffer for a block only if the block is already cached. Readers that can go to the device
+ *                directly use this to pick up changes that haven't been written back yet.
+ *   INPUTS: blk -- block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the buffer, NULL if the block isn't cached
+ *   SIDE EFFECTS: none
+ */
+uint8_t* bcache_lookup(uint32_t blk){
+    int i = bcache_find(blk);
+
+    if(i == -1)
+        return NULL;
+    return bcache_data[i];
+}
+
+/*
+ * bcache_pin
+ *   DESCRIPTION: Looks up a block for a file read. If it is cached the buffer counts as just used and is pinned, so it
+ *                keeps holding the block while the reader copies out of it (with interrupts on) and calls bcache_unpin.
+ *                Otherwise the reader goes to the image, which is up to date for any block that isn't cached.
+ *   INPUTS: blk -- block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the buffer, NULL if the block isn't cached
+ *   SIDE EFFECTS: updates the read counters
+ */
+uint8_t* bcache_pin(uint32_t blk){
+    int i = bcache_find(blk);
+
+    if(i == -1){
+        bcache_stats.read_misses++;
+        return NULL;
+    }
+    bcache_stats.read_hits++;
+    bcache_bufs[i].pins++;
+    bcache_lru_remove(i);
+    bcache_lru_add(i, true);
+    return bcache_data[i];
+}
+
+/*
+ * bcache_unpin
+ *   DESCRIPTION: Lets a buffer bcache_pin returned be reused again
+ *   INPUTS: buf -- the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void bcache_unpin(const uint8_t* buf){
+    int i = (buf - bcache_data[0]) / BLOCK_SIZE;
+
+    if(i >= 0 && i < BCACHE_SIZE && bcache_bufs[i].pins > 0)
+        bcache_bufs[i].pins--;
+}
+
+/*
+ * bcache_dirty
+ *   DESCRIPTION: Marks a cached block as changed. It is written to the device when its buffer is reused or the cache is
+ *                flushed, or right away in write through mode.
+ *   INPUTS: blk -- block number, must be cached (get it with bcache_get first)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the block isn't cached or the write through failed
+ *   SIDE EFFECTS: may write to the device
+ */
+int32_t bcache_dirty(uint32_t blk){
+    int i = bcache_find(blk);
+
+    if(i == -1)
+        return -1;
+    bcache_gen++;
+    bcache_bufs[i].dirty = true;
+    if(bcache_writethrough)
+        return bcache_writeback(i);
+    return 0;
+}
+
+/*
+ * bcache_writeback
+ *   DESCRIPTION: Writes one dirty buffer to the device
+ *   INPUTS: i -- index of the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (the buffer stays dirty)
+ *   SIDE EFFECTS: writes to the device
+ */
+static int32_t bcache_writeback(int i){
+    if(blk_rw(&bcache_queue, bcache_bufs[i].blk, 1, bcache_data[i], true) == -1)
+        return -1;
+    bcache_bufs[i].dirty = false;
+    bcache_stats.writebacks++;
+    return 0;
+}
+
+/*
+ * bcache_flush
+ *   DESCRIPTION: Writes every dirty buffer to the device. They all go to the block queue before it is unplugged, so
+ *                the device sees them in one elevator sweep with consecutive blocks merged into one write.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of blocks written, -1 if any write failed
+ *   SIDE EFFECTS: writes to the device, buffers stay cached (clean)
+ */
+int32_t bcache_flush(){
+    int i;
+    uint32_t before = bcache_stats.writebacks;
+
+    if(bcache_dev == NULL)
+        return -1;
+
+    for(i = 0; i < BCACHE_SIZE; i++){
+        if(!bcache_bufs[i].dirty)
+            continue;
+        bcache_reqs[i].blk = bcache_bufs[i].blk;
+        bcache_reqs[i].count = 1;
+        bcache_reqs[i].buf = bcache_data[i];
+        bcache_reqs[i].write = true;
+        bcache_reqs[i].done = bcache_flush_done;
+        blk_submit(&bcache_queue, &bcache_reqs[i]);
+    }
+    if(blk_unplug(&bcache_queue) != 0)
+        return -1;
+    return bcache_stats.writebacks - before;
+}
+
+/*
+ * bcache_flush_done
+ *   DESCRIPTION: Completion callback for bcache_flush's writes, a buffer is clean once its write made it
+ *   INPUTS: req -- one of bcache_reqs
+ *           status -- 0 on success, -1 on failure (the buffer stays dirty)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void bcache_flush_done(blk_request_t* req, int32_t status){
+    if(status != 0)
+        return;
+    bcache_bufs[req - bcache_reqs].dirty = false;
+    bcache_stats.writebacks++;
+}
+
+/*
+ * bcache_forget
+ *   DESCRIPTION: Drops a block from the cache without writing it back, used when the filesystem frees the block
+ *   INPUTS: blk -- block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void bcache_forget(uint32_t blk){
+    int i = bcache_find(blk);
+
+    if(i == -1)
+        return;
+    bcache_gen++;
+    bcache_hash_remove(i);
+    bcache_bufs[i].blk = BCACHE_NO_BLOCK;
+    bcache_bufs[i].dirty = false;
+    bcache_lru_remove(i);
+    bcache_lru_add(i, false);
+}
+
+/*
+ * bcache_generation
+ *   DESCRIPTION: Gets a counter that changes every time a cached block is written to or a buffer starts holding a
+ *                different block. Anyone who remembers where a block's data lives (the image or a buffer) can check
+ *                this to know if that is still right.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current generation
+ *   SIDE EFFECTS: none
+ */
+uint32_t bcache_generation(){
+    return bcache_gen;
+}
+
+/*
+ * bcache_set_writethrough
+ *   DESCRIPTION: Switches between write back (dirty blocks are batched until eviction or flush) and write through
+ *                (every bcache_dirty goes to the device right away). Switching to write through flushes first.
+ *   INPUTS: on -- true for write through
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may write to the device
+ */
+void bcache_set_writethrough(bool on){
+    if(on)
+        bcache_flush();
+    bcache_writethrough = on;
+}
+
+/*
+ * bcache_get_stats
+ *   DESCRIPTION: Copies out the cache counters
+ *   INPUTS: stats -- where to copy them
+ *   OUTPUTS: the counters into *stats
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void bcache_get_stats(bcache_stats_t* stats){
+    if(stats == NULL)
+        return;
+
+    *stats = bcache_stats;
+}
@@ -0,0 +1,66 @@
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include "types.h"
+
+#define BCACHE_SIZE         32      /* Number of 4 KB buffers in the cache */
+#define BCACHE_HASH_SIZE    64      /* Hash chains for looking up a block, a power of 2 */
+#define BCACHE_NO_BLOCK     0xFFFFFFFF
+#define BCACHE_NONE         (-1)    /* End of a hash chain or of the LRU list */
+
+/* A block device, block numbers count BLOCK_SIZE blocks from the start of the filesystem image (block 0 is the boot block) */
+typedef struct blkdev {
+    int32_t (*read)(uint32_t blk, uint8_t* buf);            /* Read one block into buf, 0 on success, -1 on failure */
+    int32_t (*write)(uint32_t blk, const uint8_t* buf);     /* Write one block from buf, 0 on success, -1 on failure */
+    /* Same for count consecutive blocks at once, NULL if the device only goes a block at a time */
+    int32_t (*read_many)(uint32_t blk, uint32_t count, uint8_t* buf);
+    int32_t (*write_many)(uint32_t blk, uint32_t count, const uint8_t* buf);
+    uint32_t nblocks;                                       /* Number of blocks on the device */
+} blkdev_t;
+
+/* One cached block. Buffers holding a block are on the hash chain for it, every buffer is on the LRU list (most
+ * recently used first, free buffers at the end). */
+typedef struct bcache_buf {
+    uint32_t blk;           /* Block number this buffer holds, BCACHE_NO_BLOCK if free */
+    int32_t hash_next;      /* Next buffer on the same hash chain */
+    int32_t lru_prev;       /* Buffer used more recently */
+    int32_t lru_next;       /* Buffer used less recently */
+    uint32_t pins;          /* Readers copying out of the buffer, it isn't reused while this is not 0 */
+    bool dirty;             /* Buffer has changes that haven't been written to the device yet */
+} bcache_buf_t;
+
+/* Cache counters, read with bcache_get_stats */
+typedef struct bcache_stats {
+    uint32_t hits;          /* bcache_get found the block already in the cache */
+    uint32_t misses;        /* bcache_get had to take a buffer for the block */
+    uint32_t writebacks;    /* Dirty blocks written to the device */
+    uint32_t evictions;     /* Blocks dropped from the cache to make room for another */
+    uint32_t read_hits;     /* bcache_pin found the block cached, the read was served from the buffer */
+    uint32_t read_misses;   /* bcache_pin didn't, the reader went to the image */
+} bcache_stats_t;
+
+/* Set up the cache in front of a device */
+void bcache_init(blkdev_t* dev);
+
+/* Get the buffer for a block, reading it from the device if fill is set */
+uint8_t* bcache_get(uint32_t blk, bool fill);
+/* Get the buffer for a block only if it is already cached */
+uint8_t* bcache_lookup(uint32_t blk);
+/* Same for a file read: the buffer is pinned (not reused) until bcache_unpin, so it can be copied out of with
+ * interrupts on, and the lookup counts towards the read hit rate */
+uint8_t* bcache_pin(uint32_t blk);
+void bcache_unpin(const uint8_t* buf);
+/* Mark a block's buffer as changed, it goes to the device on eviction or flush (right away in write through mode) */
+int32_t bcache_dirty(uint32_t blk);
+/* Write every dirty buffer to the device */
+int32_t bcache_flush();
+/* Forget a block without writing it back (it was freed) */
+void bcache_forget(uint32_t blk);
+/* Counter that changes whenever a cached block changes, for callers that hold on to block addresses */
+uint32_t bcache_generation();
+
+/* Write every dirty block straight through instead of batching them, for comparing the two */
+void bcache_set_writethrough(bool on);
+void bcache_get_stats(bcache_stats_t* stats);
+
+#endif
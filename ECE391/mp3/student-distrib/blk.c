@@ -0,0 +1,399 @@
+#include "blk.h"
+#include "lib.h"
+
+static void blk_dispatch(blk_queue_t* q, blk_request_t* run, uint32_t n);
+static void blk_rw_done(blk_request_t* req, int32_t status);
+
+/* Simulated device state, see blk_sim_init */
+static uint8_t* blk_sim_mem;
+static uint32_t blk_sim_op_cost;
+static uint32_t blk_sim_seek_cost;
+static uint32_t blk_sim_pos;
+static uint32_t blk_sim_total;
+static int32_t blk_sim_read(uint32_t blk, uint8_t* buf);
+static int32_t blk_sim_write(uint32_t blk, const uint8_t* buf);
+static int32_t blk_sim_read_many(uint32_t blk, uint32_t count, uint8_t* buf);
+static int32_t blk_sim_write_many(uint32_t blk, uint32_t count, const uint8_t* buf);
+
+blkdev_t blk_simdev = {
+    .read = blk_sim_read,
+    .write = blk_sim_write,
+    .read_many = blk_sim_read_many,
+    .write_many = blk_sim_write_many,
+    .nblocks = 0,
+};
+
+/*
+ * blk_queue_init
+ *   DESCRIPTION: Sets up an empty queue in front of a device, with the elevator and merging on
+ *   INPUTS: q -- the queue
+ *           dev -- device the queue sends its requests to
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: forgets any requests that were waiting (without calling their callbacks) and clears the counters
+ */
+void blk_queue_init(blk_queue_t* q, blkdev_t* dev){
+    q->dev = dev;
+    q->head = NULL;
+    q->depth = 0;
+    q->pos = 0;
+    q->sched = BLK_SCHED_ELEVATOR;
+    q->merge = true;
+    q->stats.submitted = 0;
+    q->stats.merged = 0;
+    q->stats.ops = 0;
+    q->stats.blocks = 0;
+    q->stats.seek = 0;
+    q->stats.errors = 0;
+    q->busy = false;
+    q->idle.pids = 0;
+    q->idle.boost = false;
+}
+
+/*
+ * blk_set_sched
+ *   DESCRIPTION: Picks the order requests go to the device in and whether they are merged. Requests already waiting
+ *                keep their place, so change this on an empty queue.
+ *   INPUTS: q -- the queue
+ *           sched -- BLK_SCHED_FIFO or BLK_SCHED_ELEVATOR
+ *           merge -- merge requests for consecutive blocks
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void blk_set_sched(blk_queue_t* q, uint32_t sched, bool merge){
+    q->sched = sched;
+    q->merge = merge;
+}
+
+/*
+ * blk_submit
+ *   DESCRIPTION: Queues a request. The elevator keeps the queue sorted by block (a request goes after any others for
+ *                the same block, so those still go out in the order they came in), FIFO appends it. A full queue is
+ *                unplugged right away.
+ *   INPUTS: q -- the queue
+ *           req -- the request, its done callback is called once it has been to the device
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may send requests to the device
+ */
+void blk_submit(blk_queue_t* q, blk_request_t* req){
+    blk_request_t** link = &q->head;
+    uint32_t flags;
+    bool full;
+
+    cli_and_save(flags);
+    while(*link != NULL && (q->sched == BLK_SCHED_FIFO || (*link)->blk <= req->blk))
+        link = &(*link)->next;
+    req->next = *link;
+    *link = req;
+    q->depth++;
+    q->stats.submitted++;
+    full = (q->depth >= BLK_QUEUE_MAX);
+    restore_flags(flags);
+
+    if(full)
+        blk_unplug(q);
+}
+
+/*
+ * blk_unplug
+ *   DESCRIPTION: Sends every waiting request to the device. Each time around we take the next request (the first one
+ *                for FIFO, the first at or after where the last op ended for the elevator, going back to the lowest
+ *                block when there is nothing above), plus the requests right behind it in the queue that continue it:
+ *                same direction, next block, and BLK_MAX_RUN blocks in all at most. Those go to the device as one op.
+ *                Requests are taken off the queue with interrupts off, the device op runs with them back on (if they
+ *                were on), so another task can get in. Only one task at a time gets past the busy flag, a second one
+ *                sleeps until the first has emptied the queue (its requests included).
+ *   INPUTS: q -- the queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of requests this call sent that failed
+ *   SIDE EFFECTS: device ops, calls the requests' done callbacks, may sleep
+ */
+int32_t blk_unplug(blk_queue_t* q){
+    blk_request_t** link;
+    blk_request_t* run;
+    blk_request_t* last;
+    uint32_t flags;
+    uint32_t n, blocks;
+    uint32_t errors;
+    int32_t failed = 0;
+
+    cli_and_save(flags);
+    while(q->busy)
+        wq_sleep(&q->idle);
+    q->busy = true;
+    restore_flags(flags);
+    errors = q->stats.errors;
+
+    while(1){
+        cli_and_save(flags);
+        if(q->head == NULL){
+            restore_flags(flags);
+            break;
+        }
+        link = &q->head;
+        if(q->sched == BLK_SCHED_ELEVATOR){
+            while(*link != NULL && (*link)->blk < q->pos)
+                link = &(*link)->next;
+            if(*link == NULL)
+                link = &q->head;
+        }
+        run = last = *link;
+        blocks = run->count;
+        for(n = 1; q->merge && last->next != NULL; n++){
+            if(last->next->write != run->write || last->next->blk != last->blk + last->count ||
+               blocks + last->next->count > BLK_MAX_RUN)
+                break;
+            last = last->next;
+            blocks += last->count;
+        }
+        /* Take run..last off the queue, they stay linked to each other */
+        *link = last->next;
+        last->next = NULL;
+        q->depth -= n;
+        restore_flags(flags);
+
+        blk_dispatch(q, run, n);
+        if(q->stats.errors != errors){
+            failed += n;
+            errors = q->stats.errors;
+        }
+    }
+
+    cli_and_save(flags);
+    q->busy = false;
+    wq_wake_all(&q->idle);
+    restore_flags(flags);
+    return failed;
+}
+
+/*
+ * blk_dispatch
+ *   DESCRIPTION: Sends one run of requests to the device as a single op and completes them. If their buffers are back
+ *                to back the device uses them directly, otherwise the data goes through the queue's bounce buffer.
+ *                Only called by the task that has the queue busy (see blk_unplug).
+ *   INPUTS: q -- the queue
+ *           run -- first request, the rest follow through next (covering consecutive blocks)
+ *           n -- number of requests
+ *   OUTPUTS: fills the buffers of read requests
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: device op, updates the counters, calls the done callbacks
+ */
+static void blk_dispatch(blk_queue_t* q, blk_request_t* run, uint32_t n){
+    blkdev_t* dev = q->dev;
+    blk_request_t* req;
+    blk_request_t* next;
+    uint32_t blocks = 0, i;
+    uint8_t* buf = run->buf;
+    int32_t status = 0;
+
+    for(req = run; req != NULL; req = req->next){
+        if(req->buf != run->buf + blocks * BLOCK_SIZE)
+            buf = q->bounce;
+        blocks += req->count;
+    }
+    /* A single request bigger than BLK_MAX_RUN is never merged, so it always has its own buffer */
+    if(buf == q->bounce && run->write){
+        for(req = run, i = 0; req != NULL; i += req->count, req = req->next)
+            memcpy(q->bounce + i * BLOCK_SIZE, req->buf, req->count * BLOCK_SIZE);
+    }
+
+    if(dev == NULL || run->blk >= dev->nblocks || blocks > dev->nblocks - run->blk){
+        status = -1;
+    }
+    else if(blocks > 1 && (run->write ? dev->write_many != NULL : dev->read_many != NULL)){
+        status = run->write ? dev->write_many(run->blk, blocks, buf) : dev->read_many(run->blk, blocks, buf);
+    }
+    else{
+        for(i = 0; i < blocks && status == 0; i++){
+            status = run->write ? dev->write(run->blk + i, buf + i * BLOCK_SIZE) :
+                                  dev->read(run->blk + i, buf + i * BLOCK_SIZE);
+        }
+    }
+
+    if(buf == q->bounce && !run->write && status == 0){
+        for(req = run, i = 0; req != NULL; i += req->count, req = req->next)
+            memcpy(req->buf, q->bounce + i * BLOCK_SIZE, req->count * BLOCK_SIZE);
+    }
+    q->stats.ops++;
+    q->stats.merged += n - 1;
+    q->stats.blocks += blocks;
+    q->stats.seek += (run->blk > q->pos) ? run->blk - q->pos : q->pos - run->blk;
+    if(status != 0)
+        q->stats.errors++;
+    q->pos = run->blk + blocks;
+
+    /* The callback may reuse the request, so get the next one first */
+    for(req = run; req != NULL; req = next){
+        next = req->next;
+        req->next = NULL;
+        if(req->done != NULL)
+            req->done(req, status);
+    }
+}
+
+/*
+ * blk_rw
+ *   DESCRIPTION: Synchronous read or write: submits one request and unplugs the queue, so it goes out along with
+ *                anything else that was waiting
+ *   INPUTS: q -- the queue
+ *           blk -- first block
+ *           count -- number of blocks
+ *           buf -- count * BLOCK_SIZE bytes
+ *           write -- true to write buf to the device
+ *   OUTPUTS: fills buf on a read
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: sends every waiting request to the device
+ */
+int32_t blk_rw(blk_queue_t* q, uint32_t blk, uint32_t count, uint8_t* buf, bool write){
+    blk_request_t req;
+    int32_t status = -1;
+
+    req.blk = blk;
+    req.count = count;
+    req.buf = buf;
+    req.write = write;
+    req.done = blk_rw_done;
+    req.priv = &status;
+    blk_submit(q, &req);
+    blk_unplug(q);
+    return status;
+}
+
+/*
+ * blk_rw_done
+ *   DESCRIPTION: Completion callback for blk_rw, hands the status back through priv
+ *   INPUTS: req -- the request
+ *           status -- 0 on success, -1 on failure
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void blk_rw_done(blk_request_t* req, int32_t status){
+    *(int32_t*)req->priv = status;
+}
+
+/*
+ * blk_get_stats
+ *   DESCRIPTION: Copies out a queue's counters
+ *   INPUTS: q -- the queue
+ *   OUTPUTS: stats -- the counters
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void blk_get_stats(blk_queue_t* q, blk_stats_t* stats){
+    *stats = q->stats;
+}
+
+/*
+ * blk_sim_init
+ *   DESCRIPTION: Points the simulated device at a RAM area and sets how long its ops take. The head starts at block 0.
+ *   INPUTS: mem -- nblocks * BLOCK_SIZE bytes the device stores its blocks in
+ *           nblocks -- size of the device
+ *           op_cost -- cycles every op takes
+ *           seek_cost -- extra cycles per block between where the last op ended and where the next one starts
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clears the simulated cycle count
+ */
+void blk_sim_init(uint8_t* mem, uint32_t nblocks, uint32_t op_cost, uint32_t seek_cost){
+    blk_sim_mem = mem;
+    blk_simdev.nblocks = nblocks;
+    blk_sim_op_cost = op_cost;
+    blk_sim_seek_cost = seek_cost;
+    blk_sim_pos = 0;
+    blk_sim_total = 0;
+}
+
+/*
+ * blk_sim_cycles
+ *   DESCRIPTION: Returns the simulated cycles the device has spent since blk_sim_init
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: cycles
+ *   SIDE EFFECTS: none
+ */
+uint32_t blk_sim_cycles(){
+    return blk_sim_total;
+}
+
+/*
+ * blk_sim_delay
+ *   DESCRIPTION: Takes the time an op starting at blk would take on the simulated device, by spinning on the TSC
+ *   INPUTS: blk -- first block of the op
+ *           count -- number of blocks
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: moves the simulated head to the end of the op
+ */
+static void blk_sim_delay(uint32_t blk, uint32_t count){
+    uint32_t cost = blk_sim_op_cost;
+    uint32_t start;
+
+    cost += blk_sim_seek_cost * ((blk > blk_sim_pos) ? blk - blk_sim_pos : blk_sim_pos - blk);
+    blk_sim_total += cost;
+    blk_sim_pos = blk + count;
+    start = rdtsc();
+    while(rdtsc() - start < cost);
+}
+
+/*
+ * blk_sim_read_many
+ *   DESCRIPTION: Reads count blocks from the simulated device
+ *   INPUTS: blk -- first block
+ *           count -- number of blocks
+ *   OUTPUTS: buf -- the blocks
+ *   RETURN VALUE: 0 on success, -1 if the blocks are off the end of the device
+ *   SIDE EFFECTS: takes the op's simulated time
+ */
+static int32_t blk_sim_read_many(uint32_t blk, uint32_t count, uint8_t* buf){
+    if(blk >= blk_simdev.nblocks || count > blk_simdev.nblocks - blk)
+        return -1;
+    blk_sim_delay(blk, count);
+    memcpy(buf, blk_sim_mem + blk * BLOCK_SIZE, count * BLOCK_SIZE);
+    return 0;
+}
+
+/*
+ * blk_sim_write_many
+ *   DESCRIPTION: Writes count blocks to the simulated device
+ *   INPUTS: blk -- first block
+ *           count -- number of blocks
+ *           buf -- the blocks
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the blocks are off the end of the device
+ *   SIDE EFFECTS: takes the op's simulated time
+ */
+static int32_t blk_sim_write_many(uint32_t blk, uint32_t count, const uint8_t* buf){
+    if(blk >= blk_simdev.nblocks || count > blk_simdev.nblocks - blk)
+        return -1;
+    blk_sim_delay(blk, count);
+    memcpy(blk_sim_mem + blk * BLOCK_SIZE, buf, count * BLOCK_SIZE);
+    return 0;
+}
+
+/*
+ * blk_sim_read
+ *   DESCRIPTION: Reads one block from the simulated device
+ *   INPUTS: blk -- the block
+ *   OUTPUTS: buf -- the block
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: takes the op's simulated time
+ */
+static int32_t blk_sim_read(uint32_t blk, uint8_t* buf){
+    return blk_sim_read_many(blk, 1, buf);
+}
+
+/*
+ * blk_sim_write
+ *   DESCRIPTION: Writes one block to the simulated device
+ *   INPUTS: blk -- the block
+ *           buf -- the block
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: takes the op's simulated time
+ */
+static int32_t blk_sim_write(uint32_t blk, const uint8_t* buf){
+    return blk_sim_write_many(blk, 1, buf);
+}
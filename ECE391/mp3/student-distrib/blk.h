@@ -0,0 +1,82 @@
+#ifndef _BLK_H
+#define _BLK_H
+
+#include "types.h"
+#include "bcache.h"
+#include "lib.h"
+#include "wait.h"
+
+/* Block I/O layer. Everything that reads or writes a block device (the buffer cache, disk mounts and write back)
+ * submits requests to the device's queue instead of calling its ops. A queue holds requests until it is unplugged,
+ * then sends them to the device in elevator order (upward from where the last one ended, then back around to the
+ * lowest block), merging requests for consecutive blocks in the same direction into one device op. Every request's
+ * done callback is called once it has been to the device.
+ * Completion is synchronous: blk_unplug runs the device ops itself and calls the callbacks in the task that unplugged,
+ * right after each op returns. The ATA driver waits for IRQ 14 with hlt, so other tasks get the CPU while the disk
+ * works, but nothing is completed from the interrupt. Only one task at a time sends a queue's requests (they share
+ * the device position and the bounce buffer), another one that unplugs the queue meanwhile sleeps until it is done,
+ * so callbacks must not unplug their own queue and interrupt handlers must not unplug at all. */
+#define BLK_MAX_RUN           16    /* Most blocks one device op covers after merging (64 KB) */
+#define BLK_QUEUE_MAX         64    /* Requests a queue holds before blk_submit unplugs it on its own */
+
+#define BLK_SCHED_FIFO        0     /* Requests go out in the order they came in */
+#define BLK_SCHED_ELEVATOR    1
+
+/* One request. The submitter owns it and must keep it around until done is called. */
+typedef struct blk_request {
+    uint32_t blk;               /* First block */
+    uint32_t count;             /* Number of blocks, at least 1 */
+    uint8_t* buf;               /* count * BLOCK_SIZE bytes */
+    bool write;
+    void (*done)(struct blk_request* req, int32_t status);    /* Called with 0 on success, -1 on failure */
+    void* priv;                 /* For the submitter */
+    struct blk_request* next;   /* Next request in the queue */
+} blk_request_t;
+
+/* Queue counters, read with blk_get_stats */
+typedef struct blk_stats {
+    uint32_t submitted;         /* Requests */
+    uint32_t merged;            /* Requests that went to the device as part of another request's op */
+    uint32_t ops;               /* Device ops */
+    uint32_t blocks;            /* Blocks moved */
+    uint32_t seek;              /* Sum of how many blocks the device had to skip (either way) between ops */
+    uint32_t errors;            /* Device ops that failed */
+} blk_stats_t;
+
+typedef struct blk_queue {
+    blkdev_t* dev;
+    blk_request_t* head;        /* Waiting requests, sorted by block for the elevator, in order for FIFO */
+    uint32_t depth;             /* Number of waiting requests */
+    uint32_t pos;               /* Block after the end of the last op, where the elevator goes up from */
+    uint32_t sched;
+    bool merge;
+    blk_stats_t stats;
+    bool busy;                  /* A task is in blk_unplug sending requests to the device */
+    wait_queue_t idle;          /* Tasks waiting in blk_unplug for the busy one to finish */
+    uint8_t bounce[BLK_MAX_RUN * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));  /* For merged requests whose
+                                                                                       buffers aren't back to back */
+} blk_queue_t;
+
+/* Set up an empty queue in front of a device (elevator, merging on) */
+void blk_queue_init(blk_queue_t* q, blkdev_t* dev);
+/* Pick the scheduler and turn merging on or off, for comparing them */
+void blk_set_sched(blk_queue_t* q, uint32_t sched, bool merge);
+
+/* Queue a request (unplugs the queue if it is full) */
+void blk_submit(blk_queue_t* q, blk_request_t* req);
+/* Send every waiting request to the device. Returns the number of requests that failed (not counting any another
+ * task sent while this one waited for the queue, their callbacks still see how they went). */
+int32_t blk_unplug(blk_queue_t* q);
+/* Submit one request, unplug and return its status */
+int32_t blk_rw(blk_queue_t* q, uint32_t blk, uint32_t count, uint8_t* buf, bool write);
+
+void blk_get_stats(blk_queue_t* q, blk_stats_t* stats);
+
+/* RAM backed device that takes simulated time for every op, op_cost cycles plus seek_cost cycles per block between
+ * where the last op ended and where this one starts, for benchmarking the queue without a disk */
+extern blkdev_t blk_simdev;
+void blk_sim_init(uint8_t* mem, uint32_t nblocks, uint32_t op_cost, uint32_t seek_cost);
+/* Simulated cycles spent so far */
+uint32_t blk_sim_cycles();
+
+#endif
@@ -0,0 +1,299 @@
+#include "compress.h"
+#include "filesys.h"
+#include "bcache.h"
+#include "lib.h"
+
+/* One decompressed chunk in the cache, compress_slots[i] describes compress_data[i] */
+typedef struct compress_slot {
+    uint32_t inode;         /* File the chunk is from, FS_NO_BLOCK if the slot is free */
+    uint32_t chunk;         /* Index of the chunk in the file */
+    uint32_t last_used;     /* Cache tick of the last access, for LRU eviction */
+} compress_slot_t;
+
+static uint8_t compress_data[COMPRESS_CACHE_SLOTS][BLOCK_SIZE];
+static compress_slot_t compress_slots[COMPRESS_CACHE_SLOTS];
+static uint8_t compress_in[BLOCK_SIZE];     /* Compressed chunk that is split over two data blocks, copied together */
+static compress_stats_t compress_stats;
+static uint32_t compress_tick;
+
+static int32_t compress_chunk(uint32_t inode, uint32_t chunk, uint32_t chunk_len, uint8_t* dst);
+
+/*
+ * compress_clear
+ *   DESCRIPTION: Empties the decompressed chunk cache
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: drops every cached chunk and clears the counters
+ */
+void compress_clear(){
+    int i;
+
+    for(i = 0; i < COMPRESS_CACHE_SLOTS; i++){
+        compress_slots[i].inode = FS_NO_BLOCK;
+        compress_slots[i].last_used = 0;
+    }
+    compress_tick = 0;
+    compress_stats.hits = 0;
+    compress_stats.misses = 0;
+    compress_stats.direct = 0;
+    compress_stats.errors = 0;
+}
+
+/*
+ * compress_invalidate
+ *   DESCRIPTION: Drops every cached chunk of a file, for when the inode gets new contents
+ *   INPUTS: inode -- inode number of the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees cache slots
+ */
+void compress_invalidate(uint32_t inode){
+    int i;
+
+    for(i = 0; i < COMPRESS_CACHE_SLOTS; i++){
+        if(compress_slots[i].inode == inode)
+            compress_slots[i].inode = FS_NO_BLOCK;
+    }
+}
+
+/*
+ * compress_file_size
+ *   DESCRIPTION: Size of a compressed file, from the first word of its header
+ *   INPUTS: inode -- inode number of the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: size of the file in bytes, 0 if the header can't be read
+ *   SIDE EFFECTS: none
+ */
+uint32_t compress_file_size(uint32_t inode){
+    uint32_t size;
+
+    if(read_stored(inode, 0, (uint8_t*)&size, sizeof(size)) < sizeof(size))
+        return 0;
+    return size;
+}
+
+/*
+ * compress_read
+ *   DESCRIPTION: read_data for a compressed file. Works a chunk at a time: a chunk the read wants all of is
+ *                decompressed straight into buf, anything less comes out of the decompressed chunk cache, so reading a
+ *                file in small pieces decompresses each chunk once.
+ *   INPUTS: inode -- inode number of the file
+ *           offset -- number of bytes into the file to start reading
+ *           buf -- buffer to fill
+ *           length -- number of bytes to read
+ *   OUTPUTS: fills buf
+ *   RETURN VALUE: number of bytes read. Like read_data a read that reaches the end of the file also gets the byte at
+ *                 position size (a 0 here). Short if a chunk is bad.
+ *   SIDE EFFECTS: may evict cached chunks
+ */
+int32_t compress_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t size = compress_file_size(inode);
+    uint32_t bytes_read = 0;
+    uint32_t pos;           /* Position in the file we are at */
+    uint32_t chunk;         /* Chunk that position is in */
+    uint32_t chunk_off;     /* Number of bytes into that chunk */
+    uint32_t chunk_len;     /* Number of bytes of file the chunk holds */
+    uint32_t span;          /* Number of bytes we copy this time around */
+    int32_t i, slot;
+    uint32_t flags;
+
+    if(offset > size)
+        return 0;
+    if(length > size - offset + 1)
+        length = size - offset + 1;
+
+    while(bytes_read < length){
+        pos = offset + bytes_read;
+        if(pos >= size){
+            memset(buf + bytes_read, 0, length - bytes_read);
+            bytes_read = length;
+            break;
+        }
+        chunk = pos / BLOCK_SIZE;
+        chunk_off = pos % BLOCK_SIZE;
+        chunk_len = (size - chunk * BLOCK_SIZE < BLOCK_SIZE) ? size - chunk * BLOCK_SIZE : BLOCK_SIZE;
+        span = chunk_len - chunk_off;
+        if(span > length - bytes_read)
+            span = length - bytes_read;
+
+        cli_and_save(flags);
+        if(span == chunk_len){
+            if(compress_chunk(inode, chunk, chunk_len, buf + bytes_read) == -1){
+                restore_flags(flags);
+                break;
+            }
+            compress_stats.direct++;
+        }
+        else{
+            /* Look for the chunk, remembering the least recently used slot in case it isn't there */
+            slot = 0;
+            for(i = 0; i < COMPRESS_CACHE_SLOTS; i++){
+                if(compress_slots[i].inode == inode && compress_slots[i].chunk == chunk)
+                    break;
+                if(compress_slots[i].inode == FS_NO_BLOCK || compress_slots[i].last_used < compress_slots[slot].last_used)
+                    slot = i;
+            }
+            if(i < COMPRESS_CACHE_SLOTS){
+                slot = i;
+                compress_stats.hits++;
+            }
+            else{
+                compress_slots[slot].inode = FS_NO_BLOCK;
+                if(compress_chunk(inode, chunk, chunk_len, compress_data[slot]) == -1){
+                    restore_flags(flags);
+                    break;
+                }
+                compress_slots[slot].inode = inode;
+                compress_slots[slot].chunk = chunk;
+                compress_stats.misses++;
+            }
+            compress_slots[slot].last_used = ++compress_tick;
+            memcpy(buf + bytes_read, compress_data[slot] + chunk_off, span);
+        }
+        restore_flags(flags);
+        bytes_read += span;
+    }
+    return bytes_read;
+}
+
+/*
+ * compress_chunk
+ *   DESCRIPTION: Decompresses one chunk of a file. The compressed bytes are read in place when they sit in one data
+ *                block that isn't in the buffer cache, otherwise they are copied out together first.
+ *   INPUTS: inode -- inode number of the file
+ *           chunk -- index of the chunk
+ *           chunk_len -- number of bytes of file the chunk holds
+ *           dst -- where the chunk goes, chunk_len bytes
+ *   OUTPUTS: fills dst
+ *   RETURN VALUE: 0 on success, -1 if the chunk is bad
+ *   SIDE EFFECTS: uses compress_in, call with interrupts off
+ */
+static int32_t compress_chunk(uint32_t inode, uint32_t chunk, uint32_t chunk_len, uint8_t* dst){
+    uint32_t range[2];      /* Offsets of this chunk and the next one in the stored data */
+    uint32_t len;           /* Compressed length of the chunk */
+    uint32_t data_block;
+    const uint8_t* src;
+
+    if(read_stored(inode, 4 + 4 * chunk, (uint8_t*)range, sizeof(range)) < sizeof(range) || range[1] < range[0] ||
+       range[1] - range[0] > BLOCK_SIZE || range[1] > inode_stored_len(get_inode(inode))){
+        compress_stats.errors++;
+        return -1;
+    }
+    len = range[1] - range[0];
+
+    /* Stored as is */
+    if(len == chunk_len){
+        if(read_stored(inode, range[0], dst, len) < len){
+            compress_stats.errors++;
+            return -1;
+        }
+        return 0;
+    }
+
+    src = NULL;
+    if(range[0] / BLOCK_SIZE == (range[1] - 1) / BLOCK_SIZE){
+        data_block = inode_data_block(get_inode(inode), range[0] / BLOCK_SIZE);
+        if(data_block < get_num_data_blocks() && bcache_lookup(data_blk_num(data_block)) == NULL)
+            src = data_blk_addr(data_block) + range[0] % BLOCK_SIZE;
+    }
+    if(src == NULL){
+        if(read_stored(inode, range[0], compress_in, len) < len){
+            compress_stats.errors++;
+            return -1;
+        }
+        src = compress_in;
+    }
+    if(lz_decompress(src, len, dst, chunk_len) != chunk_len){
+        compress_stats.errors++;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * lz_decompress
+ *   DESCRIPTION: Decompresses one LZ4 block. The block is a list of sequences: a token byte (literal count in the top
+ *                4 bits, match length - LZ_MIN_MATCH in the bottom 4, 15 in either means more length bytes follow,
+ *                each added on until one isn't 255), the literals, then a 2 byte little endian offset back into the
+ *                output to copy the match from. The last sequence stops after its literals.
+ *   INPUTS: src -- compressed data
+ *           src_len -- number of bytes of compressed data
+ *           dst -- where the data goes
+ *           dst_len -- room in dst
+ *   OUTPUTS: fills dst
+ *   RETURN VALUE: number of bytes written to dst, -1 if a length runs past the end of src or dst or an offset points
+ *                 before dst
+ *   SIDE EFFECTS: none
+ */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len){
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+    uint8_t* match;
+    uint32_t token, len, off, b;
+
+    while(ip < iend){
+        token = *ip++;
+
+        /* Literals */
+        len = token >> 4;
+        if(len == 15){
+            do{
+                if(ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        if(len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if(ip == iend)
+            break;
+
+        /* Match */
+        if(iend - ip < 2)
+            return -1;
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(off == 0 || off > (uint32_t)(op - dst))
+            return -1;
+        len = (token & 0xF) + LZ_MIN_MATCH;
+        if((token & 0xF) == 15){
+            do{
+                if(ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while(b == 255);
+        }
+        if(len > (uint32_t)(oend - op))
+            return -1;
+        /* A match that overlaps what it is making repeats the last off bytes. Every copy doubles how much of the
+        repeat is already written, so copy that much each time instead of going a byte at a time. */
+        match = op - off;
+        while(len > 0){
+            off = (len < (uint32_t)(op - match)) ? len : (uint32_t)(op - match);
+            memcpy(op, match, off);
+            op += off;
+            len -= off;
+        }
+    }
+    return op - dst;
+}
+
+/*
+ * compress_get_stats
+ *   DESCRIPTION: Copies out the decompressed chunk cache counters
+ *   INPUTS: stats -- filled with the counters
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void compress_get_stats(compress_stats_t* stats){
+    *stats = compress_stats;
+}
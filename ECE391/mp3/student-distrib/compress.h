@@ -0,0 +1,38 @@
+#ifndef _COMPRESS_H
+#define _COMPRESS_H
+
+#include "types.h"
+
+/* A compressed file is marked by INODE_COMPRESSED in its inode's length, the rest of the length is the number of bytes
+ * stored in its data blocks. What is stored starts with a header: the file's real size, then one offset per
+ * BLOCK_SIZE chunk of the file plus one past the last chunk, all uint32_t and counted from the start of the stored
+ * data. Chunk i is the bytes between offsets i and i + 1. Every chunk is compressed on its own (LZ4 block format),
+ * and a chunk that is as long as the data it holds is stored as is. So a read only ever decompresses the chunks it
+ * touches, and no chunk is ever longer than BLOCK_SIZE. */
+#define COMPRESS_HDR_SIZE(chunks)   (4 * ((chunks) + 2))
+#define COMPRESS_CACHE_SLOTS  8     /* Decompressed chunks we keep around */
+#define LZ_MIN_MATCH          4     /* Shortest match the format can describe */
+
+/* Cache counters, read with compress_get_stats */
+typedef struct compress_stats {
+    uint32_t hits;          /* Chunk was in the decompressed chunk cache */
+    uint32_t misses;        /* Chunk was decompressed into the cache */
+    uint32_t direct;        /* Read wanted a whole chunk, it was decompressed straight into the caller's buffer */
+    uint32_t errors;        /* Chunk with a bad offset or that didn't decompress to the right size */
+} compress_stats_t;
+
+/* Empty the decompressed chunk cache, done at mount */
+void compress_clear();
+/* Drop every cached chunk of a file */
+void compress_invalidate(uint32_t inode);
+
+/* Size of a compressed file, and reads from one (same rules as read_data) */
+uint32_t compress_file_size(uint32_t inode);
+int32_t compress_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+
+/* Decompress one LZ4 block, returns the number of bytes written to dst or -1 if src is bad or doesn't fit */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+void compress_get_stats(compress_stats_t* stats);
+
+#endif
@@ -426,9 +426,8 @@ int console_getinput(buffered_input_t * bufin)
     bufin->complete = false;
     // Stop the user from backspacing beyond this point in the line
     vterms[cur_pcb->con].constate.con_bkspstop_col = vterms[cur_pcb->con].constate.vcur_x;
-    // Poll until the interrupt handler makes this true
-    sti();
-    while (!bufin->complete);
+    // Sleep until the keyboard handler makes this true
+    wait_event(&vterms[cur_pcb->con].input_wq, bufin->complete);
     // Absolutely ensure the buffer is null-terminated
     // EDITED 
     bufin->buffer[bufin->buffer_length - 1] = '\0';
@@ -579,6 +578,9 @@ fastcall void console_inputhandler(char raw)
     }
     // Resync current_input to the correct vterm
     current_console->current_input = current_input;
+    // A finished line wakes up whoever is reading it
+    if (current_input.complete)
+        wq_wake_all(&current_console->input_wq);
 }
 
 inline bool console_isinit()
@@ -756,6 +758,9 @@ int vterm_new(int idx)
     new_con->kbuf[0] = '\0';
     new_con->current_input.buffer = '\0';
     new_con->current_input.buffer_length = 0;
+    // Nobody is waiting for a line yet. Whoever does gets the interactive boost when it comes.
+    new_con->input_wq.pids = 0;
+    new_con->input_wq.boost = true;
     // Fill screen buffer with spaces.
     int i;
     vga_char_t * sbuf = (vga_char_t*)VIDEO;
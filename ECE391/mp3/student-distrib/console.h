@@ -7,6 +7,7 @@
 #include "lib.h"
 #include "types.h"
 #include "vga.h"
+#include "wait.h"
 
 extern pcb_t * cur_pcb;
 
@@ -114,6 +115,8 @@ typedef struct console {
     console_state_t constate;
     /// Buffered input object for this console
     buffered_input_t current_input;
+    /// Tasks waiting for current_input to be complete
+    wait_queue_t input_wq;
     /// Contents of this console's buffered input buffer.
     char kbuf[KBUF_LEN];
     /// Contents of this console's screen buffer.  Perfect analog of the video memory.
@@ -150,6 +153,7 @@ int32_t console_close(int32_t fd);
 #define MAX_VTERMS 3
 
 extern console_t vterms[MAX_VTERMS];
+extern console_t * current_console;
 typedef struct vconsole_override {
     int idx;
     bool flag;
@@ -0,0 +1,187 @@
+#include "execcache.h"
+#include "lib.h"
+
+/* Images we have prepared, each one owns a fixed EXEC_CACHE_SLOT_SIZE chunk of the cache region */
+static exec_image_t exec_cache[EXEC_CACHE_SLOTS];
+static exec_cache_stats_t exec_cache_stats;
+static uint32_t exec_cache_tick;    /* Bumped on every lookup, used as the LRU clock */
+
+/*
+ * exec_cache_init
+ *   DESCRIPTION: Empties the executable image cache and gives each slot its chunk of the cache region
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clears the cache and its counters, init_paging must have mapped the cache region
+ */
+void exec_cache_init(){
+    int i;
+
+    for(i = 0; i < EXEC_CACHE_SLOTS; i++){
+        exec_cache[i].base = (uint8_t*)(EXEC_CACHE_LOC + (i * EXEC_CACHE_SLOT_SIZE));
+        exec_cache[i].refcount = 0;
+        exec_cache[i].last_used = 0;
+        exec_cache[i].valid = false;
+    }
+    exec_cache_tick = 0;
+    exec_cache_stats.hits = 0;
+    exec_cache_stats.misses = 0;
+    exec_cache_stats.evictions = 0;
+    exec_cache_stats.uncached = 0;
+}
+
+/*
+ * exec_check_header
+ *   DESCRIPTION: Checks that a file starts with the ELF magic number and gets its entry point
+ *   INPUTS: header -- first MAX_TEMP_BUF bytes of the file
+ *           entry -- where to put the entry point
+ *   OUTPUTS: entry point into *entry
+ *   RETURN VALUE: 0 if the file is an executable, -1 if not
+ *   SIDE EFFECTS: none
+ */
+int exec_check_header(const uint8_t* header, uint32_t* entry){
+    if(header[0] != EXECUTABLE_FILE_ONE || header[1] != EXECUTABLE_FILE_TWO || header[2] != EXECUTABLE_FILE_THREE || header[3] != EXECUTABLE_FILE_FOUR){
+        return -1;
+    }
+
+    /* 27,26,25,24 = bytes of the entry point in the ELF header, little endian */
+    *entry = (header[27] << 24) + (header[26] << 16) + (header[25] << 8) + (header[24]);
+    return 0;
+}
+
+/*
+ * exec_cache_get
+ *   DESCRIPTION: Looks up the prepared image for an executable, reading it in on a miss. On a miss we take a free slot,
+ *                or the least recently used one that no process is running from.
+ *   INPUTS: inode -- inode number of the executable
+ *   OUTPUTS: none
+ *   RETURN VALUE: the image with a reference taken, NULL if the file isn't an executable or couldn't be cached
+ *                 (too big, or every slot is in use) in which case the caller should run it straight from the file
+ *   SIDE EFFECTS: may evict another image, updates the cache counters
+ */
+exec_image_t* exec_cache_get(uint32_t inode){
+    int i;
+    int victim = -1;                    /* Slot we will read the image into on a miss */
+    uint32_t size;                      /* Size of the executable in bytes */
+    uint32_t entry;                     /* Entry point from the ELF header */
+    uint8_t header[MAX_TEMP_BUF];       /* ELF header, checked before we throw out anything for this file */
+    uint32_t flags;
+    exec_image_t* image;
+
+    cli_and_save(flags);
+    exec_cache_tick++;
+
+    /* Hit, the image is already prepared */
+    for(i = 0; i < EXEC_CACHE_SLOTS; i++){
+        if(exec_cache[i].valid && exec_cache[i].inode == inode){
+            exec_cache[i].refcount++;
+            exec_cache[i].last_used = exec_cache_tick;
+            exec_cache_stats.hits++;
+            restore_flags(flags);
+            return &exec_cache[i];
+        }
+    }
+
+    /* Miss, make sure this is really an executable before we evict anything for it */
+    if(read_data(inode, 0, header, MAX_TEMP_BUF) != MAX_TEMP_BUF || exec_check_header(header, &entry) == -1){
+        restore_flags(flags);
+        return NULL;
+    }
+    exec_cache_stats.misses++;
+
+    size = get_inode_len(inode);
+    for(i = 0; i < EXEC_CACHE_SLOTS && size <= EXEC_CACHE_SLOT_SIZE; i++){
+        /* Slots still in use can't be touched, even if the image was invalidated */
+        if(exec_cache[i].refcount != 0)
+            continue;
+        if(!exec_cache[i].valid){
+            victim = i;
+            break;
+        }
+        if(victim == -1 || exec_cache[i].last_used < exec_cache[victim].last_used){
+            victim = i;
+        }
+    }
+    if(victim == -1){
+        exec_cache_stats.uncached++;
+        restore_flags(flags);
+        return NULL;
+    }
+
+    image = &exec_cache[victim];
+    if(image->valid){
+        exec_cache_stats.evictions++;
+        image->valid = false;
+    }
+
+    /* Read the whole file into the slot in one go */
+    if(read_data(inode, 0, image->base, size) != size){
+        restore_flags(flags);
+        return NULL;
+    }
+    image->inode = inode;
+    image->size = size;
+    image->entry = entry;
+    image->refcount = 1;
+    image->last_used = exec_cache_tick;
+    image->valid = true;
+
+    restore_flags(flags);
+    return image;
+}
+
+/*
+ * exec_cache_put
+ *   DESCRIPTION: Drops a reference taken by exec_cache_get, once nothing is running from an image it can be evicted
+ *   INPUTS: image -- image to release, NULL is ignored
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void exec_cache_put(exec_image_t* image){
+    uint32_t flags;
+
+    if(image == NULL)
+        return;
+
+    cli_and_save(flags);
+    if(image->refcount > 0)
+        image->refcount--;
+    restore_flags(flags);
+}
+
+/*
+ * exec_cache_invalidate
+ *   DESCRIPTION: Throws out the cached image of a file that was changed, so the next execute() reads the new contents.
+ *                Processes already running from the old image keep it until they halt.
+ *   INPUTS: inode -- inode number of the file that changed
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void exec_cache_invalidate(uint32_t inode){
+    int i;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    for(i = 0; i < EXEC_CACHE_SLOTS; i++){
+        if(exec_cache[i].valid && exec_cache[i].inode == inode)
+            exec_cache[i].valid = false;
+    }
+    restore_flags(flags);
+}
+
+/*
+ * exec_cache_get_stats
+ *   DESCRIPTION: Copies out the cache counters
+ *   INPUTS: stats -- where to copy them
+ *   OUTPUTS: the counters into *stats
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void exec_cache_get_stats(exec_cache_stats_t* stats){
+    if(stats == NULL)
+        return;
+
+    *stats = exec_cache_stats;
+}
@@ -0,0 +1,39 @@
+#ifndef _EXECCACHE_H
+#define _EXECCACHE_H
+
+#include "types.h"
+#include "paging.h"
+#include "filesys.h"
+
+/* The cache lives in the 4 MB of physical memory right after the last user process slot.
+ * It is identity mapped (supervisor only) in every page directory so the kernel can always reach it. */
+#define EXEC_CACHE_LOC        (MB_8 + (MAX_PROCESS * USER_PAGE_SIZE))
+#define EXEC_CACHE_IDX        (EXEC_CACHE_LOC >> PDE_SHIFT)     /* PDE index of the cache region */
+#define EXEC_CACHE_BITS       0x083                     /* Data bits for the cache PDE: present, r/w, supervisor, 4 MB */
+#define EXEC_CACHE_SLOTS      8                         /* Number of executables we keep around */
+#define EXEC_CACHE_SLOT_SIZE  (USER_PAGE_SIZE / EXEC_CACHE_SLOTS)   /* Largest executable we will cache (512 KB) */
+
+/* Hit/miss counters, read with exec_cache_get_stats */
+typedef struct exec_cache_stats {
+    uint32_t hits;          /* execute() found the image already prepared */
+    uint32_t misses;        /* execute() had to read the image from the file system */
+    uint32_t evictions;     /* A cached image was thrown out to make room for another */
+    uint32_t uncached;      /* Image was too big or every slot was in use, so it was run straight from the file */
+} exec_cache_stats_t;
+
+/* Set up the (empty) cache */
+void exec_cache_init();
+
+/* Get a prepared image for an executable inode, takes a reference that must be given back with exec_cache_put */
+exec_image_t* exec_cache_get(uint32_t inode);
+void exec_cache_put(exec_image_t* image);
+/* Drop the cached image of a file that was written to */
+void exec_cache_invalidate(uint32_t inode);
+
+/* Check the ELF magic in an executable's header and pull out its entry point */
+int exec_check_header(const uint8_t* header, uint32_t* entry);
+
+/* Copy out the cache counters */
+void exec_cache_get_stats(exec_cache_stats_t* stats);
+
+#endif
@@ -0,0 +1,212 @@
+#include "extent.h"
+#include "filesys.h"
+#include "lib.h"
+
+/* Extents of every file, extent_lists[i] says where inode i's runs are in extent_pool */
+static extent_t extent_pool[EXTENT_POOL_SIZE];
+static extent_list_t extent_lists[EXTENT_MAX_INODES];
+static uint32_t extent_pool_used;       /* Slots at the start of the pool that are taken (holes included) */
+
+static int32_t extent_add(uint32_t inode, uint32_t index, uint32_t data_block);
+
+/*
+ * extent_clear
+ *   DESCRIPTION: Drops every extent list, reads go block by block through the inodes until extent_build
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: empties the pool
+ */
+void extent_clear(){
+    uint32_t i;
+
+    for(i = 0; i < EXTENT_MAX_INODES; i++){
+        extent_lists[i].first = 0;
+        extent_lists[i].count = 0;
+        extent_lists[i].blocks = 0;
+    }
+    extent_pool_used = 0;
+}
+
+/*
+ * extent_build
+ *   DESCRIPTION: Builds the extent lists from scratch: walks the data blocks of every file (and directory) and merges
+ *                blocks that follow each other in the image into one run. A file's list stops at the first data block
+ *                number that is out of range, the rest of that file is read block by block like before.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: replaces every list and packs the pool
+ */
+void extent_build(){
+    uint32_t num_blocks;    /* Number of data blocks a file uses */
+    inode_t* inodeptr;
+    uint32_t i, j;
+
+    extent_clear();
+    for(i = 0; i < EXTENT_MAX_INODES && i < get_num_inodes(); i++){
+        if(!fs_inode_used(i))
+            continue;
+        inodeptr = get_inode(i);
+        num_blocks = (inode_stored_len(inodeptr) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        for(j = 0; j < num_blocks && j < inode_max_blocks(); j++){
+            if(extent_add(i, j, inode_data_block(inodeptr, j)) == -1)
+                break;
+        }
+    }
+}
+
+/*
+ * extent_add
+ *   DESCRIPTION: Adds the next block of a file to its extent list, growing the last run if the block follows it
+ *   INPUTS: inode -- inode number of the file
+ *           index -- index of the block in the file, has to be the block right after the ones the list covers
+ *           data_block -- data block number of the block
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the block is out of range, isn't the next block, or the pool is full
+ *   SIDE EFFECTS: may move the file's list to the end of the pool
+ */
+static int32_t extent_add(uint32_t inode, uint32_t index, uint32_t data_block){
+    extent_list_t* list = &extent_lists[inode];
+    extent_t* last;
+
+    if(data_block >= get_num_data_blocks() || index != list->blocks)
+        return -1;
+
+    if(list->count > 0){
+        last = &extent_pool[list->first + list->count - 1];
+        if(last->start + last->len == data_block){
+            last->len++;
+            list->blocks++;
+            return 0;
+        }
+    }
+
+    /* Need a new run, the list has to be at the end of the pool to grow */
+    if(list->count == 0 || list->first + list->count != extent_pool_used){
+        if(extent_pool_used + list->count + 1 > EXTENT_POOL_SIZE)
+            return -1;
+        memmove(&extent_pool[extent_pool_used], &extent_pool[list->first], list->count * sizeof(extent_t));
+        list->first = extent_pool_used;
+        extent_pool_used += list->count;
+    }
+    if(extent_pool_used >= EXTENT_POOL_SIZE)
+        return -1;
+    extent_pool[extent_pool_used].start = data_block;
+    extent_pool[extent_pool_used].len = 1;
+    extent_pool_used++;
+    list->count++;
+    list->blocks++;
+    return 0;
+}
+
+/*
+ * extent_append
+ *   DESCRIPTION: Tells the extent lists a file just got a new block at its end. If the pool is out of room (it is full
+ *                of holes left by lists that moved) everything is rebuilt, which packs it.
+ *   INPUTS: inode -- inode number of the file
+ *           index -- index of the new block in the file
+ *           data_block -- data block number the file got
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see extent_add, the caller must keep interrupts off
+ */
+void extent_append(uint32_t inode, uint32_t index, uint32_t data_block){
+    if(inode >= EXTENT_MAX_INODES)
+        return;
+    if(extent_add(inode, index, data_block) == 0 || index != extent_lists[inode].blocks)
+        return;
+    /* The inode doesn't count the new block yet (its length is updated after the data is in), so the rebuild leaves
+    the list right before it */
+    extent_build();
+    extent_add(inode, index, data_block);
+}
+
+/*
+ * extent_reset
+ *   DESCRIPTION: Empties a file's extent list, for a new file that took over an inode
+ *   INPUTS: inode -- inode number of the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the old list's slots stay taken until the next rebuild
+ */
+void extent_reset(uint32_t inode){
+    if(inode >= EXTENT_MAX_INODES)
+        return;
+    extent_lists[inode].count = 0;
+    extent_lists[inode].blocks = 0;
+}
+
+/*
+ * extent_find
+ *   DESCRIPTION: Finds the data block behind a block of a file, and how many of the file's blocks after it follow it
+ *                in the image
+ *   INPUTS: inode -- inode number of the file
+ *           index -- index of the block in the file
+ *           data_block -- where to put the data block number
+ *   OUTPUTS: data block number into *data_block
+ *   RETURN VALUE: number of blocks in the run from index on (at least 1), 0 if the list doesn't cover the block
+ *   SIDE EFFECTS: none, the caller must keep interrupts off (a write can move the list)
+ */
+uint32_t extent_find(uint32_t inode, uint32_t index, uint32_t* data_block){
+    extent_list_t* list;
+    extent_t* run;
+    uint32_t i;
+
+    if(inode >= EXTENT_MAX_INODES)
+        return 0;
+    list = &extent_lists[inode];
+    if(index >= list->blocks)
+        return 0;
+
+    for(i = 0; i < list->count; i++){
+        run = &extent_pool[list->first + i];
+        if(index < run->len){
+            *data_block = run->start + index;
+            return run->len - index;
+        }
+        index -= run->len;
+    }
+    return 0;
+}
+
+/*
+ * extent_get_stats
+ *   DESCRIPTION: Gets the layout numbers of a file: how many blocks it has, how many runs they are split into and how
+ *                long the longest run is. With EXTENT_ALL_FILES the numbers are added up over every file (largest is
+ *                the longest run anywhere).
+ *   INPUTS: inode -- inode number of the file, or EXTENT_ALL_FILES
+ *           stats -- where to put the numbers
+ *   OUTPUTS: the numbers into *stats
+ *   RETURN VALUE: 0 on success, -1 if the inode has no extent list
+ *   SIDE EFFECTS: none
+ */
+int32_t extent_get_stats(uint32_t inode, extent_stats_t* stats){
+    uint32_t i, j;
+    uint32_t lo = inode, hi = inode + 1;   /* Range of inodes to add up */
+    extent_list_t* list;
+
+    if(stats == NULL)
+        return -1;
+    if(inode == EXTENT_ALL_FILES){
+        lo = 0;
+        hi = EXTENT_MAX_INODES;
+    }
+    else if(inode >= EXTENT_MAX_INODES || inode >= get_num_inodes()){
+        return -1;
+    }
+
+    stats->blocks = 0;
+    stats->extents = 0;
+    stats->largest = 0;
+    for(i = lo; i < hi; i++){
+        list = &extent_lists[i];
+        stats->blocks += list->blocks;
+        stats->extents += list->count;
+        for(j = 0; j < list->count; j++){
+            if(extent_pool[list->first + j].len > stats->largest)
+                stats->largest = extent_pool[list->first + j].len;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _EXTENT_H
+#define _EXTENT_H
+
+#include "types.h"
+#include "paging.h"
+
+/* Every data block could be its own extent, so the pool can never need more than one slot per block. Lists are
+ * packed in the pool back to back, a list that grows and isn't at the end of the pool is moved to the end, and once
+ * the pool runs out everything is rebuilt from the inodes (which packs it again). */
+#define EXTENT_POOL_SIZE      FS_MAX_BLOCKS
+#define EXTENT_MAX_INODES     1024      /* Inodes past this don't get an extent list, reads of them go block by block */
+
+/* A run of data blocks that follow each other in the image */
+typedef struct extent {
+    uint32_t start;         /* First data block of the run */
+    uint32_t len;           /* Number of blocks in the run */
+} extent_t;
+
+/* Where one file's extents are in the pool */
+typedef struct extent_list {
+    uint32_t first;         /* Index of the first extent in the pool */
+    uint32_t count;         /* Number of extents */
+    uint32_t blocks;        /* Number of data blocks the extents cover, the file's blocks in order */
+} extent_list_t;
+
+/* Layout numbers for a file (or the whole filesystem), read with extent_get_stats */
+typedef struct extent_stats {
+    uint32_t blocks;        /* Data blocks */
+    uint32_t extents;       /* Runs those blocks are split into, 1 per file is a perfect layout */
+    uint32_t largest;       /* Blocks in the longest run */
+} extent_stats_t;
+
+/* Build the extent list of every file from the inodes, done at mount (extent_clear drops every list first) */
+void extent_clear();
+void extent_build();
+/* Keep a file's extents up to date as the filesystem changes it */
+void extent_append(uint32_t inode, uint32_t index, uint32_t data_block);
+void extent_reset(uint32_t inode);
+
+/* Find the run a block of a file is in */
+uint32_t extent_find(uint32_t inode, uint32_t index, uint32_t* data_block);
+
+/* Fragmentation numbers for one file, or every file with EXTENT_ALL_FILES */
+#define EXTENT_ALL_FILES      0xFFFFFFFF
+int32_t extent_get_stats(uint32_t inode, extent_stats_t* stats);
+
+#endif
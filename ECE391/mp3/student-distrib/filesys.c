@@ -4,14 +4,81 @@
 #include "lib.h"
 #include "scheduling.h"
 #include "syscall.h"
+#include "execcache.h"
+#include "bcache.h"
+#include "blk.h"
+#include "extent.h"
+#include "compress.h"
 
 //dentry_t dir_entry_arr[MAX_DENTRY_NUM];      /* Temp array for cp2 containg all possible directory entries, we use this as our pseudo file descriptor */
 
 pcb_t * cur_pcb;
 
+/* Name index over the entries of every directory, built by fs_tree_build at mount. Open addressing keyed by directory
+and name, each slot holds the directory, the entry's index in it (or DENTRY_HASH_EMPTY) and the full hash of the entry's
+name so probes only compare names on a real match. Once DENTRY_INDEX_MAX entries are in, the rest are left out and
+lookups that miss scan the directory. */
+static uint32_t dentry_hash_dir[DENTRY_HASH_SIZE];
+static uint32_t dentry_hash_idx[DENTRY_HASH_SIZE];
+static uint32_t dentry_hash_val[DENTRY_HASH_SIZE];
+static uint32_t dentry_index_count;
+static bool dentry_index_partial;
+
+/* Inodes some directory entry points at (regular files and subdirectories), found by fs_tree_build. Directories still
+to be walked go in fs_dir_queue. */
+static uint32_t fs_inode_bitmap[FS_MAX_INODES / 32];
+static uint32_t fs_dir_queue[FS_MAX_INODES];
+
+/* Writable mode. When the image fits in the FS_RAM_LOC region the mount copies it there and the free space after it
+becomes extra data blocks. fs_block_bitmap has a bit set for every data block some file is using, it is rebuilt from the
+inodes at mount so the on-disk format doesn't change. The image in RAM is the device behind the buffer cache. */
+static bool fs_writable;
+static bool fs_indirect;            /* Inodes have indirect blocks (FS_VERSION_INDIRECT), see inode_data_block */
+static uint32_t fs_block_bitmap[FS_MAX_BLOCKS / 32];
+static uint32_t fs_alloc_hint;      /* Data block to start the next free block search from, keeps appends contiguous */
+static int32_t ramdev_read(uint32_t blk, uint8_t* buf);
+static int32_t ramdev_write(uint32_t blk, const uint8_t* buf);
+static blkdev_t fs_ramdev = {
+    .read = ramdev_read,
+    .write = ramdev_write,
+    .nblocks = 0,
+};
+
+/* Mounts from a disk (fs_mount_dev). The image is still read into the FS_RAM_LOC region and used from there, fs_flush
+writes it back to the disk. fs_disk_dirty has a bit set for every block of the image changed in RAM since the last
+fs_flush: blocks the buffer cache wrote back, and the boot block, inodes and indirect blocks (changed in place). The
+disk is read and written through its block queue. Only one task at a time is in fs_flush, since they would all hand
+out the same fs_disk_reqs. */
+static blkdev_t* fs_disk;
+static blk_queue_t fs_disk_queue;
+static blk_request_t fs_disk_reqs[BLK_QUEUE_MAX];
+static uint32_t fs_disk_dirty[FS_MAX_BLOCKS / 32];
+static bool fs_flushing;            /* A task is in fs_flush */
+static wait_queue_t fs_flush_wq;    /* Tasks waiting for it to finish */
+static int32_t fs_disk_write();
+static void fs_disk_mark(const void* addr);
+static void fs_disk_done(blk_request_t* req, int32_t status);
+
 /* Helper functions */
 int read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 int read_dentry_by_index(uint32_t idx, dentry_t* dentry);
+static uint32_t dentry_name_hash(const uint8_t* fname, uint32_t len);
+static uint32_t dentry_hash_slot(uint32_t dir, uint32_t hash);
+static void dentry_index_insert(uint32_t dir, uint32_t idx, const dentry_t* dentry);
+static bool dentry_name_eq(const dentry_t* dentry, const uint8_t* name, uint32_t len);
+static void fs_tree_build();
+static int32_t dir_lookup(uint32_t dir, const uint8_t* name, uint32_t len, dentry_t* dentry);
+static int32_t path_walk(const uint8_t* path, dentry_t* dentry, const uint8_t** last, uint32_t* last_len);
+static int32_t fs_create_entry(const uint8_t* path, uint32_t ftype);
+static void fs_bitmap_build();
+static void fs_bitmap_mark(uint32_t b);
+static void fs_format_upgrade();
+static uint32_t* index_block(uint32_t* slot, bool alloc);
+static int32_t inode_set_block(inode_t* inodeptr, uint32_t index, uint32_t data_block);
+static int32_t fs_block_alloc();
+static uint32_t write_blocks(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+static uint32_t stream_read(filedesc_t* fdptr, void* buf, uint32_t nbytes);
+static void stream_advance(filedesc_t* fdptr);
 int read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
 int get_num_dir_entries();
 int get_num_inodes();
@@ -26,10 +93,469 @@ uint32_t get_inode_len(int inodeidx);
  *   INPUTS: addr -- address of the filesystem loaded in kernel.c
  *   OUTPUTS: set filesys_addr to the input addr because that is the address we will use for our calculations later on in this file
  *   RETURN VALUE: none
- *   SIDE EFFECTS: set filesys_addr, initialize
+ *   SIDE EFFECTS: set filesys_addr, builds the dentry name index, free block bitmap and extent lists, empties the buffer cache
  */ 
 void init_dir(uint32_t* addr){
     filesys_addr = addr;
+    fs_indirect = (*(uint32_t*)((uint32_t)addr + FS_VERSION_OFFSET) == FS_VERSION_INDIRECT);
+    fs_ramdev.nblocks = 1 + get_num_inodes() + get_num_data_blocks();
+    /* Walking the directory tree reads subdirectories with read_data, so nothing from an earlier mount can be left */
+    bcache_init(&fs_ramdev);
+    compress_clear();
+    extent_clear();
+    fs_tree_build();
+    fs_bitmap_build();
+    extent_build();
+}
+
+/*
+ * fs_mount
+ *   DESCRIPTION:   Mounts the filesystem module. If the image fits in the FS_RAM_LOC region we copy it there and mount it
+ *                  writable, with every block of the region past the image added as free data blocks, and a flat image
+ *                  is switched to indirect inodes so files can grow past MAX_INODE_BLOCKS. Otherwise the module is
+ *                  mounted in place, read only, like before.
+ *                  Called before paging is turned on, so FS_RAM_LOC is reached by its physical address.
+ *   INPUTS: addr -- address of the filesystem module loaded by GRUB
+ *           size -- size of the module in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see init_dir, overwrites the FS_RAM_LOC region
+ */ 
+void fs_mount(uint32_t* addr, uint32_t size){
+    uint32_t num_inodes = addr[1];      /* Second 4B of the boot block */
+    uint32_t* ram = (uint32_t*)FS_RAM_LOC;
+
+    fs_writable = false;
+    fs_disk = NULL;
+    if(size > FS_RAM_SIZE || BLOCK_SIZE * (1 + num_inodes) >= FS_RAM_SIZE){
+        init_dir(addr);
+        return;
+    }
+
+    memcpy(ram, addr, size);
+    memset((uint8_t*)ram + size, 0, FS_RAM_SIZE - size);
+    /* Third 4B of the boot block, the data blocks now run to the end of the region */
+    ram[2] = (FS_RAM_SIZE / BLOCK_SIZE) - 1 - num_inodes;
+    fs_writable = true;
+    init_dir(ram);
+    fs_format_upgrade();
+}
+
+/*
+ * fs_mount_dev
+ *   DESCRIPTION:   Mounts the filesystem image on a block device (the ATA disk) instead of a module. The image is read
+ *                  into the FS_RAM_LOC region and mounted writable from there like a module that fits, with free data
+ *                  blocks up to the end of the device (or of the region, if the device is bigger). fs_flush writes
+ *                  what changed back to the device, so it is still there on the next boot.
+ *                  The device may wait for interrupts, so this is called once paging and interrupts are on.
+ *   INPUTS: dev -- device with the image starting at block 0
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the device can't be read or what is on it isn't an image that fits
+ *   SIDE EFFECTS: see init_dir, overwrites the FS_RAM_LOC region
+ */
+int32_t fs_mount_dev(blkdev_t* dev){
+    uint32_t* ram = (uint32_t*)FS_RAM_LOC;
+    uint32_t last;              /* Number of blocks both the device and the region have */
+    uint32_t num_blocks;        /* Number of blocks in the image, boot block and inodes too */
+
+    fs_writable = false;
+    fs_disk = NULL;
+    if(dev == NULL || dev->nblocks == 0)
+        return -1;
+    blk_queue_init(&fs_disk_queue, dev);
+    if(blk_rw(&fs_disk_queue, 0, 1, (uint8_t*)ram, false) == -1)
+        return -1;
+    last = (dev->nblocks < FS_MAX_BLOCKS) ? dev->nblocks : FS_MAX_BLOCKS;
+    if(ram[0] > MAX_DENTRY_NUM || ram[1] >= last || ram[2] > last - 1 - ram[1])
+        return -1;
+    num_blocks = 1 + ram[1] + ram[2];
+
+    if(num_blocks > 1 && blk_rw(&fs_disk_queue, 1, num_blocks - 1, (uint8_t*)ram + BLOCK_SIZE, false) == -1)
+        return -1;
+    memset((uint8_t*)ram + num_blocks * BLOCK_SIZE, 0, FS_RAM_SIZE - num_blocks * BLOCK_SIZE);
+
+    memset(fs_disk_dirty, 0, sizeof(fs_disk_dirty));
+    ram[2] = last - 1 - ram[1];
+    fs_writable = true;
+    init_dir(ram);
+    fs_disk = dev;
+    if(num_blocks != last)
+        fs_disk_mark(ram);
+    fs_format_upgrade();
+    return 0;
+}
+
+/*
+ * fs_format_upgrade
+ *   DESCRIPTION:   Switches a flat image in RAM to indirect inodes. Only files that use the last two block numbers of
+ *                  their inode need anything done: those two move into a new indirect block. The order of every file's
+ *                  blocks stays the same, so the extent lists built by init_dir are still right. If there aren't enough
+ *                  free blocks for that the image stays flat.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the boot block version word and the inodes of files with more than INODE_DIRECT_BLOCKS blocks
+ */
+static void fs_format_upgrade(){
+    uint32_t inode, needed = 0;
+    uint32_t* table;
+    int32_t b;
+
+    if(fs_indirect)
+        return;
+    /* Count first so we never leave the image half switched */
+    for(inode = 0; inode < get_num_inodes(); inode++){
+        if(fs_inode_used(inode) && inode_stored_len(get_inode(inode)) > INODE_DIRECT_BLOCKS * BLOCK_SIZE)
+            needed++;
+    }
+    if(needed > fs_free_blocks())
+        return;
+
+    for(inode = 0; inode < get_num_inodes(); inode++){
+        if(!fs_inode_used(inode) || inode_stored_len(get_inode(inode)) <= INODE_DIRECT_BLOCKS * BLOCK_SIZE)
+            continue;
+        b = fs_block_alloc();
+        table = (uint32_t*)data_blk_addr(b);
+        memset(table, 0, BLOCK_SIZE);
+        table[0] = get_inode(inode)->data_blocks[INODE_INDIRECT_SLOT];
+        table[1] = get_inode(inode)->data_blocks[INODE_DINDIRECT_SLOT];
+        get_inode(inode)->data_blocks[INODE_INDIRECT_SLOT] = b;
+        get_inode(inode)->data_blocks[INODE_DINDIRECT_SLOT] = 0;
+        fs_disk_mark(table);
+        fs_disk_mark(get_inode(inode));
+    }
+    *(uint32_t*)((uint32_t)filesys_addr + FS_VERSION_OFFSET) = FS_VERSION_INDIRECT;
+    fs_disk_mark(filesys_addr);
+    fs_indirect = true;
+}
+
+/*
+ * fs_inode_used
+ *   DESCRIPTION:   Checks if a directory entry somewhere in the tree points at an inode (as a regular file or a
+ *                  subdirectory)
+ *   INPUTS: inode -- inode number
+ *   OUTPUTS: none
+ *   RETURN VALUE: true if the inode is in use
+ *   SIDE EFFECTS: none
+ */
+bool fs_inode_used(uint32_t inode){
+    return inode < FS_MAX_INODES && (fs_inode_bitmap[inode / 32] & (1 << (inode % 32)));
+}
+
+/*
+ * fs_tree_build
+ *   DESCRIPTION:   Walks the whole directory tree from the root: puts every entry in the name index and marks the
+ *                  inodes of files and subdirectories as used. Each subdirectory is walked once, even if more than one
+ *                  entry points at it (so a loop in a bad image ends).
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills the name index and fs_inode_bitmap
+ */
+static void fs_tree_build(){
+    uint32_t dir = FS_ROOT_DIR;     /* Directory being walked */
+    uint32_t head = 0, tail = 0;    /* Directories in fs_dir_queue still to walk */
+    uint32_t i;
+    dentry_t dentry;
+
+    for(i = 0; i < DENTRY_HASH_SIZE; i++)
+        dentry_hash_idx[i] = DENTRY_HASH_EMPTY;
+    dentry_index_count = 0;
+    dentry_index_partial = false;
+    memset(fs_inode_bitmap, 0, sizeof(fs_inode_bitmap));
+
+    while(1){
+        for(i = 0; i < dir_num_entries(dir); i++){
+            if(dir_entry(dir, i, &dentry) != 0)
+                break;
+            dentry_index_insert(dir, i, &dentry);
+            if(dentry.ftype == 0 || (dentry.ftype == 1 && dentry.inode_num == FS_ROOT_DIR))
+                continue;
+            if(dentry.inode_num >= get_num_inodes() || dentry.inode_num >= FS_MAX_INODES || fs_inode_used(dentry.inode_num))
+                continue;
+            fs_inode_bitmap[dentry.inode_num / 32] |= 1 << (dentry.inode_num % 32);
+            if(dentry.ftype == 1)
+                fs_dir_queue[tail++] = dentry.inode_num;
+        }
+        if(head == tail)
+            break;
+        dir = fs_dir_queue[head++];
+    }
+}
+
+/*
+ * fs_bitmap_build
+ *   DESCRIPTION:   Rebuild the free block bitmap from the inodes: every data block a file's length covers is in use, and
+ *                  so are the indirect blocks that lead to them
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills fs_block_bitmap
+ */ 
+static void fs_bitmap_build(){
+    uint32_t num_blocks;    /* Number of data blocks a file uses */
+    uint32_t i, j, k;
+    uint32_t* table;        /* Double indirect block of the file */
+    inode_t* inodeptr;
+
+    memset(fs_block_bitmap, 0, sizeof(fs_block_bitmap));
+    fs_alloc_hint = 0;
+    for(i = 0; i < get_num_inodes(); i++){
+        if(!fs_inode_used(i))
+            continue;
+        inodeptr = get_inode(i);
+        num_blocks = (inode_stored_len(inodeptr) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        for(j = 0; j < num_blocks && j < inode_max_blocks(); j++){
+            fs_bitmap_mark(inode_data_block(inodeptr, j));
+            if(!fs_indirect || j < INODE_DIRECT_BLOCKS)
+                continue;
+            /* First block behind an indirect block, the indirect block is in use too */
+            k = j - INODE_DIRECT_BLOCKS;
+            if(k == 0)
+                fs_bitmap_mark(inodeptr->data_blocks[INODE_INDIRECT_SLOT]);
+            if(k < BLOCK_PTRS)
+                continue;
+            k -= BLOCK_PTRS;
+            table = index_block(&inodeptr->data_blocks[INODE_DINDIRECT_SLOT], false);
+            if(k == 0)
+                fs_bitmap_mark(inodeptr->data_blocks[INODE_DINDIRECT_SLOT]);
+            if(table != NULL && k % BLOCK_PTRS == 0)
+                fs_bitmap_mark(table[k / BLOCK_PTRS]);
+        }
+    }
+}
+
+/*
+ * fs_bitmap_mark
+ *   DESCRIPTION:   Marks a data block used in the free block bitmap, block numbers out of range are ignored
+ *   INPUTS: b -- data block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes fs_block_bitmap
+ */
+static void fs_bitmap_mark(uint32_t b){
+    if(b < get_num_data_blocks() && b < FS_MAX_BLOCKS)
+        fs_block_bitmap[b / 32] |= 1 << (b % 32);
+}
+
+/*
+ * dentry_name_hash
+ *   DESCRIPTION: FNV-1a hash of a file name, stopping at the null terminator or len chars
+ *                (dentry names are not null terminated when they are exactly 32 chars long)
+ *   INPUTS: fname -- name to hash
+ *           len -- most chars to hash, MAX_FNAME_SIZE for a dentry name or the length of one part of a path
+ *   OUTPUTS: none
+ *   RETURN VALUE: 32 bit hash of the name
+ *   SIDE EFFECTS: none
+ */ 
+static uint32_t dentry_name_hash(const uint8_t* fname, uint32_t len){
+    uint32_t hash = FNV_OFFSET_BASIS;
+    uint32_t i;
+
+    for(i = 0; i < len && fname[i] != '\0'; i++){
+        hash ^= fname[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Here to make code more readable
+Description: first slot to probe for a name hash in a directory, the directory is mixed in so the same name in
+different directories lands in different places */
+static uint32_t dentry_hash_slot(uint32_t dir, uint32_t hash){
+    return (hash ^ (dir * FNV_PRIME)) & (DENTRY_HASH_SIZE - 1);
+}
+
+/*
+ * dentry_name_eq
+ *   DESCRIPTION: Compares a dentry's name with one part of a path
+ *   INPUTS: dentry -- entry to check
+ *           name -- start of the name, doesn't have to be null terminated
+ *           len -- length of the name, at most MAX_FNAME_SIZE
+ *   OUTPUTS: none
+ *   RETURN VALUE: true if the names are the same
+ *   SIDE EFFECTS: none
+ */
+static bool dentry_name_eq(const dentry_t* dentry, const uint8_t* name, uint32_t len){
+    if(strncmp(dentry->fname, (int8_t*)name, len) != 0)
+        return false;
+    return len == MAX_FNAME_SIZE || dentry->fname[len] == '\0';
+}
+
+/*
+ * dentry_index_insert
+ *   DESCRIPTION: Adds one directory entry to the name index. If two entries in a directory share a name the first one
+ *                wins, same as the linear scan.
+ *   INPUTS: dir -- directory the entry is in
+ *           idx -- index of the entry in the directory
+ *           dentry -- the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills a slot of the index, or marks the index partial if it is full
+ */ 
+static void dentry_index_insert(uint32_t dir, uint32_t idx, const dentry_t* dentry){
+    uint32_t hash = dentry_name_hash((uint8_t*)dentry->fname, MAX_FNAME_SIZE);
+    uint32_t slot = dentry_hash_slot(dir, hash);
+    dentry_t other;         /* Entry already in the slot we are probing */
+
+    if(dentry_index_count >= DENTRY_INDEX_MAX){
+        dentry_index_partial = true;
+        return;
+    }
+    /* Linear probe to a free slot, skipping names we already have (the table is never more than half full) */
+    while(dentry_hash_idx[slot] != DENTRY_HASH_EMPTY){
+        if(dentry_hash_dir[slot] == dir && dentry_hash_val[slot] == hash && dir_entry(dir, dentry_hash_idx[slot], &other) == 0 &&
+           !strncmp(other.fname, dentry->fname, MAX_FNAME_SIZE))
+            return;
+        slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+    }
+    dentry_hash_dir[slot] = dir;
+    dentry_hash_idx[slot] = idx;
+    dentry_hash_val[slot] = hash;
+    dentry_index_count++;
+}
+
+/*
+ * dir_lookup
+ *   DESCRIPTION: Finds an entry by name in one directory through the name index (and by scanning the directory if the
+ *                index didn't have room for everything)
+ *   INPUTS: dir -- directory to look in
+ *           name -- name to find, doesn't have to be null terminated
+ *           len -- length of the name, at most MAX_FNAME_SIZE
+ *           dentry -- filled with the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the name is there, -1 if not
+ *   SIDE EFFECTS: fills dentry
+ */
+static int32_t dir_lookup(uint32_t dir, const uint8_t* name, uint32_t len, dentry_t* dentry){
+    uint32_t hash = dentry_name_hash(name, len);
+    uint32_t slot = dentry_hash_slot(dir, hash);
+    uint32_t i;
+
+    /* Probe until we hit an empty slot, which means the name is not in the index */
+    while(dentry_hash_idx[slot] != DENTRY_HASH_EMPTY){
+        if(dentry_hash_dir[slot] == dir && dentry_hash_val[slot] == hash && dir_entry(dir, dentry_hash_idx[slot], dentry) == 0 &&
+           dentry_name_eq(dentry, name, len))
+            return 0;
+        slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+    }
+    if(!dentry_index_partial)
+        return -1;
+    for(i = 0; i < dir_num_entries(dir); i++){
+        if(dir_entry(dir, i, dentry) == 0 && dentry_name_eq(dentry, name, len))
+            return 0;
+    }
+    return -1;
+}
+
+/*
+ * path_walk
+ *   DESCRIPTION: Follows a path from the root. Parts are separated by '/' (a leading '/' is optional, every path starts
+ *                at the root), "." is the directory we are in and ".." the one above it.
+ *   INPUTS: path -- path to follow
+ *           dentry -- filled with the entry the path ends at. For a path ending in a directory ("/", "..", ...)
+ *                     that is a made up entry with ftype 1 and the directory's number as the inode.
+ *           last, last_len -- if not NULL, stop before the last part of the path: dentry is the directory it would be
+ *                     in, and these say where that last part is in path
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the path is empty, a part of it is missing or too long, something in the
+ *                 middle isn't a directory, or it goes more than FS_MAX_DEPTH directories deep
+ *   SIDE EFFECTS: fills dentry (and last, last_len)
+ */
+static int32_t path_walk(const uint8_t* path, dentry_t* dentry, const uint8_t** last, uint32_t* last_len){
+    uint32_t dirs[FS_MAX_DEPTH];    /* Directories from the root down to the one we are in, for ".." */
+    uint32_t depth = 0;
+    uint32_t len;                   /* Length of the current part of the path */
+    const uint8_t* next;            /* Start of the part after it */
+
+    if(path == NULL || path[0] == '\0')
+        return -1;
+    dirs[0] = FS_ROOT_DIR;
+    memset(dentry, 0, sizeof(dentry_t));
+    dentry->fname[0] = '.';
+    dentry->ftype = 1;
+    dentry->inode_num = FS_ROOT_DIR;
+
+    while(1){
+        while(*path == '/')
+            path++;
+        for(len = 0; path[len] != '\0' && path[len] != '/'; len++);
+        if(len == 0)
+            return (last == NULL) ? 0 : -1;
+        if(len > MAX_FNAME_SIZE)
+            return -1;
+        for(next = path + len; *next == '/'; next++);
+
+        if(last != NULL && *next == '\0'){
+            *last = path;
+            *last_len = len;
+            return 0;
+        }
+        if(path[0] == '.' && (len == 1 || (len == 2 && path[1] == '.'))){
+            if(len == 2 && depth > 0)
+                depth--;
+            memset(dentry, 0, sizeof(dentry_t));
+            memcpy(dentry->fname, path, len);
+            dentry->ftype = 1;
+            dentry->inode_num = dirs[depth];
+        }
+        else{
+            if(dir_lookup(dirs[depth], path, len, dentry) != 0)
+                return -1;
+            if(*next == '\0')
+                return 0;
+            if(dentry->ftype != 1)
+                return -1;
+            if(dentry->inode_num == FS_ROOT_DIR)
+                depth = 0;
+            else if(depth + 1 < FS_MAX_DEPTH)
+                dirs[++depth] = dentry->inode_num;
+            else
+                return -1;
+        }
+        path = next;
+    }
+}
+
+/*
+ * dir_num_entries
+ *   DESCRIPTION: Number of entries in a directory
+ *   INPUTS: dir -- FS_ROOT_DIR or the inode of a subdirectory
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of entries
+ *   SIDE EFFECTS: none
+ */
+int32_t dir_num_entries(uint32_t dir){
+    uint32_t num;
+
+    if(dir == FS_ROOT_DIR){
+        num = get_num_dir_entries();
+        return (num > MAX_DENTRY_NUM) ? MAX_DENTRY_NUM : num;
+    }
+    if(dir >= get_num_inodes())
+        return 0;
+    return get_inode_len(dir) / DENTRY_SIZE;
+}
+
+/*
+ * dir_entry
+ *   DESCRIPTION: Reads one entry of a directory, out of the boot block for the root and out of the subdirectory's
+ *                data for everything else
+ *   INPUTS: dir -- FS_ROOT_DIR or the inode of a subdirectory
+ *           idx -- index of the entry
+ *           dentry -- filled with the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no such entry
+ *   SIDE EFFECTS: fills dentry
+ */
+int32_t dir_entry(uint32_t dir, uint32_t idx, dentry_t* dentry){
+    if(idx >= dir_num_entries(dir))
+        return -1;
+    if(dir == FS_ROOT_DIR)
+        return read_dentry_by_index(idx, dentry);
+    if(read_data(dir, idx * DENTRY_SIZE, (uint8_t*)dentry, DENTRY_SIZE) < DENTRY_SIZE)
+        return -1;
+    return 0;
 }
 
 
@@ -44,14 +570,15 @@ void init_dir(uint32_t* addr){
  */ 
 int file_open(const uint8_t* fname) {
     dentry_t cur_dentry;
-    int fdnum;
+    int fdnum = -1;
     filedesc_t * fdptr = get_free_fd(&fdnum);
-    if (read_dentry_by_name((uint8_t *)fname, &cur_dentry) == -1) return -1;
+    if (read_dentry_by_name((uint8_t *)fname, &cur_dentry) == -1 || cur_dentry.ftype != 2) return -1;
     if (!fdptr) return -1;
     fdptr->flags.in_use = true;
     fdptr->optbl = &regfile_optbl;
     fdptr->inode = cur_dentry.inode_num;
     fdptr->pos = 0;
+    fdptr->flags.streaming = 0;
     return fdnum;
 }
 
@@ -66,12 +593,14 @@ int file_open(const uint8_t* fname) {
  */ 
 int dir_open(const uint8_t* dirname) {
     dentry_t cur_dentry;
-    int fdnum;
+    int fdnum = -1;
     filedesc_t * fdptr = get_free_fd(&fdnum);
-    if (read_dentry_by_name((uint8_t *)dirname, &cur_dentry) == -1) return -1;
+    if (read_dentry_by_name((uint8_t *)dirname, &cur_dentry) == -1 || cur_dentry.ftype != 1) return -1;
     if (!fdptr) return -1;
     fdptr->flags.in_use = true;
     fdptr->optbl = &dir_optbl;
+    fdptr->inode = cur_dentry.inode_num;    /* Directory number, FS_ROOT_DIR for the root */
+    fdptr->pos = 0;
     return fdnum;
 }
 
@@ -112,17 +641,36 @@ int dir_close(int fd){
 }
 
 /*
- * file_write and dir_write
- *   DESCRIPTION:   Unused in read only file system, the same for both functions.
- *   INPUTS: fd -- file descriptor for current file or directory
+ * file_write
+ *   DESCRIPTION:   Writes to a file at the descriptor's position, growing the file if the write goes past its end.
+ *                  See write_data for details.
+ *   INPUTS: fd -- file descriptor for current file
+ *          buf -- data to write
+ *          nbytes -- number of bytes to write
  *   OUTPUTS: none
- *   RETURN VALUE: -1, failure because we cannot write in a read only file system
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: number of bytes written (may be short if the filesystem fills up), -1 if the filesystem is read only
+ *   SIDE EFFECTS: changes the file, updates position in file for given fd.
  */ 
 int file_write(int fd, const void * buf, int nbytes){
-    return -1;
+    int bytes_written;
+    filedesc_t * fdptr = syscall_getfdptr(fd);
+
+    if(buf == NULL || nbytes < 0)
+        return -1;
+    bytes_written = write_data(fdptr->inode, fdptr->pos, buf, nbytes);
+    if(bytes_written > 0)
+        fdptr->pos += bytes_written;
+    return bytes_written;
 }
-/* See above */
+
+/*
+ * dir_write
+ *   DESCRIPTION:   Directories can't be written to, files are added with fs_create.
+ *   INPUTS: fd -- file descriptor for current directory
+ *   OUTPUTS: none
+ *   RETURN VALUE: -1
+ *   SIDE EFFECTS: none
+ */ 
 int dir_write(int fd, const void * buf, int nbytes){
     return -1;
 }
@@ -142,14 +690,123 @@ int file_read(int fd, void* buf, int32_t nbytes){
     int bytes_read;     /* Number of bytes read from this call */
     filedesc_t * fdptr = syscall_getfdptr(fd);
 
-    /* Read the file */
-    bytes_read = read_data(fdptr->inode, fdptr->pos, buf, nbytes);
+    if(nbytes <= 0)
+        return 0;
+
+    /* Sequential reads come out of the stream window, anything it can't do (the first read, a read that doesn't pick up
+    where the last one stopped, the end of the file) goes through read_data like always */
+    bytes_read = stream_read(fdptr, buf, nbytes);
+    if(bytes_read < nbytes)
+        bytes_read += read_data(fdptr->inode, fdptr->pos + bytes_read, (uint8_t*)buf + bytes_read, nbytes - bytes_read);
 
-    /* Update position in file and return number of bytes read from read_data */
+    /* Update position in file, and start the window for the next read if we just did a sequential one */
     fdptr->pos += bytes_read;
+    stream_advance(fdptr);
     return bytes_read;
 }
 
+/*
+ * stream_read
+ *   DESCRIPTION: Streaming fast path for file_read. If this read starts where the stream window is, copy out of the
+ *                window without looking at the inode again. The window always stops short of the end of the file, so the
+ *                last bytes (and read_data's extra byte at the end) are left for read_data.
+ *   INPUTS: fdptr -- file descriptor being read
+ *          buf --  buffer to be filled with file contents
+ *          nbytes -- number of bytes to be read
+ *   OUTPUTS: fills buf
+ *   RETURN VALUE: number of bytes copied, 0 if the read isn't sequential or the window is stale
+ *   SIDE EFFECTS: uses up the window
+ */ 
+static uint32_t stream_read(filedesc_t* fdptr, void* buf, uint32_t nbytes){
+    uint32_t span;
+    uint32_t flags;
+
+    if(!fdptr->flags.streaming || fdptr->stream_pos != fdptr->pos)
+        return 0;
+
+    cli_and_save(flags);
+    /* Something in the buffer cache changed since the window was set up, the window may point at old data */
+    if(fdptr->stream_gen != bcache_generation()){
+        fdptr->flags.streaming = 0;
+        restore_flags(flags);
+        return 0;
+    }
+    span = (nbytes < fdptr->stream_left) ? nbytes : fdptr->stream_left;
+    memcpy(buf, fdptr->stream_ptr, span);
+    restore_flags(flags);
+
+    fdptr->stream_ptr += span;
+    fdptr->stream_pos += span;
+    fdptr->stream_left -= span;
+    return span;
+}
+
+/*
+ * stream_advance
+ *   DESCRIPTION: Keeps the stream window ahead of a sequential reader. Once the window is used up we read ahead: look up
+ *                the block at the new position in the file's extents and take the rest of its run (up to STREAM_RA_BLOCKS),
+ *                so the next reads are straight copies out of one run. Blocks that are in the buffer cache are read from
+ *                their buffer, one at a time.
+ *   INPUTS: fdptr -- file descriptor that was just read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets up the stream fields of the descriptor, turns streaming off if there is nothing to stream
+ */ 
+static void stream_advance(filedesc_t* fdptr){
+    uint32_t index_offset = fdptr->pos / BLOCK_SIZE;    /* Index of the block the window starts in */
+    uint32_t byte_offset = fdptr->pos % BLOCK_SIZE;     /* Number of bytes offset into that block */
+    uint32_t length;                                    /* Length of the file */
+    uint32_t data_block;                                /* Data block number of the block the window starts in */
+    uint32_t run;                                       /* Number of blocks in the window */
+    uint32_t n;
+    uint8_t* cached;
+    inode_t* inodeptr;
+    uint32_t flags;
+
+    /* Window still has data left for the next read */
+    if(fdptr->flags.streaming && fdptr->stream_pos == fdptr->pos && fdptr->stream_left > 0)
+        return;
+
+    fdptr->flags.streaming = 0;
+    if(fdptr->inode >= get_num_inodes())
+        return;
+    inodeptr = get_inode(fdptr->inode);
+    length = inodeptr->length;
+    /* Compressed files have nothing to stream in place, their reads go through read_data */
+    if(fdptr->pos >= length || (length & INODE_COMPRESSED))
+        return;
+
+    cli_and_save(flags);
+    /* Blocks the extents don't cover are left to read_data */
+    run = extent_find(fdptr->inode, index_offset, &data_block);
+    if(run == 0){
+        restore_flags(flags);
+        return;
+    }
+    cached = bcache_lookup(data_blk_num(data_block));
+    if(cached != NULL){
+        fdptr->stream_ptr = cached + byte_offset;
+        run = 1;
+    }
+    else{
+        fdptr->stream_ptr = data_blk_addr(data_block) + byte_offset;
+        for(n = 1; n < run && n < STREAM_RA_BLOCKS; n++){
+            if(bcache_lookup(data_blk_num(data_block + n)) != NULL)
+                break;
+        }
+        run = n;
+    }
+    fdptr->stream_gen = bcache_generation();
+    restore_flags(flags);
+
+    /* Stop short of the end of the file, read_data does the last bytes */
+    fdptr->stream_left = run * BLOCK_SIZE - byte_offset;
+    if(fdptr->pos + fdptr->stream_left > length)
+        fdptr->stream_left = length - fdptr->pos;
+    fdptr->stream_pos = fdptr->pos;
+    fdptr->flags.streaming = 1;
+}
+
 /*
  * dir_read
  *   DESCRIPTION: Given a directory reads the directory entry name, successive calls read next directory entry name until no more exist
@@ -165,12 +822,8 @@ int dir_read(int fd, void* buf, int32_t nbytes){
     dentry_t garbage;
     
 
-    /* If the dentry index we are trying to access is greater than the number of dentries we read 0 bytes */
-    if(get_num_dir_entries() < cur_pcb->file_array[fd].pos)
-        return 0;
-    
-    /* If the dentry isn't real we read 0 bytes */
-    if(read_dentry_by_index(cur_pcb->file_array[fd].pos, &garbage) != 0)
+    /* If the dentry isn't real (we are past the last one) we read 0 bytes */
+    if(dir_entry(cur_pcb->file_array[fd].inode, cur_pcb->file_array[fd].pos, &garbage) != 0)
         return 0;
 
     /* Copy the name over to the buffer and then update the index */
@@ -187,11 +840,48 @@ int dir_read(int fd, void* buf, int32_t nbytes){
     return bytes_read;
 }
 
+/*
+ * dir_getdents
+ *   DESCRIPTION: Batched dir_read: fills buf with as many whole directory entries (name, type, inode, size) as fit,
+ *                starting at the descriptor's position in the directory. Shares that position with dir_read.
+ *   INPUTS: fd -- file descriptor of an open directory
+ *          buf -- buffer to be filled with dirent_t structs
+ *          nbytes -- size of buf in bytes
+ *   OUTPUTS: fills buf
+ *   RETURN VALUE: number of bytes filled in (a multiple of sizeof(dirent_t)), 0 once every entry has been read,
+ *                 -1 if buf can't hold even one entry
+ *   SIDE EFFECTS: moves the position in the directory past the entries returned
+ */
+int32_t dir_getdents(int32_t fd, void* buf, int32_t nbytes){
+    filedesc_t* fdptr = syscall_getfdptr(fd);
+    dirent_t* ent = (dirent_t*)buf;
+    dentry_t dentry;
+    int32_t count = 0;      /* Number of entries filled in */
+
+    if(buf == NULL || nbytes < 0)
+        return -1;
+    while(dir_entry(fdptr->inode, fdptr->pos, &dentry) == 0){
+        if((count + 1) * sizeof(dirent_t) > nbytes)
+            break;
+        memcpy(ent[count].fname, dentry.fname, MAX_FNAME_SIZE);
+        ent[count].ftype = dentry.ftype;
+        ent[count].inode_num = dentry.inode_num;
+        ent[count].size = (dentry.ftype == 2) ? get_inode_len(dentry.inode_num) : 0;
+        count++;
+        fdptr->pos++;
+    }
+
+    /* There is an entry left, but the buffer is too small for it */
+    if(count == 0 && fdptr->pos < dir_num_entries(fdptr->inode) && nbytes < sizeof(dirent_t))
+        return -1;
+    return count * sizeof(dirent_t);
+}
+
 /*
  * read_dentry_by_name
- *   DESCRIPTION: Searches through the directory entries in the filesys img looking for one with the
- *                  same name as fname. Updates dentry info if found.
- *   INPUTS: fname -- string name of the file we want to find
+ *   DESCRIPTION: Finds the directory entry a path names, see path_walk for what a path can look like. A plain file
+ *                  name is looked up in the root directory, same as before there were subdirectories.
+ *   INPUTS: fname -- path of the file we want to find
  *          dentry --  pointer to directory entry struct that we will update the contents of
  *   OUTPUTS: none
  *   RETURN VALUE: 0 if we successfully find the directory entry corresponding to fname
@@ -199,6 +889,25 @@ int dir_read(int fd, void* buf, int32_t nbytes){
  *   SIDE EFFECTS: fills dentry with the data corresponding to the directory entry w/ fname
  */ 
 int read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
+    /* If the path is longer than the longest path we take we know it doesn't exist */
+    if(fname == NULL || strlen((char*)fname) > MAX_PATH_SIZE){
+        return -1;
+    }
+    return path_walk(fname, dentry, NULL, NULL);
+}
+
+/*
+ * read_dentry_by_name_scan
+ *   DESCRIPTION: Same as read_dentry_by_name for a name in the root directory, but walks every directory entry in the
+ *                boot block instead of using the name index. Kept as the reference for the lookup benchmark in tests.c.
+ *   INPUTS: fname -- string name of the file we want to find
+ *          dentry --  pointer to directory entry struct that we will update the contents of
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if we successfully find the directory entry corresponding to fname
+ *                  -1 if we cannot find it
+ *   SIDE EFFECTS: fills dentry with the data corresponding to the directory entry w/ fname
+ */ 
+int read_dentry_by_name_scan(const uint8_t* fname, dentry_t* dentry){
     uint32_t dentry_tot;    /* Number of total directory entries */
     int i;                  /* Loop Counter */
     dentry_t** dir_table;   /* Pointer to the mem location of the first directory entry */
@@ -268,7 +977,8 @@ int read_dentry_by_index(uint32_t idx, dentry_t* dentry){
 
 /*
  * read_data
- *   DESCRIPTION: Given an inode number and the location in the file we want to read, we read the data from the file
+ *   DESCRIPTION: Given an inode number and the location in the file we want to read, we read the data from the file.
+ *                Compressed files are decompressed by compress_read, everything else is read as stored.
  *   INPUTS: inode-- inode number for the current file we want to read
  *          offset --  number of bytes into the file we want to start reading
  *          buf -- the buffer we will be putting the read data into
@@ -276,47 +986,517 @@ int read_dentry_by_index(uint32_t idx, dentry_t* dentry){
  *   OUTPUTS: fills input buffer 
  *   RETURN VALUE: bytes_read -- number of bytes in the file read this call
  *   SIDE EFFECTS: fills input buffer
+ *   NOTE: see read_stored for the extra byte at the end of the file
  */ 
 int read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
-    int i;                                          /* Loop counter */
-    int byte_offset = offset % BLOCK_SIZE;          /* Number of bytes offset into a data block */
-    int index_offset = offset / BLOCK_SIZE;         /* Number of data blocks we offset based on number of bytes offset */
-    int32_t dataBlockCount = get_num_data_blocks();     /* Number of data blocks total */
-    int bytes_read = 0;                             /* Number of bytes read in this call */
+    /* Check if this is a bad file, if it is we read 0 B */
+    if(inode > get_num_inodes())
+        return 0;
+    if(get_inode(inode)->length & INODE_COMPRESSED)
+        return compress_read(inode, offset, buf, length);
+    return read_stored(inode, offset, buf, length);
+}
+
+/*
+ * read_stored
+ *   DESCRIPTION: Reads the bytes of a file as they are stored in its data blocks (for a compressed file that is the
+ *                compressed data, see compress.h).
+ *                Works a run of blocks at a time: the file's extent list says how many of its blocks from here on sit
+ *                next to each other in the image, and we memcpy the span we need out of all of them in one go.
+ *   INPUTS: inode-- inode number for the current file we want to read
+ *          offset --  number of bytes into the file we want to start reading
+ *          buf -- the buffer we will be putting the read data into
+ *          length -- the number of bytes we want to read
+ *   OUTPUTS: fills input buffer 
+ *   RETURN VALUE: bytes_read -- number of bytes in the file read this call
+ *   SIDE EFFECTS: fills input buffer
+ *   NOTE: Reads only stop once the position is past the file length, so a read that reaches the end of the file
+ *         also gets the byte at position length (the byte loop this replaced did the same and callers see it).
+ *         Blocks the extent list doesn't cover (that byte, or a file with a bad block number) are looked up in the
+ *         inode one at a time, and a data block number that is out of range ends the read before that block is touched.
+ */ 
+int read_stored(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t byte_offset = offset % BLOCK_SIZE;     /* Number of bytes offset into the current data block */
+    uint32_t index_offset = offset / BLOCK_SIZE;    /* Index of the current data block in the inode */
+    uint32_t dataBlockCount;                        /* Number of data blocks total */
+    uint32_t bytes_read = 0;                        /* Number of bytes read in this call */
     uint32_t bytes_max;                             /* Number of bytes in the file we are reading */
-    uint8_t start_flag = 0;                         /* Flag checking if this is the beginning of the file, so we don't offset immediately */
+    uint32_t span;                                  /* Number of bytes we copy this time around */
+    uint32_t data_block;                            /* Data block number of the current block */
+    uint32_t run;                                   /* Number of blocks from the current one on that follow each other in the image */
+    uint32_t n;                                     /* Number of blocks we copy this time around */
+    inode_t * inodeptr;                             /* Inode struct for the file in the filesystem */
+    uint8_t * cached;                               /* Buffer cache copy of the current data block, if there is one */
+    uint32_t flags;
 
     /* Check if this is a bad file, if it is we read 0 B */
     if(inode > get_num_inodes())
         return 0;
-    /* Make inodeptr for our inode struct to easily access the data in the inode in the filesystem */
-    inode_t * inodeptr = (inode_t*)((uint32_t)filesys_addr + (inode * BLOCK_SIZE) + BLOCK_SIZE);
-    bytes_max = inodeptr->length;
+    inodeptr = (inode_t*)((uint32_t)filesys_addr + (inode * BLOCK_SIZE) + BLOCK_SIZE);
+    bytes_max = inode_stored_len(inodeptr);
 
-    
-    /* Loop through the file starting from offset until length is reached or we reach the end of the file */
-    for(i = 0; i < length; i++){
-        /* Check if end of file reached */
-        if(bytes_read + offset > bytes_max)
-            return bytes_read;
-        /* Check if datablock is valid */
-        if(inodeptr->data_blocks[index_offset] > dataBlockCount)
-            return bytes_read;
-
-        /* This is how we check which data block we go into, we mod by blocksize. Reset the byte offset and increment the datablock offset into the file */
-        if ((get_data_block(index_offset, inodeptr) + byte_offset) % BLOCK_SIZE == 0 && start_flag != 0) {
-            byte_offset = 0;
-            index_offset++;
+    /* Check if we are already past the end of the file, otherwise clamp the length once up front */
+    if(offset > bytes_max)
+        return 0;
+    if(length > bytes_max - offset + 1)
+        length = bytes_max - offset + 1;
+
+    dataBlockCount = get_num_data_blocks();
+    while(bytes_read < length){
+        cli_and_save(flags);
+        run = extent_find(inode, index_offset, &data_block);
+        if(run == 0){
+            /* Check if datablock is valid */
+            data_block = inode_data_block(inodeptr, index_offset);
+            if(data_block > dataBlockCount){
+                restore_flags(flags);
+                break;
+            }
+            run = 1;
+        }
+
+        /* A block in the buffer cache may have writes that aren't in the image yet, it is copied out of its buffer on
+        its own (pinned, so the buffer can't be reused while interrupts are on). Otherwise take every block of the run
+        we need up to the next cached one. */
+        cached = bcache_pin(data_blk_num(data_block));
+        if(cached != NULL){
+            n = 1;
+        }
+        else{
+            for(n = 1; n < run && n * BLOCK_SIZE - byte_offset < length - bytes_read; n++){
+                if(bcache_lookup(data_blk_num(data_block + n)) != NULL)
+                    break;
+            }
+        }
+        restore_flags(flags);
+        span = n * BLOCK_SIZE - byte_offset;
+        if(span > length - bytes_read)
+            span = length - bytes_read;
+        if(cached != NULL){
+            memcpy(buf + bytes_read, cached + byte_offset, span);
+            cli_and_save(flags);
+            bcache_unpin(cached);
+            restore_flags(flags);
         }
-        /* Fill the buffer with new info from the data blocks, then increment that we've read a byte */
-        buf[i] = *(uint8_t*)(get_data_block(index_offset, inodeptr) + byte_offset);
-        byte_offset++;
-        bytes_read++;
-        start_flag = 1;
+        else{
+            memcpy(buf + bytes_read, data_blk_addr(data_block) + byte_offset, span);
+        }
+
+        bytes_read += span;
+        byte_offset = 0;
+        index_offset += n;
     }
     return bytes_read;
 }
 
+/*
+ * write_data
+ *   DESCRIPTION: Writes into a file, the write side of read_data. Data goes into the buffer cache a block at a time and
+ *                reaches the image when the block is evicted or the cache is flushed. Writing past the end of the file
+ *                grows it, taking new data blocks from the free block bitmap. If the write starts past the end of the
+ *                file the gap is filled with zeros first.
+ *   INPUTS: inode -- inode number of the file we are writing
+ *           offset -- number of bytes into the file to start writing
+ *           buf -- data to write, NULL writes zeros
+ *           length -- number of bytes to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes written, which is short if we run out of data blocks or hit the largest file an
+ *                 inode can describe. -1 if the filesystem is read only, the inode is bad or the file is compressed
+ *                 (compressed files are read only).
+ *   SIDE EFFECTS: changes the file and its inode, may allocate data blocks, drops any cached exec image of the file
+ */
+int write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length){
+    inode_t* inodeptr;
+    uint32_t gap;           /* Bytes between the end of the file and the start of the write */
+    uint32_t bytes_written;
+    uint32_t flags;
+
+    if(!fs_writable || inode >= get_num_inodes() || (get_inode(inode)->length & INODE_COMPRESSED))
+        return -1;
+    inodeptr = get_inode(inode);
+
+    cli_and_save(flags);
+    if(offset > inodeptr->length){
+        gap = offset - inodeptr->length;
+        if(write_blocks(inode, inodeptr->length, NULL, gap) != gap){
+            restore_flags(flags);
+            return 0;
+        }
+    }
+    bytes_written = write_blocks(inode, offset, buf, length);
+    restore_flags(flags);
+
+    exec_cache_invalidate(inode);
+    return bytes_written;
+}
+
+/*
+ * write_blocks
+ *   DESCRIPTION: Block loop for write_data, the file must already reach offset
+ *   INPUTS: inode -- inode number of the file
+ *           offset -- number of bytes into the file to start writing, at most the file length
+ *           buf -- data to write, NULL writes zeros
+ *           length -- number of bytes to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of bytes written
+ *   SIDE EFFECTS: changes the file and its inode, may allocate data blocks (and add them to the file's extents)
+ */
+static uint32_t write_blocks(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length){
+    inode_t* inodeptr = get_inode(inode);
+    uint32_t num_blocks = (inodeptr->length + BLOCK_SIZE - 1) / BLOCK_SIZE;    /* Data blocks the file has now */
+    uint32_t index_offset;      /* Index of the current data block in the inode */
+    uint32_t byte_offset;       /* Number of bytes offset into the current data block */
+    uint32_t span;              /* Number of bytes we write into the current data block */
+    uint32_t bytes_written = 0;
+    uint32_t blk;               /* Block number of the current data block on the device */
+    int32_t new_block;
+    uint8_t* data;
+
+    while(bytes_written < length){
+        index_offset = (offset + bytes_written) / BLOCK_SIZE;
+        byte_offset = (offset + bytes_written) % BLOCK_SIZE;
+        if(index_offset >= inode_max_blocks())
+            break;
+        span = BLOCK_SIZE - byte_offset;
+        if(span > length - bytes_written)
+            span = length - bytes_written;
+
+        if(index_offset >= num_blocks){
+            /* Past the last block, give the file a new zeroed one */
+            new_block = fs_block_alloc();
+            if(new_block == -1)
+                break;
+            blk = data_blk_num(new_block);
+            data = bcache_get(blk, false);
+            if(data == NULL){
+                fs_block_free(new_block);
+                break;
+            }
+            memset(data, 0, BLOCK_SIZE);
+            if(inode_set_block(inodeptr, index_offset, new_block) == -1){
+                fs_block_free(new_block);
+                break;
+            }
+            extent_append(inode, index_offset, new_block);
+            num_blocks = index_offset + 1;
+        }
+        else{
+            /* Only read the old contents if we aren't overwriting all of them */
+            blk = data_blk_num(inode_data_block(inodeptr, index_offset));
+            data = bcache_get(blk, byte_offset != 0 || span != BLOCK_SIZE);
+            if(data == NULL)
+                break;
+        }
+
+        if(buf != NULL)
+            memcpy(data + byte_offset, buf + bytes_written, span);
+        else
+            memset(data + byte_offset, 0, span);
+        bcache_dirty(blk);
+
+        bytes_written += span;
+        if(offset + bytes_written > inodeptr->length){
+            inodeptr->length = offset + bytes_written;
+            fs_disk_mark(inodeptr);
+        }
+    }
+    return bytes_written;
+}
+
+/*
+ * fs_create
+ *   DESCRIPTION: Adds a new empty regular file
+ *   INPUTS: fname -- path of the new file, every directory on the way has to exist
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (see fs_create_entry)
+ *   SIDE EFFECTS: see fs_create_entry
+ */
+int32_t fs_create(const uint8_t* fname){
+    return fs_create_entry(fname, 2);
+}
+
+/*
+ * fs_mkdir
+ *   DESCRIPTION: Adds a new empty directory
+ *   INPUTS: path -- path of the new directory, every directory on the way has to exist
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure (see fs_create_entry)
+ *   SIDE EFFECTS: see fs_create_entry
+ */
+int32_t fs_mkdir(const uint8_t* path){
+    return fs_create_entry(path, 1);
+}
+
+/*
+ * fs_create_entry
+ *   DESCRIPTION: Adds a new entry with a fresh empty inode to a directory. Entries in the root go in the boot block,
+ *                entries in a subdirectory are appended to its data.
+ *   INPUTS: path -- path of the new entry, the last part is its name (1 to MAX_FNAME_SIZE chars)
+ *           ftype -- 2 for a regular file, 1 for a directory
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the filesystem is read only, the path is bad, the name is taken, or there is no
+ *                 room for the entry or no free inode
+ *   SIDE EFFECTS: changes the directory and an inode, adds the entry to the name index
+ */
+static int32_t fs_create_entry(const uint8_t* path, uint32_t ftype){
+    dentry_t dir;               /* Directory the entry goes in */
+    dentry_t dentry;
+    dentry_t* new_dentry;       /* Pointer to the new dentry in the boot block */
+    const uint8_t* name;        /* Last part of the path */
+    uint32_t len;
+    uint32_t num_entries;
+    uint32_t num_inodes;
+    uint32_t inode;
+    uint32_t flags;
+
+    if(!fs_writable || path == NULL || strlen((char*)path) > MAX_PATH_SIZE)
+        return -1;
+
+    cli_and_save(flags);
+    if(path_walk(path, &dir, &name, &len) != 0 || dir.ftype != 1 ||
+       (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.'))) || dir_lookup(dir.inode_num, name, len, &dentry) == 0){
+        restore_flags(flags);
+        return -1;
+    }
+    num_entries = dir_num_entries(dir.inode_num);
+    if(dir.inode_num == FS_ROOT_DIR && num_entries >= MAX_DENTRY_NUM){
+        restore_flags(flags);
+        return -1;
+    }
+
+    /* Take the first inode no dentry points at, inode 0 is left alone since "." and rtc use it */
+    num_inodes = (get_num_inodes() < FS_MAX_INODES) ? get_num_inodes() : FS_MAX_INODES;
+    for(inode = 1; inode < num_inodes && fs_inode_used(inode); inode++);
+    if(inode >= num_inodes){
+        restore_flags(flags);
+        return -1;
+    }
+    get_inode(inode)->length = 0;
+    fs_disk_mark(get_inode(inode));
+    extent_reset(inode);
+    compress_invalidate(inode);
+
+    memset(&dentry, 0, sizeof(dentry));
+    memcpy(dentry.fname, name, len);
+    dentry.ftype = ftype;
+    dentry.inode_num = inode;
+    if(dir.inode_num == FS_ROOT_DIR){
+        /* The directory entries begin 64 bytes into the boot block */
+        new_dentry = (dentry_t*)((uint32_t)filesys_addr + DENTRY_SIZE + num_entries * DENTRY_SIZE);
+        memcpy(new_dentry, &dentry, DENTRY_SIZE);
+        *filesys_addr = num_entries + 1;
+        fs_disk_mark(filesys_addr);
+    }
+    else if(write_data(dir.inode_num, num_entries * DENTRY_SIZE, (uint8_t*)&dentry, DENTRY_SIZE) != DENTRY_SIZE){
+        restore_flags(flags);
+        return -1;
+    }
+    fs_inode_bitmap[inode / 32] |= 1 << (inode % 32);
+    dentry_index_insert(dir.inode_num, num_entries, &dentry);
+
+    restore_flags(flags);
+    return 0;
+}
+
+/*
+ * fs_flush
+ *   DESCRIPTION: Writes every dirty block in the buffer cache back to the image, then, for a disk mount, every changed
+ *                block of the image to the disk (see fs_disk_write). A task that calls this while another one is in the
+ *                middle of it sleeps until that one is done, then does its own.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of blocks written (to the image and the disk), -1 on failure
+ *   SIDE EFFECTS: see bcache_flush, writes to the disk, may sleep
+ */
+int32_t fs_flush(){
+    int32_t written, disk;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while(fs_flushing)
+        wq_sleep(&fs_flush_wq);
+    fs_flushing = true;
+    written = bcache_flush();
+    restore_flags(flags);
+
+    if(written != -1 && fs_disk != NULL){
+        disk = fs_disk_write();
+        written = (disk == -1) ? -1 : written + disk;
+    }
+
+    cli_and_save(flags);
+    fs_flushing = false;
+    wq_wake_all(&fs_flush_wq);
+    restore_flags(flags);
+    return written;
+}
+
+/*
+ * fs_disk_write
+ *   DESCRIPTION: Writes every changed block of the image to the disk, for fs_flush. Changed blocks go to the disk
+ *                queue, which merges consecutive ones into one write and goes out whenever it fills up (so
+ *                fs_disk_reqs can be reused every BLK_QUEUE_MAX blocks) and at the end. The disk writes happen with
+ *                interrupts on (if they were on), so other tasks run while the disk works. A block's bit is cleared
+ *                when it is queued, so one that changes in the meantime is marked again and goes out next time, and
+ *                one whose write fails is marked again by fs_disk_done.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of blocks written, -1 on failure
+ *   SIDE EFFECTS: writes to the disk, call only with fs_flushing set
+ */
+static int32_t fs_disk_write(){
+    uint32_t flags;
+    uint32_t num_blocks, b, n = 0;
+    blk_request_t* req;
+    blk_stats_t before, after;
+
+    blk_get_stats(&fs_disk_queue, &before);
+    num_blocks = 1 + get_num_inodes() + get_num_data_blocks();
+    for(b = 0; b < num_blocks; b++){
+        cli_and_save(flags);
+        if(!(fs_disk_dirty[b / 32] & (1 << (b % 32)))){
+            restore_flags(flags);
+            continue;
+        }
+        fs_disk_dirty[b / 32] &= ~(1 << (b % 32));
+        restore_flags(flags);
+
+        req = &fs_disk_reqs[n++ % BLK_QUEUE_MAX];
+        req->blk = b;
+        req->count = 1;
+        req->buf = (uint8_t*)filesys_addr + b * BLOCK_SIZE;
+        req->write = true;
+        req->done = fs_disk_done;
+        blk_submit(&fs_disk_queue, req);
+    }
+    blk_unplug(&fs_disk_queue);
+    blk_get_stats(&fs_disk_queue, &after);
+    if(after.errors != before.errors)
+        return -1;
+    return n;
+}
+
+/*
+ * fs_disk_mark
+ *   DESCRIPTION: Notes that the block of the image an address is in changed, so fs_flush writes it to the disk. Does
+ *                nothing unless the filesystem was mounted from a disk.
+ *   INPUTS: addr -- address in the image in RAM
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets the block's bit in fs_disk_dirty
+ */
+static void fs_disk_mark(const void* addr){
+    uint32_t b = ((uint32_t)addr - (uint32_t)filesys_addr) / BLOCK_SIZE;
+
+    if(fs_disk == NULL || b >= FS_MAX_BLOCKS)
+        return;
+    fs_disk_dirty[b / 32] |= 1 << (b % 32);
+}
+
+/*
+ * fs_disk_done
+ *   DESCRIPTION: Completion callback for fs_flush's disk writes, a block whose write failed is marked changed again
+ *   INPUTS: req -- one of fs_disk_reqs
+ *           status -- 0 on success, -1 on failure
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see fs_disk_mark
+ */
+static void fs_disk_done(blk_request_t* req, int32_t status){
+    if(status != 0)
+        fs_disk_mark(req->buf);
+}
+
+/*
+ * fs_block_alloc
+ *   DESCRIPTION: Takes a free data block from the bitmap. The search starts after the last block handed out, so a file
+ *                that is written front to back gets consecutive blocks.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: data block number, -1 if the filesystem is full
+ *   SIDE EFFECTS: marks the block used
+ */
+static int32_t fs_block_alloc(){
+    uint32_t num_blocks = get_num_data_blocks();
+    uint32_t i, b;
+
+    if(num_blocks > FS_MAX_BLOCKS)
+        num_blocks = FS_MAX_BLOCKS;
+    for(i = 0; i < num_blocks; i++){
+        b = (fs_alloc_hint + i) % num_blocks;
+        if(!(fs_block_bitmap[b / 32] & (1 << (b % 32)))){
+            fs_block_bitmap[b / 32] |= 1 << (b % 32);
+            fs_alloc_hint = b + 1;
+            return b;
+        }
+    }
+    return -1;
+}
+
+/*
+ * fs_block_free
+ *   DESCRIPTION: Gives a data block back to the bitmap
+ *   INPUTS: b -- data block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: marks the block free and drops it from the buffer cache
+ */
+void fs_block_free(uint32_t b){
+    if(b >= FS_MAX_BLOCKS)
+        return;
+    fs_block_bitmap[b / 32] &= ~(1 << (b % 32));
+    bcache_forget(data_blk_num(b));
+}
+
+/*
+ * fs_free_blocks
+ *   DESCRIPTION: Counts the free data blocks
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of data blocks no file is using, 0 if the filesystem is read only
+ *   SIDE EFFECTS: none
+ */
+uint32_t fs_free_blocks(){
+    uint32_t num_blocks = get_num_data_blocks();
+    uint32_t b, count = 0;
+
+    if(!fs_writable)
+        return 0;
+    if(num_blocks > FS_MAX_BLOCKS)
+        num_blocks = FS_MAX_BLOCKS;
+    for(b = 0; b < num_blocks; b++){
+        if(!(fs_block_bitmap[b / 32] & (1 << (b % 32))))
+            count++;
+    }
+    return count;
+}
+
+/*
+ * ramdev_read and ramdev_write
+ *   DESCRIPTION: Block device ops for the image in RAM, this is what the buffer cache reads from and writes back to
+ *   INPUTS: blk -- block number from the start of the image
+ *           buf -- BLOCK_SIZE buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the block is past the end of the image
+ *   SIDE EFFECTS: ramdev_write changes the image
+ */
+static int32_t ramdev_read(uint32_t blk, uint8_t* buf){
+    if(blk >= fs_ramdev.nblocks)
+        return -1;
+    memcpy(buf, (uint8_t*)filesys_addr + blk * BLOCK_SIZE, BLOCK_SIZE);
+    return 0;
+}
+/* See above */
+static int32_t ramdev_write(uint32_t blk, const uint8_t* buf){
+    if(blk >= fs_ramdev.nblocks)
+        return -1;
+    memcpy((uint8_t*)filesys_addr + blk * BLOCK_SIZE, buf, BLOCK_SIZE);
+    fs_disk_mark((uint8_t*)filesys_addr + blk * BLOCK_SIZE);
+    return 0;
+}
+
+/* Everything that starts processes needs paging and the scheduler, the host build (FS_HOST) leaves it out */
+#ifndef FS_HOST
 /*
  * file_to_mem
  *   DESCRIPTION: Helper function for system call, 'EXECUTE'
@@ -324,7 +1504,7 @@ int read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
  *          fname --  file name we are trying to read
  *   OUTPUTS: none
  *   RETURN VALUE: return -1 for failure, otherwise return entry point
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: sets up paging and the PCB for the new process, the file itself is paged in lazily
  */ 
 int file_to_mem(uint8_t* addr, char* fname){
     dentry_t temp_dentry;           /* Used to grab the dentry data easily */
@@ -333,27 +1513,39 @@ int file_to_mem(uint8_t* addr, char* fname){
     uint32_t entry;                 /* Address of entry point into new process */
     int process_num;                /* Number of current process (zero indexed) */
     pcb_t * parent_pcb = NULL;             /* Pointer ot PCB of parent process, or what cur_pcb was last time. */
+    exec_image_t* image;            /* Cached copy of the executable, NULL if we have to run it from the file */
 
-    /* Check that the file exists, if it is fill in the temp_dentry, if not return failure */
-    if(read_dentry_by_name((uint8_t*)fname, &temp_dentry) == -1){
+    /* Check that the file exists and is a regular file, if it is fill in the temp_dentry, if not return failure */
+    if(read_dentry_by_name((uint8_t*)fname, &temp_dentry) == -1 || temp_dentry.ftype != 2){
         return -1;
     }
-    /* Get length of file */
+    /* Get length of file, it has to fit below the user stack */
     file_size = get_inode_len(temp_dentry.inode_num);
-
-    /* Read meta data from the file, if 40 bytes is not read return failure */
-    if(read_data(temp_dentry.inode_num, 0, temp_buf, MAX_TEMP_BUF) != MAX_TEMP_BUF){
+    if(file_size > USER_STACK - (uint32_t)addr){
         return -1;
     }
 
-    /* Check if executable, if not return failure */
-    if(temp_buf[0] != EXECUTABLE_FILE_ONE || temp_buf[1] != EXECUTABLE_FILE_TWO || temp_buf[2] != EXECUTABLE_FILE_THREE || temp_buf[3] != EXECUTABLE_FILE_FOUR){
-        return -1;
+    /* Most of the time the image is already cached and checked, so we don't need to look at the file at all */
+    image = exec_cache_get(temp_dentry.inode_num);
+    if(image != NULL){
+        entry = image->entry;
+    }
+    else{
+        /* Read meta data from the file, if 40 bytes is not read return failure */
+        if(read_data(temp_dentry.inode_num, 0, temp_buf, MAX_TEMP_BUF) != MAX_TEMP_BUF){
+            return -1;
+        }
+
+        /* Check if executable, if not return failure */
+        if(exec_check_header(temp_buf, &entry) == -1){
+            return -1;
+        }
     }
 
     /* Set up paging for new process, and get process number, return failure if paging could not be made (may be at max number of processes) */
     process_num = new_process_ptable();
     if(process_num == -1){
+        exec_cache_put(image);
         return -1;
     }
 
@@ -378,16 +1570,16 @@ int file_to_mem(uint8_t* addr, char* fname){
     }
     sti();
     
-    /* Copy the executable into the new user page, if we don't copy the whole file return failure */
-    if(read_data(temp_dentry.inode_num, 0, addr, file_size) != file_size){
-        return -1;
-    }
+    /* Don't copy the executable now, just remember where it goes. Pages are read in from the file by
+     * user_page_fault the first time the program touches them, so a big binary doesn't cost a full copy up front */
+    cur_pcb->exe_inode = temp_dentry.inode_num;
+    cur_pcb->exe_size = file_size;
+    cur_pcb->exe_addr = (uint32_t)addr;
+    cur_pcb->exe_image = image;
 
-    /* Calculate the address of the entry point into the new process, then return that */
-    /* 27,26,25 = byte offset of the file , shifting bits = 27, 26, 25 corresponds to the MSB we intends */
-    entry = (temp_buf[27] << 24) + (temp_buf[26] << 16) + (temp_buf[25] << 8) + (temp_buf[24]);
     return entry;
 }
+#endif /* FS_HOST */
 
 /* Here to make code more readable
 Description: gets and returns the number of directory entries
@@ -423,7 +1615,7 @@ int32_t get_num_data_blocks(){
  */ 
 uint32_t get_data_block(int idxOffset, inode_t* inodeptr){
     uint32_t numinode = get_num_inodes();                       /* Number of inodes */
-    uint32_t dbIndex = inodeptr->data_blocks[idxOffset];        /* The datablock number in the filesystem */
+    uint32_t dbIndex = inode_data_block(inodeptr, idxOffset);   /* The datablock number in the filesystem */
     uint32_t retAddr = (uint32_t)((uint32_t)filesys_addr + BLOCK_SIZE + (numinode * BLOCK_SIZE) + (dbIndex * BLOCK_SIZE));
     return retAddr;
 }
@@ -438,8 +1630,147 @@ uint32_t get_data_block(int idxOffset, inode_t* inodeptr){
  */ 
 uint32_t get_inode_len(int inodeidx){
     inode_t * inodeptr = (inode_t*)((uint32_t)filesys_addr + (inodeidx * BLOCK_SIZE) + BLOCK_SIZE);
+    if(inodeptr->length & INODE_COMPRESSED)
+        return compress_file_size(inodeidx);
     return inodeptr->length;
 }
+
+/* Here to make code more readable
+Description: number of bytes a file has in its data blocks, which for a compressed file is less than its size */
+uint32_t inode_stored_len(inode_t* inodeptr){
+    return inodeptr->length & ~INODE_COMPRESSED;
+}
+
+/* Here to make code more readable
+Description: gets a pointer to an inode, the inodes start right after the boot block */
+inode_t* get_inode(uint32_t inodeidx){
+    return (inode_t*)((uint32_t)filesys_addr + (inodeidx * BLOCK_SIZE) + BLOCK_SIZE);
+}
+
+/* Here to make code more readable
+Description: turns a data block number into a block number from the start of the image
+(what the buffer cache and block devices use), the data blocks start after the boot block and inodes */
+uint32_t data_blk_num(uint32_t data_block){
+    return 1 + get_num_inodes() + data_block;
+}
+
+/* Here to make code more readable
+Description: gets the address of a data block in the image */
+uint8_t* data_blk_addr(uint32_t data_block){
+    return (uint8_t*)filesys_addr + data_blk_num(data_block) * BLOCK_SIZE;
+}
+
+/* Here to make code more readable
+Description: number of blocks a file can have with the current image's inode layout */
+uint32_t inode_max_blocks(){
+    return fs_indirect ? MAX_INODE_BLOCKS_INDIRECT : MAX_INODE_BLOCKS;
+}
+
+/*
+ * inode_data_block
+ *   DESCRIPTION: Finds the data block number of one block of a file, going through the indirect blocks if the image
+ *                has them. Everything that walks a file's blocks goes through here instead of reading data_blocks[].
+ *   INPUTS: inodeptr -- inode of the file
+ *           index -- index of the block in the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: data block number (not checked against the number of data blocks), FS_NO_BLOCK if the index is past
+ *                 what the inode can describe or an indirect block it needs is out of range
+ *   SIDE EFFECTS: none
+ */
+uint32_t inode_data_block(inode_t* inodeptr, uint32_t index){
+    uint32_t* table;
+
+    if(!fs_indirect)
+        return (index < MAX_INODE_BLOCKS) ? inodeptr->data_blocks[index] : FS_NO_BLOCK;
+    if(index < INODE_DIRECT_BLOCKS)
+        return inodeptr->data_blocks[index];
+    index -= INODE_DIRECT_BLOCKS;
+    if(index < BLOCK_PTRS){
+        table = index_block(&inodeptr->data_blocks[INODE_INDIRECT_SLOT], false);
+        return (table != NULL) ? table[index] : FS_NO_BLOCK;
+    }
+    index -= BLOCK_PTRS;
+    if(index >= BLOCK_PTRS * BLOCK_PTRS)
+        return FS_NO_BLOCK;
+    table = index_block(&inodeptr->data_blocks[INODE_DINDIRECT_SLOT], false);
+    if(table == NULL)
+        return FS_NO_BLOCK;
+    table = index_block(&table[index / BLOCK_PTRS], false);
+    return (table != NULL) ? table[index % BLOCK_PTRS] : FS_NO_BLOCK;
+}
+
+/*
+ * index_block
+ *   DESCRIPTION: Gets the indirect block a block number slot points at, optionally giving the slot a new zeroed block
+ *                first. Indirect blocks are file system metadata like the inodes, they are changed in place in the image
+ *                and never go through the buffer cache.
+ *   INPUTS: slot -- inode slot or indirect block entry holding the indirect block's number
+ *           alloc -- take a free block for the slot first
+ *   OUTPUTS: none
+ *   RETURN VALUE: the indirect block's block numbers, NULL if the slot is out of range or no block was free
+ *   SIDE EFFECTS: with alloc, takes a data block and changes the slot
+ */
+static uint32_t* index_block(uint32_t* slot, bool alloc){
+    int32_t b;
+
+    if(alloc){
+        b = fs_block_alloc();
+        if(b == -1)
+            return NULL;
+        memset(data_blk_addr(b), 0, BLOCK_SIZE);
+        *slot = b;
+        fs_disk_mark(data_blk_addr(b));
+        fs_disk_mark(slot);
+    }
+    if(*slot >= get_num_data_blocks())
+        return NULL;
+    return (uint32_t*)data_blk_addr(*slot);
+}
+
+/*
+ * inode_set_block
+ *   DESCRIPTION: Records the data block number of one block of a file, the write side of inode_data_block. Files only
+ *                grow a block at a time, so an indirect block is taken when the first block behind it is set.
+ *   INPUTS: inodeptr -- inode of the file
+ *           index -- index of the block in the file
+ *           data_block -- data block number to put there
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the index is past what the inode can describe or no block was free for an
+ *                 indirect block
+ *   SIDE EFFECTS: changes the inode or an indirect block, may take data blocks for indirect blocks
+ */
+static int32_t inode_set_block(inode_t* inodeptr, uint32_t index, uint32_t data_block){
+    uint32_t* table;
+
+    if(index < (fs_indirect ? INODE_DIRECT_BLOCKS : MAX_INODE_BLOCKS)){
+        inodeptr->data_blocks[index] = data_block;
+        fs_disk_mark(inodeptr);
+        return 0;
+    }
+    if(!fs_indirect)
+        return -1;
+    index -= INODE_DIRECT_BLOCKS;
+    if(index < BLOCK_PTRS){
+        table = index_block(&inodeptr->data_blocks[INODE_INDIRECT_SLOT], index == 0);
+        if(table == NULL)
+            return -1;
+        table[index] = data_block;
+        fs_disk_mark(&table[index]);
+        return 0;
+    }
+    index -= BLOCK_PTRS;
+    if(index >= BLOCK_PTRS * BLOCK_PTRS)
+        return -1;
+    table = index_block(&inodeptr->data_blocks[INODE_DINDIRECT_SLOT], index == 0);
+    if(table == NULL)
+        return -1;
+    table = index_block(&table[index / BLOCK_PTRS], index % BLOCK_PTRS == 0);
+    if(table == NULL)
+        return -1;
+    table[index % BLOCK_PTRS] = data_block;
+    fs_disk_mark(&table[index % BLOCK_PTRS]);
+    return 0;
+}
 /**
  * @brief Get a pointer to a file descriptor for the current task
  * 
@@ -469,6 +1800,7 @@ filedesc_t * get_free_fd(int * fdnum)
     return syscall_getfdptr(fd);
 }
 
+#ifndef FS_HOST
 /* Parse input string
 Will support multiple words, but will ignore
 after the first for this checkpoint (no get args) */
@@ -477,7 +1809,7 @@ void parse_exec(char* string, char* filename, char* argstr){
     int j;          /* Holds old i for indexing purposes */
 
     /* Grab the file name (like ls)*/
-    while(string[i] != 0x20 && string[i] != '\0' && i < MAX_FNAME_SIZE){ // 0x20 -> magic number for space
+    while(string[i] != 0x20 && string[i] != '\0' && i < MAX_PATH_SIZE){ // 0x20 -> magic number for space
         filename[i] = string[i];
         i++;
     }
@@ -513,12 +1845,13 @@ void parse_exec(char* string, char* filename, char* argstr){
 int execute(char* strname){
     uint32_t temp_esp;              /* Temp variable to hold esp when execute starts */
     uint32_t temp_ebp;              /* Temp variable to hold ebp when execute starts */
-    char fname[MAX_FNAME_SIZE];     /* Name of the file we are trying to execute */
+    char fname[MAX_PATH_SIZE + 1];  /* Path of the file we are trying to execute */
     char argstr[128];               /* The arguments that go along with that file, 128 because that is max kbdr buffer size */
     uint32_t entry_addr;            /* The address of the entry point into the new process */
     int32_t parent;                /* pid of the parent to give to the child */
-    task_t temp_cur;                /* Task struct for temporarily holding the task in task_queue[0] */
-    task_t temp_next;               /* Task struct for temporarily holding the task that will be created from execute */
+    int i;                          /* Loop counter */
+    task_t* parent_task = cur_task; /* Task that is running now, NULL for the first shell */
+    task_t* new_task;               /* Task for the process execute creates */
 
     /* Save esp */
     asm volatile (
@@ -538,16 +1871,13 @@ int execute(char* strname){
     parse_exec(strname, fname, argstr);
 
     // For giving to the child, the first 3 shells won't have parents
-    if(cur_pcb == NULL || task_queue[2].pcb == NULL){
+    if(cur_pcb == NULL || task_count() < BOOT_SHELLS){
         parent = -1;
     }
     else{
         parent = cur_pcb->pid;
     }
 
-    // Save temp current task
-    temp_cur = task_queue[0];
-
     /* Checks if file is executeable, if it is makes new paging data for it, updates pcb, copies file to memory */
     cli();
     entry_addr = file_to_mem((uint8_t*)LOAD_LOC, fname);
@@ -570,39 +1900,35 @@ int execute(char* strname){
     strcpy(cur_pcb->args, argstr);
     /* Make sure the vidmap check is initially off! */
     cur_pcb->vidmap_check = false;
+    /* No files mapped yet */
+    for(i = 0; i < MAX_MMAPS; i++){
+        cur_pcb->mmaps[i].pages = 0;
+    }
+    /* No syscall ring until the program sets one up */
+    cur_pcb->ring = NULL;
     // Set to the correct parent for cp5
     cur_pcb->parent_pid = parent;
     /* Set the return value for the pcb to be return in execute */
     /* Give control to child */
     cur_pcb->ret_addr = entry_addr;
 
-    // If the parent pid is -1 don't sleep parent, otherwise sleep parent
-    if(cur_pcb == NULL || cur_pcb->parent_pid != -1){ // irrelevant for NULL, just don't want page faults
-        temp_cur.enabled = false;
+    // The new process gets its task and becomes the running one
+    new_task = &tasks[(int32_t)cur_pcb->pid];
+    new_task->pcb = cur_pcb;
+    new_task->state = 1;
+    new_task->enabled = true;
+    new_task->waiting = false;
+    new_task->boost = false;
+    new_task->woken_at = 0;
+    new_task->ticks_left = sched_quantum[SCHED_CLASS_FG];
+    new_task->list = NULL;
+    // If the parent pid is -1 don't sleep parent, otherwise sleep parent. It goes on the run queue or the sleep list.
+    if(parent_task != NULL){
+        if(cur_pcb->parent_pid != -1)
+            parent_task->enabled = false;
+        task_requeue(parent_task);
     }
-
-    // Set temp next task, safe from interrupts???
-    // Will we need to protect everywhere with cur_pcb??? Probably
-    //cli();
-    temp_next.pcb = cur_pcb;
-    temp_next.state = 1;
-    temp_next.enabled = true;
-    // temp_next.esp/ebp = esp/ebp
-    /*
-    asm volatile (
-        "movl %%ebp, %%eax      ;"
-        "movl %%esp, %%ebx      ;"
-        : "=a" (temp_next.ebp), "=b" (temp_next.esp)
-        :
-        : "memory"//"eax", "ebx"
-    );
-    */
-    // "Push" the newly executed process, the current one
-    //task_push(&temp_next);
-    if(cur_pcb->pid != 0){
-        task_push(&temp_cur);
-    }
-    task_queue[0] = temp_next; // We have the new exec take priority over other tasks, shouldn't make a difference
+    cur_task = new_task;
     //sti();
     // I'm pretty sure everything from the file to mem call to tss.esp0 being set need to be in a critical section, but for now not doing it
 
@@ -656,10 +1982,12 @@ int execute(char* strname){
  */  
 int halt(){
     int i;      /* Loop Counter */
-    task_t temp;
 
     //cli(); //?
 
+    /* Unmap any files the program left mapped, the first shell restarting below needs this too */
+    mmap_clear();
+
     /* If this is the first shell halting is not allowed! */
     if(cur_pcb->parent_pid == -1 || cur_pcb->pid == 0){
         console_clrsc();
@@ -700,6 +2028,11 @@ int halt(){
     /* Clear the user video memory mapping */
     vmem_table2.pte[0] = 0;
     cur_pcb->vidmap_check = false;
+    /* Stop draining the ring at PIT ticks, it goes away with the user page */
+    cur_pcb->ring = NULL;
+    /* Nothing runs from this image any more */
+    exec_cache_put(cur_pcb->exe_image);
+    cur_pcb->exe_image = NULL;
     /* Return control back to parent! */
 
     /* Switch to parent's paging structure (and flush TLB) */
@@ -711,14 +2044,15 @@ int halt(){
     /* Set tss esp0 to be parent's kernel stack */
     tss.esp0 = ((uint32_t)cur_pcb) + KB_8 - STACK_OFF;
 
-    // Get the halted process out of the queue, then bring the parent to the front of the queue
+    // Free the halted process' task, then make the parent the running task again (off the sleep list)
     // More locking than this??
     cli();
-    temp.pcb = cur_pcb; // This works because we only check pcb for queue matches
-    task_grab(&temp);
-    task_pop(&temp); // get parent out of the queue so we don't have duplicates
-    task_queue[0] = temp; // Now make the parent the active task 
-    task_queue[0].enabled = true; // make the parent runnable again
+    cur_task->pcb = NULL;
+    cur_task = &tasks[(int32_t)cur_pcb->pid];
+    task_list_remove(cur_task);
+    cur_task->state = 1;
+    cur_task->enabled = true; // make the parent runnable again
+    cur_task->waiting = false;
 
     sti(); // ??
 
@@ -736,3 +2070,4 @@ int halt(){
     /* How'd you get here? */
     return -1;
 }
+#endif /* FS_HOST */
@@ -4,6 +4,7 @@
 #include "types.h"
 #include "syscall.h"
 #include "console.h"
+#include "bcache.h"
 
 /* MAGIC NUMBERS FOR file_to_mem  */
 /* Magic numbers for executable check */
@@ -12,6 +13,43 @@
 #define EXECUTABLE_FILE_THREE 0x4C
 #define EXECUTABLE_FILE_FOUR  0x46
 
+/* Dentry name index over every directory, must be a power of 2 and at least twice DENTRY_INDEX_MAX so probes stay short */
+#define DENTRY_HASH_SIZE      8192
+#define DENTRY_INDEX_MAX      4096  /* Entries past this aren't indexed, lookups that miss scan the directory */
+#define DENTRY_HASH_EMPTY     0xFFFFFFFF
+#define FNV_OFFSET_BASIS      0x811C9DC5
+#define FNV_PRIME             0x01000193
+
+/* Directories. The root's entries are in the boot block. A subdirectory is a dentry with ftype 1 whose inode holds
+ * the subdirectory's dentries back to back (so it can span any number of blocks). "." and ".." aren't stored, paths
+ * handle them. Inode 0 is never a subdirectory, ftype 1 with inode 0 (the root's "." entry) is the root itself. */
+#define FS_ROOT_DIR           0     /* Directory number of the root, subdirectories are numbered by their inode */
+#define FS_MAX_INODES         4096  /* Inodes past this are never used for files */
+#define FS_MAX_DEPTH          16    /* Most directories deep a path can go */
+
+/* Writable mode */
+#define MAX_INODE_BLOCKS      1023  /* Data block numbers an inode can hold in a flat (version 0) image */
+
+/* Multi-level inodes. A boot block whose version word (in the reserved bytes after the counts, 0 in images from the
+ * old createfs) says FS_VERSION_INDIRECT uses the last two block numbers of every inode for an indirect block (a data
+ * block full of data block numbers) and a double indirect block (a data block full of indirect block numbers). */
+#define FS_VERSION_OFFSET     12    /* Byte offset of the version word in the boot block */
+#define FS_VERSION_FLAT       0
+#define FS_VERSION_INDIRECT   2
+#define INODE_DIRECT_BLOCKS   1021  /* Block numbers held right in the inode in an indirect image */
+#define INODE_INDIRECT_SLOT   1021  /* data_blocks[] slot with the indirect block */
+#define INODE_DINDIRECT_SLOT  1022  /* data_blocks[] slot with the double indirect block */
+#define BLOCK_PTRS            (BLOCK_SIZE / 4)  /* Block numbers in one indirect block */
+#define MAX_INODE_BLOCKS_INDIRECT (INODE_DIRECT_BLOCKS + BLOCK_PTRS + BLOCK_PTRS * BLOCK_PTRS)
+#define FS_NO_BLOCK           0xFFFFFFFF
+
+/* Set in an inode's length when the file is stored compressed, see compress.h. The rest of the length is what is in
+ * the data blocks. A flat inode can't hold a file anywhere near 2 GB, so older images never have it set. */
+#define INODE_COMPRESSED      0x80000000
+
+/* Streaming reads, most blocks file_read looks ahead through when a file is read front to back */
+#define STREAM_RA_BLOCKS      8
+
 /* Number of bytes of meta data in files */
 #define MAX_TEMP_BUF          40
 /* Contants of hex values of memory sizes, used for accessing different virtual memory addresses */
@@ -29,6 +67,8 @@ extern pcb_t* cur_pcb;
 
 /* File and directory operations, see their function headers for details */
 void init_dir(uint32_t* addr);
+void fs_mount(uint32_t* addr, uint32_t size);
+int32_t fs_mount_dev(blkdev_t* dev);
 int file_open(const uint8_t* fname);
 int dir_open(const uint8_t* dirname);
 int file_close(int fd);
@@ -37,8 +77,33 @@ int file_write(int fd, const void * buf, int nbytes);
 int dir_write(int fd, const void * buf, int nbytes);
 int file_read(int fd, void* buf, int32_t nbytes);
 int dir_read(int fd, void* buf, int32_t nbytes);
+int32_t dir_getdents(int32_t fd, void* buf, int32_t nbytes);
 int file_to_mem(uint8_t* addr, char* fname);
 int read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
+int read_dentry_by_name_scan(const uint8_t* fname, dentry_t* dentry);
+int read_dentry_by_index(uint32_t idx, dentry_t* dentry);
+int32_t get_num_dir_entries();
+int32_t get_num_inodes();
+int32_t get_num_data_blocks();
+int read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+int read_stored(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+uint32_t get_data_block(int idxOffset, inode_t* inodeptr);
+uint32_t get_inode_len(int inodeidx);
+inode_t* get_inode(uint32_t inodeidx);
+uint32_t inode_stored_len(inode_t* inodeptr);
+uint32_t data_blk_num(uint32_t data_block);
+uint8_t* data_blk_addr(uint32_t data_block);
+uint32_t inode_data_block(inode_t* inodeptr, uint32_t index);
+uint32_t inode_max_blocks();
+int write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+int32_t fs_create(const uint8_t* fname);
+int32_t fs_mkdir(const uint8_t* dirname);
+bool fs_inode_used(uint32_t inode);
+int32_t dir_num_entries(uint32_t dir);
+int32_t dir_entry(uint32_t dir, uint32_t idx, dentry_t* dentry);
+int32_t fs_flush();
+void fs_block_free(uint32_t b);
+uint32_t fs_free_blocks();
 extern filedesc_t * syscall_getfdptr(uint32_t fd);
 extern file_optbl_t stdio_optbl;
 filedesc_t * get_free_fd(int * fdnum);
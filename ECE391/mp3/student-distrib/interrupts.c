@@ -4,6 +4,7 @@
  */
 
 #include "interrupts.h"
+#include "paging.h"
 
 /* Write some exception handlers.
  * Right now, these don't even read their error codes.
@@ -69,19 +70,22 @@ DECLARE_ISR(gp_exception)
 	while(1);
 }
 
-DECLARE_ISR(page_fault)
+DECLARE_ISR_ERRCODE(page_fault)
 {
-	int addr;
-	cli();
+	uint32_t addr;
 
-	printf("PAGE FAULT!\n");
 	asm volatile (
-		"mov %%cr2, %%eax                       ;"
+		"movl %%cr2, %0                       ;"
 		: "=r" (addr)
-		:  
-		: "eax"                 
-	); 
-	printf("Page fault line: %x\n", addr);
+	);
+
+	/* Faults in a process' user region may just mean the page hasn't been loaded yet, or is a shared page being written */
+	if(user_page_fault(addr, error_code) == 0)
+		return;
+
+	cli();
+	printf("PAGE FAULT!\n");
+	printf("Page fault line: %x, error code: %x\n", addr, error_code);
 	while(1);
 }
 
@@ -57,6 +57,35 @@ asm (									\
 	"iret");							\
 void isr_name##_handler(void)
 
+/* DECLARE_ISR_ERRCODE is the same thing for exceptions where the CPU pushes an
+ * error code before the return address (e.g. page faults).  The wrapper hands
+ * the error code to the handler as its argument and pops it back off before
+ * the iret, so the handler is allowed to return and restart the instruction.
+ * HOW TO USE:
+ *		```
+ *		DECLARE_ISR_ERRCODE(my_isr_name)
+ *		{
+ *			... error_code is in scope here ...
+ *		}
+ *		```
+ */
+#define DECLARE_ISR_ERRCODE(isr_name)		\
+extern void isr_name(void);				\
+void isr_name##_handler(uint32_t error_code);	\
+asm (									\
+	".global "#isr_name"\n"				\
+	".align 4\n"							\
+	#isr_name":\n\t"					\
+	"pusha\n\t"							\
+	"cld\n\t"							\
+	"pushl 32(%esp)\n\t"				\
+	"call " #isr_name "_handler \n\t"	\
+	"addl $4, %esp\n\t"				\
+	"popa\n\t"							\
+	"addl $4, %esp\n\t"				\
+	"iret");							\
+void isr_name##_handler(uint32_t error_code)
+
 /* Exception handlers */
 void divide_exception(void);
 void nmi_handler(void);
@@ -16,6 +16,8 @@
 #include "console.h"
 #include "syscall.h"
 #include "scheduling.h"
+#include "execcache.h"
+#include "ata.h"
 
 #define RUN_TESTS
 
@@ -28,6 +30,8 @@
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    uint32_t mount_start;
+    int fs_mounted = 0;
 
     /* Clear the screen. */
     clear();
@@ -62,7 +66,10 @@ void entry(unsigned long magic, unsigned long addr) {
         module_t* mod = (module_t*)mbi->mods_addr;
         while (mod_count < mbi->mods_count) {
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
-            init_dir((uint32_t*)mod->mod_start); // This is fine because only 1 module is being loaded (cp2)
+            mount_start = rdtsc();
+            fs_mount((uint32_t*)mod->mod_start, mod->mod_end - mod->mod_start); // This is fine because only 1 module is being loaded (cp2)
+            printf("Module %d is %d KB, mounted in %u cycles\n", mod_count, (mod->mod_end - mod->mod_start) / 1024, rdtsc() - mount_start);
+            fs_mounted = 1;
             printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
             printf("First few bytes of module:\n");
             for (i = 0; i < 16; i++) {
@@ -154,17 +161,29 @@ void entry(unsigned long magic, unsigned long addr) {
     init_idt();
     init_rtc();
     keyboard_init();
+    /* The filesystem disk, if there is one, is the slave on the primary channel (GRUB's disk is the master) */
+    if (ata_init(ATA_DRIVE_SLAVE) == 0)
+        printf("ATA disk: %u KB, %s\n", ata_num_sectors() / 2, (ata_get_mode() == ATA_MODE_DMA) ? "DMA" : "PIO");
 
     cur_pcb = NULL; // Need to ensure pcb starts as NULL for pit interrupts creating the first 3 shells
 
     /* Initialize paging */
     init_paging();
+    exec_cache_init();
     /* Enable interrupts */
     /* Do not enable the following until after you have set up your
      * IDT correctly otherwise QEMU will triple fault and simple close
      * without showing you any output */
     printf("Enabling Interrupts\n");
     sti();
+    /* No filesystem module, mount the disk instead. Its reads wait for IRQ 14, so interrupts have to be on. */
+    if (!fs_mounted && ata_num_sectors() > 0) {
+        mount_start = rdtsc();
+        if (fs_mount_dev(&ata_blkdev) == 0)
+            printf("Disk mounted in %u cycles\n", rdtsc() - mount_start);
+        else
+            printf("No filesystem image on the disk\n");
+    }
     /* Enable the console driver */
     vterm_init();
     vterm_new(1);
@@ -82,6 +82,20 @@ static inline uint32_t inl(int port) {
     return val;
 }
 
+/* Reads the low 32 bits of the time stamp counter.
+ * Callers only ever take the difference of two nearby reads (a tick, a
+ * system call, a wakeup), which unsigned subtraction gets right even
+ * across the low 32 bits wrapping */
+static inline uint32_t rdtsc(void) {
+    uint32_t val;
+    asm volatile ("rdtsc"
+            : "=a"(val)
+            :
+            : "edx"
+    );
+    return val;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
@@ -105,13 +119,31 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
     );                                  \
 } while (0)
 
+/* Writes a model specific register (the high 32 bits are always 0 here) */
+#define wrmsr(msr, val)                 \
+do {                                    \
+    asm volatile ("wrmsr"               \
+            :                           \
+            : "c"(msr), "a"(val), "d"(0)\
+            : "memory"                  \
+    );                                  \
+} while (0)
+
+#ifdef FS_HOST
+/* The host build of the filesystem code (see ../fsbench) runs as a single threaded Linux program,
+ * there are no interrupts to turn off and it isn't allowed to touch the interrupt flag anyway */
+#define cli()                   do { } while (0)
+#define cli_and_save(flags)     do { (flags) = 0; } while (0)
+#define sti()                   do { } while (0)
+#define restore_flags(flags)    do { (void)(flags); } while (0)
+#else
 /* Clear interrupt flag - disables interrupts on this processor */
 #define cli()                           \
 do {                                    \
@@ -162,6 +194,7 @@ do {                                    \
             : "memory", "cc"            \
     );                                  \
 } while (0)
+#endif /* FS_HOST */
 
 /* IO wait.
  * Apparently you can make use of another IO on an unused port
@@ -1,5 +1,12 @@
 #include "types.h"
 #include "paging.h"
+#include "lib.h"
+#include "execcache.h"
+#include "bcache.h"
+
+static void user_ptable_clear(int pid);
+static uint32_t user_private_frame(int pid, uint32_t idx);
+static void user_map_private(uint32_t idx);
 
 
 /*
@@ -46,6 +53,17 @@ void init_paging(){
         }
 
     }
+    /* Make the user page tables, each process' user region maps onto its own 4 MB physical slot starting at 8 MB */
+    for(j = 0; j < MAX_PROCESS; j++){
+        user_ptable_clear(j);
+    }
+    /* Nothing is mapped in the mmap regions yet */
+    for(j = 0; j < MAX_PROCESS; j++){
+        for(i = 0; i < TBL_SIZE; i++){
+            mmap_ptable[j].pte[i] = 0;
+        }
+    }
+
     /* Make all page directories for processes */
     for(j = 0; j < MAX_PROCESS; j++){
         for(i = 0; i < TBL_SIZE; i++){
@@ -65,10 +83,21 @@ void init_paging(){
                 process_pdir_table[j].pde[i] = addr + VMEMPD_BITS;
             }
             else if(i == USER_IDX){
-                addr = MB_8 + (j * 0x400000); //0x400000 -> 4MB because that is the size of a jumbo page, each user process starts at 8mb and after in physcial mem
+                addr = (unsigned int) &(user_ptable[j]);
                 addr &= ADDR_MASK;
                 process_pdir_table[j].pde[i] = addr + USER_BITS;
             }
+            else if(i == MMAP_IDX){
+                addr = (unsigned int) &(mmap_ptable[j]);
+                addr &= ADDR_MASK;
+                process_pdir_table[j].pde[i] = addr + MMAP_PDE_BITS;
+            }
+            else if(i == EXEC_CACHE_IDX){
+                process_pdir_table[j].pde[i] = EXEC_CACHE_LOC + EXEC_CACHE_BITS;
+            }
+            else if(i >= (FS_RAM_LOC >> PDE_SHIFT) && i < ((FS_RAM_LOC + FS_RAM_SIZE) >> PDE_SHIFT)){
+                process_pdir_table[j].pde[i] = (i << PDE_SHIFT) + FS_RAM_BITS;
+            }
             else
                 process_pdir_table[j].pde[i] = 0;
         }
@@ -83,6 +112,10 @@ void init_paging(){
     for(i = 2; i < DIR_SIZE; i++){
         page_dir.pde[i] = 0x0;
     }
+    page_dir.pde[EXEC_CACHE_IDX] = EXEC_CACHE_LOC + EXEC_CACHE_BITS;
+    for(i = (FS_RAM_LOC >> PDE_SHIFT); i < ((FS_RAM_LOC + FS_RAM_SIZE) >> PDE_SHIFT); i++){
+        page_dir.pde[i] = (i << PDE_SHIFT) + FS_RAM_BITS;
+    }
 
     /* Load base address of pd into pdbr (cr3) */
     pd_addr = (unsigned int) page_dir.pde;
@@ -97,13 +130,14 @@ void init_paging(){
         : "eax"                 
     );
 
-    /* Turn paging on */
+    /* Turn paging on, with write protect so kernel writes into shared user pages fault and get copied too */
     asm volatile (
         "mov %%cr0, %%eax                                               ;"
         "orl $0x80000000, %%eax /* Sets PG Flag to enable paging */     ;"
+        "orl %%edx, %%eax       /* Sets WP Flag */                      ;"
         "mov %%eax, %%cr0                                               ;"
         : 
-        : 
+        : "d" (CR0_WP)
         : "eax"                                    
     );  
 }
@@ -125,6 +159,7 @@ int new_process_ptable(){
     for(i = 0; i < MAX_PROCESS; i ++){
         if(!(process_pdir_table[i].pde[USER_IDX] & 0x1)){
             process_pdir_table[i].pde[USER_IDX] |= 0x1;
+            user_ptable_clear(i);
 
             /* Reload CR3 to flush the TLB */
             pd_addr = (uint32_t) process_pdir_table[i].pde;
@@ -226,3 +261,252 @@ void* baby_malloc(){
 
     return NULL;
 }
+
+/*
+ * user_ptable_clear
+ *   DESCRIPTION: Point every page in a process' user region back at its own private frame and mark it not present,
+ *                so a new program faults its pages in instead of seeing whatever the last process in this slot left behind
+ *   INPUTS: pid -- process number whose user page table we clear
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: modifies paging structures, caller must flush the TLB (new_process_ptable reloads CR3 after this)
+ */
+static void user_ptable_clear(int pid){
+    int i;
+
+    for(i = 0; i < TBL_SIZE; i++){
+        user_ptable[pid].pte[i] = user_private_frame(pid, i) + USER_PTE_BITS;
+    }
+}
+
+/*
+ * user_private_frame
+ *   DESCRIPTION: Physical address of the frame backing one page of a process' user region when the page is private
+ *   INPUTS: pid -- process number
+ *           idx -- index of the page in the user page table
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, inside the process' 4 MB slot starting at 8 MB
+ *   SIDE EFFECTS: none
+ */
+static uint32_t user_private_frame(int pid, uint32_t idx){
+    return MB_8 + (pid * USER_PAGE_SIZE) + (idx * PAGE_SIZE);
+}
+
+/*
+ * user_map_private
+ *   DESCRIPTION: Map one page of the current process' user region onto its private frame, writable
+ *   INPUTS: idx -- index of the page in the user page table
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: modifies paging structures, flushes the page's TLB entry
+ */
+static void user_map_private(uint32_t idx){
+    uint32_t page = USER_LOC + (idx * PAGE_SIZE);
+
+    user_ptable[(int)cur_pcb->pid].pte[idx] = user_private_frame(cur_pcb->pid, idx) + USER_PRIV_BITS;
+    asm volatile (
+        "invlpg (%0)                            ;"
+        :
+        : "r" (page)
+        : "memory"
+    );
+}
+
+/*
+ * user_page_fault
+ *   DESCRIPTION: Demand paging and copy on write for the user region.
+ *                When a process first touches a page in its 4 MB user region we load it. Pages that lie entirely inside
+ *                an executable image held in the exec cache are mapped read only straight onto the cache's frame, so every
+ *                process running that program shares them (all of the text, and data that is never written). Everything
+ *                else gets the process' own frame: the part that overlaps the program image is copied in, the rest
+ *                (bss, heap, stack) starts out zeroed.
+ *                When a process (or the kernel on its behalf) writes to a shared page, the page is copied into the
+ *                process' own frame and made writable.
+ *   INPUTS: addr -- faulting linear address (from CR2)
+ *           error_code -- error code the CPU pushed for the fault
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the page was loaded and the faulting instruction can be restarted, -1 if this is a real fault
+ *   SIDE EFFECTS: modifies paging structures, fills the new page
+ */
+int user_page_fault(uint32_t addr, uint32_t error_code){
+    uint32_t idx;           /* Index of the faulting page in the user page table */
+    uint32_t pte;           /* Current page table entry for the faulting page */
+    uint32_t page;          /* Linear address of the start of the faulting page */
+    uint32_t fill_start;    /* Linear address where the program image starts within this page */
+    uint32_t fill_end;      /* Linear address where the program image ends within this page */
+    exec_image_t* image;
+
+    /* Only faults in a running process' user region are ours */
+    if(cur_pcb == NULL || addr < USER_LOC || addr >= USER_LOC + USER_PAGE_SIZE)
+        return -1;
+    idx = (addr - USER_LOC) / PAGE_SIZE;
+    pte = user_ptable[(int)cur_pcb->pid].pte[idx];
+    page = addr & ADDR_MASK;
+    image = cur_pcb->exe_image;
+
+    if(error_code & PF_PRESENT){
+        /* Copy on write, the shared frame is identity mapped so we can copy from it after moving the page */
+        if(!(error_code & PF_WRITE) || !(pte & PAGE_PRESENT) || (pte & PAGE_RW))
+            return -1;
+        user_map_private(idx);
+        memcpy((void*)page, (void*)(pte & ADDR_MASK), PAGE_SIZE);
+        return 0;
+    }
+    if(pte & PAGE_PRESENT)
+        return -1;
+
+    fill_start = (page > cur_pcb->exe_addr) ? page : cur_pcb->exe_addr;
+    fill_end = cur_pcb->exe_addr + cur_pcb->exe_size;
+    if(fill_end > page + PAGE_SIZE)
+        fill_end = page + PAGE_SIZE;
+
+    /* Whole page is in the cached image, share it unless this first touch is already a write */
+    if(image != NULL && fill_start == page && fill_end == page + PAGE_SIZE && !(error_code & PF_WRITE)){
+        user_ptable[(int)cur_pcb->pid].pte[idx] = (uint32_t)(image->base + (page - cur_pcb->exe_addr)) + USER_SHARED_BITS;
+        return 0;
+    }
+
+    /* Otherwise map the private frame first so we can fill it through its user address */
+    user_map_private(idx);
+    memset((void*)page, 0, PAGE_SIZE);
+
+    /* Copy in whatever part of the executable lands in this page, straight from the exec cache if we have it there */
+    if(fill_start < fill_end){
+        if(image != NULL)
+            memcpy((void*)fill_start, image->base + (fill_start - cur_pcb->exe_addr), fill_end - fill_start);
+        else if(read_data(cur_pcb->exe_inode, fill_start - cur_pcb->exe_addr, (uint8_t*)fill_start, fill_end - fill_start) != fill_end - fill_start)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * mmap_file
+ *   DESCRIPTION: Maps a whole file read only into the current process' mmap region, so it can be read in place instead
+ *                of copied out with read(). Every page of the mapping is one of the file's data blocks in the image, which
+ *                only works because blocks are page sized and the image is page aligned. Dirty blocks in the buffer
+ *                cache are written back into the image first (not out to a disk, that is left to sync), so the mapping
+ *                starts out showing the file as it is now; later writes through the cache show up once they are
+ *                written back, and the mapping doesn't grow with the file.
+ *   INPUTS: inode -- inode of the file to map
+ *           start -- filled in with the address the file starts at (NULL for an empty file)
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the file in bytes, -1 if it can't be mapped (no free mmap slot, no room left in the
+ *                 region, bad inode, compressed file since its blocks don't hold the file as it reads)
+ *   SIDE EFFECTS: modifies paging structures, flushes the buffer cache
+ */
+int32_t mmap_file(uint32_t inode, uint8_t** start){
+    mmap_area_t* area = NULL;       /* Free slot in the PCB for this mapping */
+    page_table_t* table;            /* Current process' mmap page table */
+    inode_t* inodeptr;
+    uint32_t len, pages;            /* Length of the file in bytes and in pages */
+    uint32_t idx, run;              /* Search for a run of free pages */
+    uint32_t i;
+    uint32_t flags;
+    int32_t written;
+
+    if(cur_pcb == NULL || start == NULL || inode >= get_num_inodes() || ((uint32_t)data_blk_addr(0) & ~ADDR_MASK))
+        return -1;
+    inodeptr = get_inode(inode);
+    len = inodeptr->length;
+    if(len & INODE_COMPRESSED)
+        return -1;
+    pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    if(pages == 0){
+        *start = NULL;
+        return 0;
+    }
+    if(pages > TBL_SIZE)
+        return -1;
+    for(i = 0; i < pages; i++){
+        if(inode_data_block(inodeptr, i) >= get_num_data_blocks())
+            return -1;
+    }
+    for(i = 0; i < MAX_MMAPS; i++){
+        if(cur_pcb->mmaps[i].pages == 0){
+            area = &cur_pcb->mmaps[i];
+            break;
+        }
+    }
+    if(area == NULL)
+        return -1;
+
+    /* First run of free pages that is long enough */
+    table = &mmap_ptable[(int)cur_pcb->pid];
+    run = 0;
+    for(idx = 0; idx < TBL_SIZE && run < pages; idx++){
+        run = (table->pte[idx] & PAGE_PRESENT) ? 0 : run + 1;
+    }
+    if(run < pages)
+        return -1;
+    idx -= pages;
+
+    /* Only the image in RAM has to be up to date for the mapping, writing it out to a disk is up to sync */
+    cli_and_save(flags);
+    written = bcache_flush();
+    restore_flags(flags);
+    if(written == -1)
+        return -1;
+    /* The pages were not present, so there is nothing in the TLB to flush */
+    for(i = 0; i < pages; i++){
+        table->pte[idx + i] = (uint32_t)data_blk_addr(inode_data_block(inodeptr, i)) + MMAP_PTE_BITS;
+    }
+    area->idx = idx;
+    area->pages = pages;
+    *start = (uint8_t*)(MMAP_LOC + (idx * PAGE_SIZE));
+    return len;
+}
+
+/*
+ * mmap_unmap
+ *   DESCRIPTION: Takes a file mapped by mmap_file out of the current process' mmap region
+ *   INPUTS: start -- address mmap_file returned for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if nothing was mapped there
+ *   SIDE EFFECTS: modifies paging structures, flushes the unmapped pages' TLB entries
+ */
+int32_t mmap_unmap(uint8_t* start){
+    uint32_t page;
+    uint32_t i, j;
+
+    if(cur_pcb == NULL)
+        return -1;
+    for(i = 0; i < MAX_MMAPS; i++){
+        if(cur_pcb->mmaps[i].pages != 0 && (uint32_t)start == MMAP_LOC + (cur_pcb->mmaps[i].idx * PAGE_SIZE))
+            break;
+    }
+    if(i == MAX_MMAPS)
+        return -1;
+
+    for(j = cur_pcb->mmaps[i].idx; j < cur_pcb->mmaps[i].idx + cur_pcb->mmaps[i].pages; j++){
+        mmap_ptable[(int)cur_pcb->pid].pte[j] = 0;
+        page = MMAP_LOC + (j * PAGE_SIZE);
+        asm volatile (
+            "invlpg (%0)                            ;"
+            :
+            : "r" (page)
+            : "memory"
+        );
+    }
+    cur_pcb->mmaps[i].pages = 0;
+    return 0;
+}
+
+/*
+ * mmap_clear
+ *   DESCRIPTION: Unmaps every file the current process still has mapped, called from halt
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: see mmap_unmap
+ */
+void mmap_clear(){
+    int i;
+
+    if(cur_pcb == NULL)
+        return;
+    for(i = 0; i < MAX_MMAPS; i++){
+        if(cur_pcb->mmaps[i].pages != 0)
+            mmap_unmap((uint8_t*)(MMAP_LOC + (cur_pcb->mmaps[i].idx * PAGE_SIZE)));
+    }
+}
@@ -14,9 +14,28 @@
 #define VMEMPT_BITS 0x0107          /* Data bits for vmem PTE */
 #define VMEMPD_BITS 0x7             /* Data bits for vmem PDE */
 #define OFF_PG_BITS 0x6             /* Data bits for non-present PTEs */
-#define USER_BITS   0x96            /* Data bits for user PDE */
+#define USER_BITS   0x6             /* Data bits for user PDE, points at the process' 4 KB user page table */
+#define USER_PTE_BITS 0x6           /* Data bits for user PTEs, left not present until the page is first touched */
+#define USER_PRIV_BITS 0x7          /* Data bits for a present private user page (user, r/w) */
+#define USER_SHARED_BITS 0x5        /* Data bits for a present user page shared from the exec cache (user, read only) */
 #define USER_IDX    32              /* Index into PD to get to the user page location (128 MB) */
-#define MAX_PROCESS 6               /* Max number of processes running */
+#define USER_PAGE_SIZE 0x400000     /* Size of the user region each process gets (and of its physical slot) */
+#define PAGE_SIZE   0x1000          /* Size of a regular 4 KB page */
+#define PDE_SHIFT   22              /* Shift from a linear address to its page directory index (log2 of 4 MB) */
+#define PAGE_PRESENT 0x1            /* Present bit in a PDE/PTE */
+#define PAGE_RW     0x2             /* Read/write bit in a PDE/PTE */
+#define PF_PRESENT  0x1             /* Page fault error code bit: set if the fault was a protection violation */
+#define PF_WRITE    0x2             /* Page fault error code bit: set if the fault was a write */
+#define CR0_WP      0x00010000      /* CR0 write protect, makes the kernel respect read only user pages too */
+#define MAX_PROCESS 8               /* Max number of processes running */
+#define FS_RAM_LOC  (MB_8 + ((MAX_PROCESS + 1) * USER_PAGE_SIZE))   /* Physical (and linear) addr of the writable copy of the filesystem, after the exec cache */
+#define FS_RAM_SIZE 0x1000000       /* Size of the writable filesystem region (16 MB) */
+#define FS_RAM_BITS 0x083           /* Data bits for the filesystem region PDEs: present, r/w, supervisor, 4 MB */
+#define FS_MAX_BLOCKS (FS_RAM_SIZE / BLOCK_SIZE)    /* Most blocks a mounted filesystem can have */
+#define MMAP_IDX    33              /* Index into PD of the 4 MB region mmap puts files in (132 MB, right after the user page) */
+#define MMAP_LOC    (MMAP_IDX << PDE_SHIFT)     /* Virtual/linear mem address of the mmap region */
+#define MMAP_PDE_BITS 0x7           /* Data bits for the mmap region PDE (user, r/w), the PTEs make the pages read only */
+#define MMAP_PTE_BITS 0x5           /* Data bits for a mapped file page (user, read only) */
 
 /* Structure for Page Directories */
 typedef struct page_dir_t {
@@ -38,6 +57,13 @@ page_table_t vmem_table2 __attribute__((aligned (1024*4)));
 /* Table of page tables for user processes (up to 8), aligned to 4kB */
 page_dir_t process_pdir_table[MAX_PROCESS] __attribute__((aligned (1024*4)));
 
+/* 4 KB page tables for each process' user region (128 MB - 132 MB), aligned to 4kB.
+ * Each one maps onto that process' 4 MB physical slot, but pages are only marked present on first touch */
+page_table_t user_ptable[MAX_PROCESS] __attribute__((aligned (1024*4)));
+
+/* 4 KB page tables for each process' mmap region, a page is present only while a file block is mapped there */
+page_table_t mmap_ptable[MAX_PROCESS] __attribute__((aligned (1024*4)));
+
 /* Function that initializes paging, the kernel page, and the pages for the first 4 MB, see function header for details */
 void init_paging();
 
@@ -46,5 +72,13 @@ int new_process_ptable();
 void return_parent_paging();
 int swap_task_paging(int8_t target_pid);
 
+/* Demand paging and copy on write for the user region, called from the page fault handler */
+int user_page_fault(uint32_t addr, uint32_t error_code);
+
+/* Map files read only into the current process' mmap region, and take them out again */
+int32_t mmap_file(uint32_t inode, uint8_t** start);
+int32_t mmap_unmap(uint8_t* start);
+void mmap_clear();
+
 
 #endif
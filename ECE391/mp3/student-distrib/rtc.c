@@ -14,6 +14,11 @@
 #include "lib.h"
 #include "i8259.h"
 #include "interrupts.h"
+#include "wait.h"
+
+volatile uint32_t rtc_ticks = 0;
+/* Tasks sleeping in rtc_read */
+static wait_queue_t rtc_wq;
 
 /*
  * init_rtc
@@ -61,8 +66,9 @@ DECLARE_ISR(rtc_interrupt) {
     /* make sure we have to acknowledge that our interrupt is done by doing this */
     send_eoi(RTC_IRQ_NUMBER);
     
-    /* clear the rtc_interupt_flag */
-    rtc_interrupt_flag = 0;
+    /* count the tick and wake up whoever is waiting for it in rtc_read */
+    rtc_ticks++;
+    wq_wake_all(&rtc_wq);
 
     /* critical section ended*/
     sti();
@@ -107,15 +113,14 @@ int32_t rtc_close (int32_t fd){
  *   INPUTS: fd-- file descripter, buf -- pointer to the the buffer, nbytes -- number of bytes to be written 
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on sucess
- *   SIDE EFFECTS: sets interrupt flag to 0 and interrupt hanlder clears it after interrupt is handled        
+ *   SIDE EFFECTS: sleeps on the RTC wait queue until the interrupt handler counts a tick and wakes it
  */  
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes){
-    rtc_interrupt_flag = 1; // lock taken. just think as "toilet" spin lock
-    
-    while(rtc_interrupt_flag){        
-    
-    }
-    
+    uint32_t start = rtc_ticks;
+
+    /* sleep (other tasks get the CPU) until the next interrupt */
+    wait_event(&rtc_wq, rtc_ticks != start);
+
     return 0;
 }
 
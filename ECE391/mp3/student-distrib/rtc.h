@@ -58,8 +58,8 @@ void init_rtc(void);
 void rtc_interrupt(void);
 void rtc_interrupt_handler(void);
 
-/* MP3.2 simple volatile flag used in tc_read to prevent any ohter interrupts happen during it */
-volatile int rtc_interrupt_flag;
+/* Interrupts so far, rtc_read sleeps until this changes */
+extern volatile uint32_t rtc_ticks;
 
 /* MP3.2 RTC basic file system functions*/
 int32_t rtc_open (const uint8_t* filename); 
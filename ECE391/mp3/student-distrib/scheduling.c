@@ -1,4 +1,13 @@
 #include "scheduling.h"
+
+task_t tasks[MAX_PROCESS];      // Indexed by pid
+task_t* cur_task = NULL;        // Task that is running, on neither list
+run_queue_t run_queue;
+task_list_t sleep_list;
+sched_stats_t sched_stats;
+uint32_t sched_quantum[SCHED_CLASSES] = {1, 3, 1};  // PIT ticks per quantum, by class (see sched_set_quantum)
+static bool sched_yielding = false;     // Set by wq_sleep around its int $0x20, so the handler knows it isn't a tick
+
 // TODO: add check somewhere for writitng to not actual video memory for not focused tasks
 
 
@@ -6,23 +15,30 @@
  *  Declares interrupt service routine for PIT
  */
 DECLARE_ISR(pit_interrupt){
-    task_t temp; // temporarily hold current task struct to pop then push
+    task_t* next;   // task to switch to
+    void* ebp;
+    void* esp;
+    uint32_t start = rdtsc();
+    bool yield = sched_yielding;    // wq_sleep giving up the CPU, not the PIT
 
     // Save current context (regs, eip, ebp, esp) already pushed by isr...
-    //task_queue[0].ebp = ebp;
-    //task_queue[0].esp = esp;
     asm volatile (
         "movl %%ebp, %%eax      ;"
         "movl %%esp, %%ebx      ;"
-        : "=a" (task_queue[0].ebp), "=b" (task_queue[0].esp)
+        : "=a" (ebp), "=b" (esp)
         :
         : "memory"//"eax", "ebx"
     );
-    task_queue[0].state = 0; // set to no longer running
+    sched_yielding = false;
+    if(cur_task != NULL){
+        cur_task->ebp = ebp;
+        cur_task->esp = esp;
+        cur_task->state = 0; // set to no longer running
+    }
 
     // If we haven't made a shell yet, execute one! (do this 3 times)
     static int con_idx = 0;
-    if(cur_pcb == NULL || task_queue[2].pcb == NULL){
+    if(cur_pcb == NULL || task_count() < BOOT_SHELLS){
         send_eoi(PIT_INT_NUM); // Make sure we say the interrupt is done
         sti(); // We want interrupts to actually come in after this execute, they won't because the interrupt won't ret
         //if (!con_ovr.flag) {
@@ -34,41 +50,50 @@ DECLARE_ISR(pit_interrupt){
         goto end_of_interrupt; // Not needed? will the above execute be ok never getting to the end?
     }
 
+    // Run what the program left in its syscall ring, if the tick came in user mode (not in the middle of a system call)
+    if(cur_pcb->ring != NULL && (((uint32_t*)__builtin_frame_address(0))[ISR_FRAME_CS] & USER_RPL) == USER_RPL){
+        ring_drain(1);
+    }
 
-    //push the current process to the end of the queue
-    //pop, then push until we get a runnable task
-    temp = task_queue[0];
-    do
-    {
-        task_pop(&temp); // Should we error check?
-        task_push(&temp);
-        temp = task_queue[0];
-    } while (temp.enabled == false);
-    
+    // A yield doesn't use up any of the quantum
+    next = sched_next(!yield);
+    // Switch paging structure, flush tlb. If it fails don't actually go to next task
+    if(next != NULL && swap_task_paging(next->pcb->pid) == -1){
+        runq_add(next);
+        task_list_remove(cur_task);
+        next = NULL;
+    }
 
-    // Set the new process state to running (1?)
-    task_queue[0].state = 1;
+    if(next != NULL){
+        cur_task = next;
 
-    //restore tss (we only change esp0?)
-    tss.esp0 = ((uint32_t)task_queue[0].pcb) + KB_8 - STACK_OFF;
+        //restore tss (we only change esp0?)
+        tss.esp0 = ((uint32_t)cur_task->pcb) + KB_8 - STACK_OFF;
 
-    // Switch paging structure, flush tlb. If it fails don't actually go to next task
-    if(swap_task_paging(task_queue[0].pcb->pid) == -1){
-        goto end_of_interrupt;
+        // Set the taskt to the current process
+        cur_pcb = cur_task->pcb;
+    }
+    // Set the new process state to running (1?)
+    cur_task->state = 1;
+    if(yield){
+        sched_stats.yields++;
+    } else {
+        sched_stats.ticks++;
+        sched_stats.cycles += rdtsc() - start;
     }
 
-    // Set the taskt to the current process
-    cur_pcb = task_queue[0].pcb;
-    // May not be needed because piazza post is saying by restoring next tasks esp, ebp then we can iret just like that
-    // So for now we'll just restore esp and ebp
-    asm volatile (
-        "popl %%ecx             ;" // DOES NOTHING, REMOVE
-        "movl %%eax, %%esp      ;"
-        "movl %%ebx, %%ebp      ;"
-        :
-        : "eax" (task_queue[0].esp), "ebx" (task_queue[0].ebp) //task_queue[0].esp, task_queue[0].ebp <- 0 is placeholder for compilation
-        : "ecx"  // We want ebp,esp to stay so do we not put that here right?? idk, using ecx to pop eip off from call within interrupt wrapper
-    );
+    if(next != NULL){
+        // May not be needed because piazza post is saying by restoring next tasks esp, ebp then we can iret just like that
+        // So for now we'll just restore esp and ebp
+        asm volatile (
+            "popl %%ecx             ;" // DOES NOTHING, REMOVE
+            "movl %%eax, %%esp      ;"
+            "movl %%ebx, %%ebp      ;"
+            :
+            : "eax" (cur_task->esp), "ebx" (cur_task->ebp)
+            : "ecx"  // We want ebp,esp to stay so do we not put that here right?? idk, using ecx to pop eip off from call within interrupt wrapper
+        );
+    }
 
     // Signal that we are done with the interrupt
 end_of_interrupt:
@@ -97,11 +122,20 @@ int32_t init_schedule(void){
     // Register in idt
     load_int(PIT_INT_NUM, &pit_interrupt, KERNEL_SEGMENT, INTERRUPT_DPL);
 
-    //Initialize task queue (empty)
+    //Initialize the task slots (all free) and the empty lists
     for(i = 0; i < MAX_PROCESS; i++){
-        task_queue[i].pcb = NULL; // All we need to signify it is empty
-        task_queue[i].enabled = true;
+        tasks[i].pcb = NULL; // All we need to signify it is free
+        tasks[i].list = NULL;
+    }
+    for(i = 0; i < 2 * SCHED_CLASSES; i++){
+        run_queue.lists[i / SCHED_CLASSES][i % SCHED_CLASSES].head = NULL;
+        run_queue.lists[i / SCHED_CLASSES][i % SCHED_CLASSES].tail = NULL;
+        run_queue.lists[i / SCHED_CLASSES][i % SCHED_CLASSES].count = 0;
     }
+    run_queue.active = 0;
+    sleep_list.head = sleep_list.tail = NULL;
+    sleep_list.count = 0;
+    cur_task = NULL;
 
     // Enable the PIT irq line again
     enable_irq(PIT_INT_NUM);
@@ -110,87 +144,331 @@ int32_t init_schedule(void){
 }
 
 /*
- * int32_t task_push
- *   DESCRIPTION: Helper function that pushes a specified task to the task queue
- *   INPUTS: current_task -- pointer to the current task struct
+ * task_t* sched_next
+ *   DESCRIPTION: The scheduler's decision, for the PIT handler. The running task keeps going until its quantum is used
+ *                up, unless it went to sleep or the keyboard woke a task. Otherwise it goes back on the run queue (its
+ *                boost is over), or to the sleep list if it went to sleep, and the next task comes off the run queue.
+ *                The requeue comes before the pick so a task that used up its quantum waits for the next round even if
+ *                the pick starts a new one.
+ *   INPUTS: tick -- a PIT tick, which uses up one tick of the running task's quantum (a yield from wq_sleep doesn't)
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, -1 on failure 
- *   SIDE EFFECTS: task gets pushed onto task queue
+ *   RETURN VALUE: the task to switch to, taken off the run queue, NULL to stay on the running task (nothing else can
+ *                 run, and if it is waiting wq_sleep idles it with hlt until a wakeup)
+ *   SIDE EFFECTS: the running task is on no list when this returns NULL, and on the list for its state otherwise
  */
-int32_t task_push(task_t* current_task){
-    int i;  // Loop counter
+task_t* sched_next(bool tick){
+    task_t* next;
 
-    // Make sure parameter is valid
-    if(current_task == NULL){
-        return -1;
+    if(tick && cur_task->ticks_left > 0)
+        cur_task->ticks_left--;
+    if(cur_task->enabled && !cur_task->waiting && cur_task->ticks_left > 0 &&
+       run_queue.lists[run_queue.active][SCHED_CLASS_BOOST].head == NULL)
+        return NULL;
+
+    cur_task->boost = false;
+    task_requeue(cur_task);
+    next = runq_pick();
+    if(next == cur_task || next == NULL){
+        task_list_remove(cur_task);
+        return NULL;
     }
+    return next;
+}
 
-    // Place at the end of the queue
-    // Assuming pcb == NULL if no task there
-    for(i = 0; i < MAX_PROCESS; i++){
-        if(task_queue[i].pcb == NULL){
-            task_queue[i] = *current_task; // Assumining this current task has all members initialized
-            break;
+/*
+ * void task_list_push
+ *   DESCRIPTION: Adds a task at the tail of a list, O(1)
+ *   INPUTS: list -- run queue or sleep list
+ *           task -- task that is on no list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links the task in
+ */
+void task_list_push(task_list_t* list, task_t* task){
+    task->list = list;
+    task->next = NULL;
+    task->prev = list->tail;
+    if(list->tail != NULL)
+        list->tail->next = task;
+    else
+        list->head = task;
+    list->tail = task;
+    list->count++;
+}
+
+/*
+ * task_t* task_list_pop
+ *   DESCRIPTION: Takes the task at the head of a list off it, O(1)
+ *   INPUTS: list -- run queue or sleep list
+ *   OUTPUTS: none
+ *   RETURN VALUE: the task, NULL if the list is empty
+ *   SIDE EFFECTS: unlinks the task
+ */
+task_t* task_list_pop(task_list_t* list){
+    task_t* task = list->head;
+
+    if(task != NULL)
+        task_list_remove(task);
+    return task;
+}
+
+/*
+ * void task_list_remove
+ *   DESCRIPTION: Takes a task off whatever list it is on, O(1)
+ *   INPUTS: task -- task to unlink, nothing happens if it is on no list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: unlinks the task
+ */
+void task_list_remove(task_t* task){
+    task_list_t* list = task->list;
+
+    if(list == NULL)
+        return;
+    if(task->prev != NULL)
+        task->prev->next = task->next;
+    else
+        list->head = task->next;
+    if(task->next != NULL)
+        task->next->prev = task->prev;
+    else
+        list->tail = task->prev;
+    list->count--;
+    task->list = NULL;
+    task->prev = task->next = NULL;
+}
+
+/*
+ * void task_requeue
+ *   DESCRIPTION: Puts a task that is on no list (one that was running) on the list for its state: the run queue if it
+ *                can run, the sleep list if it is disabled or waiting
+ *   INPUTS: task -- the task
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links the task in
+ */
+void task_requeue(task_t* task){
+    if(task->enabled && !task->waiting)
+        runq_add(task);
+    else
+        task_list_push(&sleep_list, task);
+}
+
+/*
+ * void runq_add
+ *   DESCRIPTION: Puts a runnable task at the tail of its class' list on the run queue. The class is picked here:
+ *                boosted, on the terminal that is on screen, or background. A task with quantum left this round goes
+ *                in the active set, one that used it up gets a new quantum and goes in the other set, to wait for
+ *                the next round. A boosted task always goes in the active set.
+ *   INPUTS: task -- task that is on no list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links the task in
+ */
+void runq_add(task_t* task){
+    uint32_t set = run_queue.active;
+
+    if(task->boost)
+        task->prio = SCHED_CLASS_BOOST;
+    else if(current_console != NULL && task->pcb->con == current_console->id)
+        task->prio = SCHED_CLASS_FG;
+    else
+        task->prio = SCHED_CLASS_BG;
+    if(task->ticks_left == 0){
+        task->ticks_left = sched_quantum[task->prio];
+        if(!task->boost)
+            set ^= 1;
+    }
+    task_list_push(&run_queue.lists[set][task->prio], task);
+}
+
+/*
+ * task_t* runq_pick
+ *   DESCRIPTION: Takes the next task to run off the run queue: the head of the highest class in the active set. If
+ *                the active set is empty every runnable task has had its quantum, so the sets swap and a new round
+ *                starts.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the task, NULL if the run queue is empty
+ *   SIDE EFFECTS: unlinks the task
+ */
+task_t* runq_pick(void){
+    task_t* task;
+    uint32_t round, cls;
+
+    for(round = 0; round < 2; round++){
+        for(cls = 0; cls < SCHED_CLASSES; cls++){
+            task = task_list_pop(&run_queue.lists[run_queue.active][cls]);
+            if(task != NULL)
+                return task;
         }
+        run_queue.active ^= 1;
     }
+    return NULL;
+}
+
+/*
+ * uint32_t runq_count
+ *   DESCRIPTION: Counts the tasks on the run queue, in both sets
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of tasks waiting to run
+ *   SIDE EFFECTS: none
+ */
+uint32_t runq_count(void){
+    uint32_t cls, count = 0;
 
-    // Return Success
+    for(cls = 0; cls < SCHED_CLASSES; cls++)
+        count += run_queue.lists[0][cls].count + run_queue.lists[1][cls].count;
+    return count;
+}
+
+/*
+ * int32_t sched_set_quantum
+ *   DESCRIPTION: Sets how many PIT ticks a class' tasks run for before the next task gets a turn. Changing the
+ *                foreground and background quanta changes how the CPU is split between them. Programs get here
+ *                through sysstats (SYSSTATS_QUANTUM, `sysstat quantum`).
+ *   INPUTS: cls -- SCHED_CLASS_
+ *           ticks -- quantum, at least 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on a bad class or quantum
+ *   SIDE EFFECTS: tasks already queued keep what they have left
+ */
+int32_t sched_set_quantum(uint32_t cls, uint32_t ticks){
+    if(cls >= SCHED_CLASSES || ticks == 0)
+        return -1;
+    sched_quantum[cls] = ticks;
     return 0;
 }
 
 /*
- * int32_t task_pop
- *   DESCRIPTION: helper funcion that pops a specified task struct out of the task_queue
- *   INPUTS: current_task -- pointer to the current task struct
+ * void task_set_state
+ *   DESCRIPTION: Changes whether a task is enabled and waiting, moving it between the run queue and the sleep list
+ *                to match. The running task only gets its flags changed, it goes on a list when it is switched out.
+ *   INPUTS: task -- the task
+ *           enabled -- new enabled flag
+ *           waiting -- new waiting flag
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, -1 on failure 
- *   SIDE EFFECTS: Task gets pulled out of the task_queue after calling task_dequeue
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts off
  */
-int32_t task_pop(task_t* current_task){
-    int i;  // Loop counter
+void task_set_state(task_t* task, bool enabled, bool waiting){
+    task->enabled = enabled;
+    task->waiting = waiting;
+    if(task == cur_task)
+        return;
+    task_list_remove(task);
+    task_requeue(task);
+}
 
-    // Make sure parameter is valid
-    if(current_task == NULL){
-        return -1;
-    }
+/*
+ * task_t* task_find
+ *   DESCRIPTION: Finds the task of a process
+ *   INPUTS: pid -- process number
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the task, NULL if the process has no task
+ *   SIDE EFFECTS: none
+ */
+task_t* task_find(int32_t pid){
+    if(pid < 0 || pid >= MAX_PROCESS || tasks[pid].pcb == NULL)
+        return NULL;
+    return &tasks[pid];
+}
 
-    // Check to see if the task is already in the queue
-    for(i = 0; i < MAX_PROCESS; i++){
-        // Remove the current task from the queue, then shift everything over
-        if(task_queue[i].pcb == current_task->pcb){
-            //task_queue[i].pcb = NULL;   // Assuming everything else will be overwritten when a new task is put into the queue
-            for(i = i; i < MAX_PROCESS - 1; i++){
-                task_queue[i] = task_queue[i+1]; // Shifts everything over one
-            }
-            task_queue[MAX_PROCESS - 1].pcb = NULL; // makes the last task in the queue empty
-            return 0;
+/*
+ * bool task_any_runnable
+ *   DESCRIPTION: Checks whether the scheduler has anything to run
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: true if the run queue isn't empty or the running task can keep running
+ *   SIDE EFFECTS: none
+ */
+bool task_any_runnable(void){
+    return runq_count() != 0 || (cur_task != NULL && cur_task->enabled && !cur_task->waiting);
+}
+
+/*
+ * uint32_t task_count
+ *   DESCRIPTION: Counts the tasks, running, runnable and asleep
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of tasks
+ *   SIDE EFFECTS: none
+ */
+uint32_t task_count(void){
+    return runq_count() + sleep_list.count + (cur_task != NULL);
+}
+
+/*
+ * void wq_sleep
+ *   DESCRIPTION: Puts the current task to sleep on a wait queue and lets another task run (a software PIT interrupt,
+ *                so the switch is the same one the timer makes, marked with sched_yielding so it isn't counted or
+ *                charged to the quantum as a tick). If no task can run the scheduler comes straight
+ *                back, and we idle with hlt, yielding again as soon as an interrupt makes some other task runnable.
+ *                With no task to put to sleep (booting, running the tests) we hlt until the next interrupt.
+ *   INPUTS: wq -- queue to sleep on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: call with interrupts off, returns with them off once woken (the caller rechecks its condition)
+ */
+void wq_sleep(wait_queue_t* wq){
+    task_t* task = (cur_pcb == NULL) ? NULL : task_find(cur_pcb->pid);
+
+    if(task == NULL){
+        /* sti only takes effect after the next instruction, so the interrupt can't come in before the hlt */
+        asm volatile("sti; hlt; cli" : : : "memory");
+        return;
+    }
+    wq->pids |= 1 << cur_pcb->pid;
+    task_set_state(task, task->enabled, true);
+    sched_yielding = true;
+    asm volatile("int %0" : : "i"(PIT_INT_NUM) : "memory");
+    while((task = task_find(cur_pcb->pid)) != NULL && task->waiting){
+        if(task_any_runnable()){
+            sched_yielding = true;
+            asm volatile("int %0" : : "i"(PIT_INT_NUM) : "memory");
+        } else {
+            asm volatile("sti; hlt; cli" : : : "memory");
         }
     }
-
-    // If we never found the task in the queue then we can't pop it
-    return -1;
+    /* Running again after a keyboard wakeup: count how long that took */
+    if(task != NULL && task->woken_at != 0){
+        uint32_t cycles = rdtsc() - task->woken_at;
+        sched_stats.wakeups++;
+        sched_stats.wake_cycles += cycles;
+        if(cycles > sched_stats.wake_max)
+            sched_stats.wake_max = cycles;
+        task->woken_at = 0;
+    }
 }
 
 /*
- * int32_t task_grab
- *   DESCRIPTION: Grabs task from queue
- *   INPUTS: current_task -- pointer to the current task struct that will be filled
+ * void wq_wake_all
+ *   DESCRIPTION: Wakes every task sleeping on a wait queue, for interrupt handlers. They run again when the scheduler
+ *                gets to them, right away if the queue boosts them (a task woken by the keyboard runs at the next
+ *                tick, ahead of everything else, for one quantum).
+ *   INPUTS: wq -- queue to wake
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Sets current_task's stack pointers to task struct with
- *   matching pcb and changes state to 1
+ *   SIDE EFFECTS: empties the queue
  */
-// No error checking because this has a very specific use, so invalid inputs won't happen
-void task_grab(task_t* current_task){
-    int i;
+void wq_wake_all(wait_queue_t* wq){
+    task_t* task;
+    int8_t pid;
 
-    for(i = 0; i < MAX_PROCESS; i++){
-        if(task_queue[i].pcb == current_task->pcb){
-            current_task->ebp = task_queue[i].ebp;
-            current_task->esp = task_queue[i].esp;
-            current_task->state = 1;
-            return;
+    for(pid = 0; wq->pids != 0 && pid < MAX_PROCESS; pid++){
+        if(!(wq->pids & (1 << pid)))
+            continue;
+        wq->pids &= ~(1 << pid);
+        task = task_find(pid);
+        if(task == NULL)
+            continue;
+        if(wq->boost && task != cur_task){
+            /* Queued in the boost class, with a fresh boost quantum */
+            task->boost = true;
+            task->ticks_left = 0;
+            task->woken_at = rdtsc();
         }
+        task_set_state(task, task->enabled, false);
     }
-    current_task->pcb = NULL; // avoids needing a ret val
 }
@@ -8,6 +8,9 @@
  *		First written.
  */
 
+#ifndef _SCHEDULING_H
+#define _SCHEDULING_H
+
 #include "types.h"
 #include "syscall.h"
 #include "filesys.h"
@@ -15,44 +18,105 @@
 #include "x86_desc.h"
 #include "lib.h"
 #include "interrupts.h"
+#include "wait.h"
 
 #define TASK_SUCCESS            0
 #define TASK_FAIL              -1
-#define QUEUE_SIZE	            16
+#define BOOT_SHELLS				3		// The PIT handler starts shells until there are this many tasks
 
 #define PIT_DATA_REG			0x40
 #define PIT_CMD_REG				0x43
 #define PIT_CLOCK				1193180	// Hz
 #define QUANTUM_RATE			2		// hz 20 normally, making it big for testing
 #define PIT_CMD_DATA			0x34	// Fields of the reg are listed below
+#define ISR_FRAME_CS			11		// Interrupted CS, in words above an ISR handler's ebp (saved ebp, return address,
+										// the 8 registers pusha saved, eip)
+#define USER_RPL				3
+
+/* Priority classes, lower runs first */
+#define SCHED_CLASSES			3
+#define SCHED_CLASS_BOOST		0		// Just woken up by a line from the keyboard, for one quantum
+#define SCHED_CLASS_FG			1		// Reads and writes the terminal that is on screen
+#define SCHED_CLASS_BG			2		// Everything else
 /*	7  6  5 4  3 2 1  0 
 	cntr  rw   mode   bcd 
 	0 0	  11   010	  0
 */
 
 
-/* basic task struct */
+/* basic task struct, one per process (tasks[pid]) */
 typedef struct task{
 	void* esp;
 	void* ebp;
     int8_t state;
 	uint32_t terminal_num;
 	bool enabled;			/* If a shell spawns a child we don't want that shell getting cpu time, false=asleep */
-    pcb_t* pcb;
+	bool waiting;			/* Sleeping on a wait queue, not runnable until an interrupt handler wakes it */
+    pcb_t* pcb;				/* NULL if the slot is free */
+	uint8_t prio;			/* SCHED_CLASS_ the task was last queued in */
+	bool boost;				/* Woken by the keyboard, queue it in SCHED_CLASS_BOOST until it next gets switched out */
+	uint32_t ticks_left;	/* PIT ticks left of its quantum this round */
+	uint32_t woken_at;		/* TSC when the keyboard woke it, 0 once it has run again */
+	struct task_list* list;	/* Run queue or sleep list the task is on, NULL while it is running */
+	struct task* prev;		/* Links in that list */
+	struct task* next;
 } task_t;
 
+/* Intrusive doubly linked list of tasks */
+typedef struct task_list{
+	task_t* head;
+	task_t* tail;
+	uint32_t count;
+} task_list_t;
+
+/* Runnable tasks wait their turn on the run queue, tasks that are disabled or waiting are kept on the sleep list.
+ * The run queue has two sets of lists, one per class in each: the active set holds tasks that still have some of
+ * their quantum left this round, the highest class that isn't empty goes first, and a task that uses up its quantum
+ * goes to the other set. When the active set is empty the sets swap and a new round starts, so every runnable task
+ * gets a quantum each round and a busy task on the visible terminal can't keep the background ones off the CPU. */
+typedef struct run_queue{
+	task_list_t lists[2][SCHED_CLASSES];
+	uint32_t active;		/* Index of the active set */
+} run_queue_t;
+
+/* Scheduler cost (PIT ticks and the cycles from the handler's entry to the stack switch, summed over them), how
+ * long tasks woken by the keyboard wait to run, and how often tasks gave up the CPU to sleep */
+typedef struct sched_stats{
+	uint32_t ticks;
+	uint32_t cycles;
+	uint32_t wakeups;		/* Keyboard wakeups */
+	uint32_t wake_cycles;	/* Sum over them of the cycles from the wakeup to the task running */
+	uint32_t wake_max;
+	uint32_t yields;		/* Switches wq_sleep made, which aren't ticks */
+} sched_stats_t;
+
 
 /* Basic task/scheduling function prototypes */
 int32_t init_schedule(void);
 int32_t task_schedule(int32_t ebp, int32_t esp);
 int32_t switch_context_task(int32_t ebp, int32_t esp);
 int32_t clear_struct(task_t* current_task);
+task_t* sched_next(bool tick);
 
-int32_t task_push(task_t* current_task);
-int32_t task_pop(task_t* current_task);
-//int32_t task_front(task_t** element);
-
-void task_grab(task_t* current_task);
+void task_list_push(task_list_t* list, task_t* task);
+task_t* task_list_pop(task_list_t* list);
+void task_list_remove(task_t* task);
+void task_requeue(task_t* task);
+void runq_add(task_t* task);
+task_t* runq_pick(void);
+uint32_t runq_count(void);
+int32_t sched_set_quantum(uint32_t cls, uint32_t ticks);
+void task_set_state(task_t* task, bool enabled, bool waiting);
+task_t* task_find(int32_t pid);
+bool task_any_runnable(void);
+uint32_t task_count(void);
 
-task_t task_queue[QUEUE_SIZE];
+extern task_t tasks[MAX_PROCESS];
+extern task_t* cur_task;
+extern run_queue_t run_queue;
+extern uint32_t sched_quantum[SCHED_CLASSES];
+extern task_list_t sleep_list;
+extern sched_stats_t sched_stats;
 extern volatile int terminal_schedule;
+
+#endif
@@ -10,13 +10,25 @@
 #include "filesys.h"
 #include "pcb.h"
 #include "paging.h"
+#include "x86_desc.h"
+#include "lib.h"
+#include "scheduling.h"
 #ifndef NO_SYSCALL
 
 /* MP3.4 added by MJ, current pcb initialization */
 pcb_t* current_pcb; 
 
 /// Jump table for system call functions.  Put in pointers.
-void * syscall_jumptbl[16] = {0x0};
+void * syscall_jumptbl[NUM_SYSCALLS] = {0x0};
+
+/// Call counts and latency histograms, see sysstats
+syscall_stats_t syscall_stats;
+/// Nonzero while the entry code fills in syscall_stats
+uint32_t syscall_stats_on = 0;
+
+/// Turns a number from a #define into a string for the asm below
+#define SYSCALL_STR_(x) #x
+#define SYSCALL_STR(x) SYSCALL_STR_(x)
 
 /* These following variables are the operations tables for the 3
  * kinds of file: regular, terminal/character, or RTC.
@@ -76,7 +88,7 @@ asm (
     "cld\n\t"
     "cmpl $0, %eax\n\t"
     "jle invalid_syscall\n\t"
-    "cmpl $10, %eax\n\t"
+    "cmpl $" SYSCALL_STR(NUM_SYSCALLS) " - 1, %eax\n\t" // Highest entry in syscall_jumptbl
     "jg invalid_syscall\n\t"
     "movl syscall_jumptbl(, %eax, 4), %edi\n\t"
     "cmpl $0, %edi\n\t"
@@ -84,6 +96,16 @@ asm (
     "push %edx\n\t"
     "push %ecx\n\t"
     "push %ebx\n\t"
+    "cmpl $0, syscall_stats_on\n\t"
+    "je syscall_direct\n\t"
+    "incl syscall_stats(, %eax, 4)\n\t" // syscall_stats.calls[eax]
+    "cmpl $" SYSCALL_STR(SYS_EXECUTE_NUM) ", %eax\n\t" // Execute has to be called from this depth, see exec_ret
+    "je syscall_direct\n\t"
+    "pushl %eax\n\t"
+    "call syscall_timed\n\t"
+    "addl $16, %esp\n\t"
+    "jmp cleanup\n"
+    "syscall_direct:\n\t"
     "call *syscall_jumptbl(, %eax, 4)\n\t"
     // "popl %eax\n\t" // Pop the return value into EAX.
     "addl $12, %esp\n\t"
@@ -103,20 +125,112 @@ asm (
     "iret\n"
 );
 
+/**
+ * The SYSENTER path. User code puts the call number in eax and the arguments
+ * in ebx, esi and edi (SYSENTER itself uses ecx and edx: the user stub passes
+ * its stack pointer in ecx and the address to come back to in edx, and
+ * SYSEXIT takes them from there). SYSENTER doesn't switch stacks through the
+ * TSS the way INT does, so MSR_SYSENTER_ESP points at tss.esp0 and the first
+ * thing we do is load the process's kernel stack from it. It also clears IF,
+ * nothing can interrupt us before that.
+ * Execute can't come in this way: halt goes back to the parent through the
+ * frame syscall_handler leaves on the kernel stack (see exec_ret), so it is
+ * refused here and the user stub for it keeps using INT 0x80.
+ */
+asm (
+    ".global sysenter_handler\n"
+    ".align 4\n"
+    "sysenter_handler:\n\t"
+    "movl (%esp), %esp\n\t"
+    "pushl %ecx\n\t" // User stack and return address, for SYSEXIT
+    "pushl %edx\n\t"
+    "sti\n\t"
+    "cld\n\t"
+    "cmpl $" SYSCALL_STR(NUM_SYSCALLS) ", %eax\n\t" // Unsigned, so this catches negative numbers too
+    "jae sysenter_invalid\n\t"
+    "cmpl $" SYSCALL_STR(SYS_EXECUTE_NUM) ", %eax\n\t"
+    "je sysenter_invalid\n\t"
+    "movl syscall_jumptbl(, %eax, 4), %ecx\n\t" // ecx is saved on the stack already
+    "testl %ecx, %ecx\n\t"
+    "jz sysenter_invalid\n\t"
+    "pushl %edi\n\t"
+    "pushl %esi\n\t"
+    "pushl %ebx\n\t"
+    "cmpl $0, syscall_stats_on\n\t"
+    "jne sysenter_timed\n\t"
+    "call *%ecx\n\t"
+    "addl $12, %esp\n\t"
+    "jmp sysenter_exit\n"
+    "sysenter_timed:\n\t"
+    "incl syscall_stats(, %eax, 4)\n\t"
+    "pushl %eax\n\t"
+    "call syscall_timed\n\t"
+    "addl $16, %esp\n\t"
+    "jmp sysenter_exit\n"
+    "sysenter_invalid:\n\t"
+    "movl $-1, %eax\n"
+    "sysenter_exit:\n\t"
+    "cli\n\t"
+    "popl %edx\n\t"
+    "popl %ecx\n\t"
+    "sti\n\t" // Takes effect after SYSEXIT, so we are in user mode before an interrupt can come in
+    "sysexit\n"
+);
+
+/**
+ * @brief Make a system call and put how long it took in its histogram.
+ * The entry code calls this instead of the jump table entry while
+ * syscall_stats_on is set.
+ * 
+ * @param num System call number, already checked
+ * @param a0 First argument
+ * @param a1 Second argument
+ * @param a2 Third argument
+ * @return int32_t What the call returned
+ */
+int32_t syscall_timed(uint32_t num, int32_t a0, int32_t a1, int32_t a2)
+{
+    uint32_t start, cycles;
+    int32_t ret;
+    start = rdtsc();
+    ret = ((int32_t (*)(int32_t, int32_t, int32_t))syscall_jumptbl[num])(a0, a1, a2);
+    cycles = rdtsc() - start;
+    // Bucket floor(log2(cycles)), bsr gives the highest set bit
+    syscall_stats.hist[num][cycles ? 31 - __builtin_clz(cycles) : 0]++;
+    return ret;
+}
+
 /**
  * @brief Register a system call with the system
  * 
- * @param id ID of the system call.  For now, 0<ID<16
+ * @param id ID of the system call, 0<ID<NUM_SYSCALLS
  * @param fx Pointer to function to call.  NULL is allowed.
  * @return int 0 on success, nonzero on failure
  */
 int syscall_add(size_t id, void * fx)
 {
-    if (id < 0 || id > 16) return 1;
+    if (id == 0 || id >= NUM_SYSCALLS) return 1;
     syscall_jumptbl[id] = fx;
     return 0;
 }
 
+/**
+ * @brief Check that a buffer a program passed in is all in its user page,
+ * or (for buffers the kernel only reads) in its mmap region
+ * 
+ * @param buf Start of the buffer
+ * @param nbytes Length of the buffer
+ * @param mapped_ok Allow the mmap region too
+ * @return int 1 if the buffer is the program's, 0 if not
+ */
+static int user_buf_ok(const void * buf, int32_t nbytes, int mapped_ok)
+{
+    uint32_t start = (uint32_t)buf;
+    if (nbytes < 0 || nbytes > USER_PAGE_SIZE) return 0;
+    if (start >= USER_LOC && start <= USER_LOC + USER_PAGE_SIZE - nbytes) return 1;
+    return mapped_ok && start >= MMAP_LOC && start <= MMAP_LOC + USER_PAGE_SIZE - nbytes;
+}
+
 /**
  * @brief Call read for filetype given by the fd
  * 
@@ -149,6 +263,74 @@ int32_t write(int32_t fd, void * buf, int32_t nbytes)
     return (fdesc->optbl->write)(fd, buf, nbytes);
 }
 
+/**
+ * @brief Read into several buffers with one system call. The descriptor is
+ * looked up once and its read function is called for each buffer in turn,
+ * stopping early if one comes back short (end of file, or a line from the
+ * terminal that didn't fill the buffer).
+ * 
+ * @param fd File descriptor to read from
+ * @param iov Array of iovcnt buffers, 0 < iovcnt <= IOV_MAX
+ * @param iovcnt Number of buffers
+ * @return int32_t Total bytes read, -1 on error (if nothing was read)
+ */
+int32_t readv(int32_t fd, const iovec_t * iov, int32_t iovcnt)
+{
+    filedesc_t * fdesc;
+    iovec_t vec[IOV_MAX];
+    int32_t i, ret, total = 0;
+    if (fd < 0 || fd >= NUM_FDS || iovcnt <= 0 || iovcnt > IOV_MAX) return -1;
+    if (!user_buf_ok(iov, iovcnt * sizeof(iovec_t), 0)) return -1;
+    fdesc = syscall_getfdptr(fd);
+    if (!fdesc->flags.in_use || !fdesc->optbl->read) return -1;
+    // Check and use a copy: a read into one buffer could overwrite the entries after it in the array
+    memcpy(vec, iov, iovcnt * sizeof(iovec_t));
+    for (i = 0; i < iovcnt; i++) {
+        if (!user_buf_ok(vec[i].base, vec[i].len, 0)) return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        ret = (fdesc->optbl->read)(fd, vec[i].base, vec[i].len);
+        if (ret == -1) return (total > 0) ? total : -1;
+        total += ret;
+        if (ret < vec[i].len) break;
+    }
+    return total;
+}
+
+/**
+ * @brief Write several buffers with one system call, so a line put together
+ * from pieces costs one trap. The descriptor is looked up once and its write
+ * function is called for each buffer in turn.
+ * 
+ * @param fd File descriptor to write to
+ * @param iov Array of iovcnt buffers, 0 < iovcnt <= IOV_MAX. They can be in
+ * the mmap region, so a mapped file can be written out without a copy.
+ * @param iovcnt Number of buffers
+ * @return int32_t Total bytes written, -1 on error (if nothing was written)
+ */
+int32_t writev(int32_t fd, const iovec_t * iov, int32_t iovcnt)
+{
+    filedesc_t * fdesc;
+    iovec_t vec[IOV_MAX];
+    int32_t i, ret, total = 0;
+    if (fd < 0 || fd >= NUM_FDS || iovcnt <= 0 || iovcnt > IOV_MAX) return -1;
+    if (!user_buf_ok(iov, iovcnt * sizeof(iovec_t), 0)) return -1;
+    fdesc = syscall_getfdptr(fd);
+    if (!fdesc->flags.in_use || !fdesc->optbl->write) return -1;
+    // Checked and used from a copy, as in readv
+    memcpy(vec, iov, iovcnt * sizeof(iovec_t));
+    for (i = 0; i < iovcnt; i++) {
+        if (!user_buf_ok(vec[i].base, vec[i].len, 1)) return -1;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        ret = (fdesc->optbl->write)(fd, vec[i].base, vec[i].len);
+        if (ret == -1) return (total > 0) ? total : -1;
+        total += ret;
+        if (ret < vec[i].len) break;
+    }
+    return total;
+}
+
 /**
  * @brief System call to close a file
  * 
@@ -204,6 +386,241 @@ int32_t open(const uint8_t * filename)
 
 }
 
+/**
+ * @brief Create a new, empty regular file
+ * 
+ * @param filename Path of the file to create, every directory on the way has to exist
+ * @return int32_t 0 on success, -1 if the file exists, the name is bad, or the filesystem is read only or full.
+ */
+int32_t create(const uint8_t * filename)
+{
+    if (!filename) return -1;
+    return fs_create(filename);
+}
+
+/**
+ * @brief Write all cached file changes back to the filesystem image
+ * 
+ * @return int32_t Number of blocks written, or -1 on error.
+ */
+int32_t sync(void)
+{
+    return fs_flush();
+}
+
+/**
+ * @brief Read as many directory entries (name, type, inode, size) as fit into a buffer, so listing a directory
+ * doesn't take one read() per name.
+ * 
+ * @param fd File descriptor of an open directory
+ * @param buf User buffer to fill with dirent_t structs
+ * @param nbytes Size of buf in bytes
+ * @return int32_t Number of bytes filled in, 0 at the end of the directory, or -1 on error.
+ */
+int32_t getdents(int32_t fd, void * buf, int32_t nbytes)
+{
+    filedesc_t * fdesc;
+    if (fd < 0 || fd >= NUM_FDS) return -1;
+    fdesc = syscall_getfdptr(fd);
+    if (!fdesc->flags.in_use || fdesc->optbl != &dir_optbl) return -1;
+    if (!user_buf_ok(buf, nbytes, 0)) return -1;
+    return dir_getdents(fd, buf, nbytes);
+}
+
+/**
+ * @brief Map an open file read only into the caller's address space, so it can be read in place instead of being
+ * copied into a buffer with read(). The mapping stays until munmap or until the program halts.
+ * 
+ * @param fd File descriptor of an open regular file
+ * @param start Filled in with the address the file is mapped at (NULL for an empty file)
+ * @return int32_t Length of the file in bytes, or -1 on error.
+ */
+int32_t mmap(int32_t fd, uint8_t ** start)
+{
+    filedesc_t * fdesc;
+    if (fd < 0 || fd >= NUM_FDS) return -1;
+    fdesc = syscall_getfdptr(fd);
+    if (!fdesc->flags.in_use || fdesc->optbl != &regfile_optbl) return -1;
+    if (!user_buf_ok(start, sizeof(*start), 0)) return -1;
+    return mmap_file(fdesc->inode, start);
+}
+
+/**
+ * @brief Remove a mapping made by mmap.
+ * 
+ * @param start Address mmap returned
+ * @return int32_t 0 on success, -1 if no file is mapped there.
+ */
+int32_t munmap(uint8_t * start)
+{
+    return mmap_unmap(start);
+}
+
+/**
+ * @brief Check a ring entry before running it: only calls that can't leave
+ * the process (read, write, open, close, create, getdents, nop) are allowed,
+ * with the same buffer checks readv and writev make.
+ * 
+ * @param sqe Copy of the entry
+ * @return int 1 if the entry can run, 0 if it gets -1 without running
+ */
+static int ring_op_ok(const ring_sqe_t * sqe)
+{
+    switch (sqe->op) {
+        case SYS_READ_NUM:
+        case SYS_GETDENTS_NUM:
+            return sqe->args[0] >= 0 && sqe->args[0] < NUM_FDS && user_buf_ok((void *)sqe->args[1], sqe->args[2], 0);
+        case SYS_WRITE_NUM:
+            return sqe->args[0] >= 0 && sqe->args[0] < NUM_FDS && user_buf_ok((void *)sqe->args[1], sqe->args[2], 1);
+        case SYS_CLOSE_NUM:
+            return sqe->args[0] >= 0 && sqe->args[0] < NUM_FDS;
+        case SYS_OPEN_NUM:
+        case SYS_CREATE_NUM:
+            return user_buf_ok((void *)sqe->args[0], 1, 0);
+        case SYS_NOP_NUM:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Whether an entry could wait for something (a line from the
+ * terminal, or an RTC tick). Those can't run from the PIT
+ * handler with interrupts off, so a tick stops at them and leaves them for
+ * ring_enter.
+ * 
+ * @param sqe Copy of the entry
+ * @return int 1 if the entry could wait
+ */
+static int ring_op_blocks(const ring_sqe_t * sqe)
+{
+    filedesc_t * fdesc;
+    if (sqe->op != SYS_READ_NUM || sqe->args[0] < 0 || sqe->args[0] >= NUM_FDS) return 0;
+    fdesc = syscall_getfdptr(sqe->args[0]);
+    return fdesc->flags.in_use && (fdesc->optbl == &stdio_optbl || fdesc->optbl == &rtc_optbl);
+}
+
+/**
+ * @brief Run the waiting entries of the current process's syscall ring, in
+ * order, posting a completion for each. Stops when the submission queue is
+ * empty or the completion queue is full (the rest wait for the next call).
+ * 
+ * @param from_tick Called from the PIT handler: stop at the first entry that
+ * could wait
+ * @return int32_t Number of entries run, -1 if the process has no ring
+ */
+int32_t ring_drain(int from_tick)
+{
+    sysring_t * ring = cur_pcb->ring;
+    ring_sqe_t sqe;
+    ring_cqe_t * cqe;
+    uint32_t head;
+    int32_t res, done = 0;
+    if (!ring) return -1;
+    for (head = ring->sq_head; head != ring->sq_tail && ring->cq_tail - ring->cq_head < RING_ENTRIES; head++) {
+        // Work on a copy, so the checked arguments are the ones the call gets
+        sqe = ring->sq[head & (RING_ENTRIES - 1)];
+        if (from_tick && ring_op_blocks(&sqe)) break;
+        if (ring_op_ok(&sqe))
+            res = ((int32_t (*)(int32_t, int32_t, int32_t))syscall_jumptbl[sqe.op])(sqe.args[0], sqe.args[1], sqe.args[2]);
+        else
+            res = -1;
+        cqe = &ring->cq[ring->cq_tail & (RING_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        ring->cq_tail++;
+        ring->sq_head = head + 1;
+        done++;
+    }
+    return done;
+}
+
+/**
+ * @brief Register a syscall ring for the calling process, or drop the one it
+ * has. The ring lives in the program's own page, so the kernel reaches it
+ * through the program's mappings, whenever that program is the one running.
+ * 
+ * @param ring The ring (its indices are reset to 0), NULL to drop the ring
+ * @return int32_t 0 on success, -1 if the ring isn't in the user page.
+ */
+int32_t ring_setup(sysring_t * ring)
+{
+    if (!ring) {
+        cur_pcb->ring = NULL;
+        return 0;
+    }
+    if (((uint32_t)ring & 0x3) || !user_buf_ok(ring, sizeof(sysring_t), 0)) return -1;
+    ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+    cur_pcb->ring = ring;
+    return 0;
+}
+
+/**
+ * @brief Run everything waiting in the calling process's syscall ring,
+ * the one trap for a whole batch of calls.
+ * 
+ * @return int32_t Number of entries run, -1 if the process has no ring
+ */
+int32_t ring_enter(void)
+{
+    return ring_drain(0);
+}
+
+/**
+ * @brief Turn the system call counters and latency histograms on or off,
+ * clear them (and the scheduler's), or copy them out (a syscall_stats_t, or
+ * the scheduler's sched_stats_t for SYSSTATS_SCHED). SYSSTATS_QUANTUM sets
+ * the scheduler's per-class quanta (PIT ticks, by SCHED_CLASS_) from buf,
+ * leaving the classes whose entry is 0 alone, and fills buf with the quanta
+ * in use.
+ * 
+ * @param cmd SYSSTATS_GET, SYSSTATS_ON, SYSSTATS_OFF, SYSSTATS_RESET, SYSSTATS_SCHED or SYSSTATS_QUANTUM
+ * @param buf Buffer for SYSSTATS_GET, SYSSTATS_SCHED and SYSSTATS_QUANTUM
+ * @param nbytes Size of buf, at most the size of the struct is copied (exactly
+ * SCHED_CLASSES quanta for SYSSTATS_QUANTUM)
+ * @return int32_t Bytes copied for SYSSTATS_GET and SYSSTATS_SCHED, 0 for the others, -1 on error.
+ */
+int32_t sysstats(int32_t cmd, void * buf, int32_t nbytes)
+{
+    uint32_t quanta[SCHED_CLASSES];
+    uint32_t cls;
+
+    switch (cmd) {
+        case SYSSTATS_GET:
+            if (!user_buf_ok(buf, nbytes, 0)) return -1;
+            if (nbytes > sizeof(syscall_stats_t)) nbytes = sizeof(syscall_stats_t);
+            memcpy(buf, &syscall_stats, nbytes);
+            return nbytes;
+        case SYSSTATS_ON:
+            syscall_stats_on = 1;
+            return 0;
+        case SYSSTATS_OFF:
+            syscall_stats_on = 0;
+            return 0;
+        case SYSSTATS_RESET:
+            memset(&syscall_stats, 0, sizeof(syscall_stats_t));
+            memset(&sched_stats, 0, sizeof(sched_stats_t));
+            return 0;
+        case SYSSTATS_SCHED:
+            if (!user_buf_ok(buf, nbytes, 0)) return -1;
+            if (nbytes > sizeof(sched_stats_t)) nbytes = sizeof(sched_stats_t);
+            memcpy(buf, &sched_stats, nbytes);
+            return nbytes;
+        case SYSSTATS_QUANTUM:
+            if (nbytes != sizeof(quanta) || !user_buf_ok(buf, nbytes, 0)) return -1;
+            memcpy(quanta, buf, nbytes);
+            for (cls = 0; cls < SCHED_CLASSES; cls++) {
+                if (quanta[cls] != 0 && sched_set_quantum(cls, quanta[cls]) == -1) return -1;
+            }
+            memcpy(buf, sched_quantum, nbytes);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
 /**
  * @brief Initialize system calls.
  * 
@@ -220,7 +637,51 @@ int32_t syscall_init()
     syscall_jumptbl[6] = close;
     syscall_jumptbl[7] = getargs;
     syscall_jumptbl[8] = vidmap;
+    syscall_jumptbl[11] = create;
+    syscall_jumptbl[12] = sync;
+    syscall_jumptbl[13] = getdents;
+    syscall_jumptbl[14] = mmap;
+    syscall_jumptbl[15] = munmap;
+    syscall_jumptbl[16] = nop;
+    syscall_jumptbl[17] = readv;
+    syscall_jumptbl[18] = writev;
+    syscall_jumptbl[19] = ring_setup;
+    syscall_jumptbl[20] = ring_enter;
+    syscall_jumptbl[21] = sysstats;
     // Register the system call in to the IDT
+    sysenter_init();
+    return 0;
+}
+
+/**
+ * @brief Set up the SYSENTER MSRs, if the CPU has SYSENTER. Without it
+ * only INT 0x80 works (a SYSENTER then faults in the user program).
+ * 
+ * @return int32_t 0 on success, -1 if there is no SYSENTER.
+ */
+int32_t sysenter_init()
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid"
+            : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+    );
+    /* Family 6 model < 3 stepping < 3 (the Pentium Pro) sets the bit without having the instructions */
+    if (!(edx & CPUID_SEP) || ((eax >> 8 & 0xF) == 6 && (eax >> 4 & 0xF) < 3 && (eax & 0xF) < 3))
+        return -1;
+    wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&tss.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_handler);
+    return 0;
+}
+
+/**
+ * @brief The null system call, for timing the way in and out of the kernel.
+ * 
+ * @return int32_t 0
+ */
+int32_t nop(void)
+{
     return 0;
 }
 
@@ -13,6 +13,27 @@
 #define NUM_FDS 8
 #define SYSCALL_INT 0x80
 #define SYSCALL_DPL 3 // System calls should be accessible from user space.
+#define NUM_SYSCALLS 32 // Entries in syscall_jumptbl, 0 is never a valid call
+#define SYS_EXECUTE_NUM 2
+#define IOV_MAX 16 // Most buffers one readv/writev takes
+#define RING_ENTRIES 64 // Slots in each half of a syscall ring, a power of two
+
+// Calls a syscall ring can carry
+#define SYS_READ_NUM 3
+#define SYS_WRITE_NUM 4
+#define SYS_OPEN_NUM 5
+#define SYS_CLOSE_NUM 6
+#define SYS_CREATE_NUM 11
+#define SYS_GETDENTS_NUM 13
+#define SYS_NOP_NUM 16
+
+/* SYSENTER entry. The MSRs give the kernel CS (SS, and the user CS and SS for SYSEXIT, are the GDT entries after it),
+ * the entry point and a stack pointer. SYSENTER_ESP points at tss.esp0, so the handler's first instruction can load the
+ * current process's kernel stack from there. */
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define CPUID_SEP        0x800  /* CPUID 1, EDX bit 11: SYSENTER/SYSEXIT are there */
 
 /* MP3.4 added by MJ */
 #define FAILURE -1
@@ -20,14 +41,66 @@
 #define BUF_MAX_SIZE 128
 #define EMPTY_CHAR '\0'
 
+/// One buffer of a readv/writev
+typedef struct iovec {
+    void * base;
+    int32_t len;
+} iovec_t;
+
+/* Syscall ring. A program that wants to make many small calls with one trap keeps one of these in its own memory
+ * and registers it with ring_setup. It fills submission entries and moves sq_tail up; ring_enter (or the next PIT
+ * tick that lands in the program) runs the entries in order through syscall_jumptbl and posts a completion for each,
+ * moving sq_head and cq_tail up; the program reads the completions and moves cq_head up. The indices only ever go
+ * up, the slot for index i is i % RING_ENTRIES. */
+typedef struct ring_sqe {
+    int32_t op;                 // System call number
+    int32_t args[3];
+    uint32_t user_data;         // Handed back in the completion
+} ring_sqe_t;
+
+typedef struct ring_cqe {
+    uint32_t user_data;
+    int32_t res;                // What the call returned, -1 for calls a ring can't carry
+} ring_cqe_t;
+
+typedef struct sysring {
+    volatile uint32_t sq_head;  // Next entry the kernel runs
+    volatile uint32_t sq_tail;  // Next entry the program fills
+    volatile uint32_t cq_head;  // Next completion the program reads
+    volatile uint32_t cq_tail;  // Next completion the kernel posts
+    ring_sqe_t sq[RING_ENTRIES];
+    ring_cqe_t cq[RING_ENTRIES];
+} sysring_t;
+
+/* Per call counters and latency histograms, kept while syscall_stats_on is set and read out with sysstats.
+ * Bucket i of a histogram counts calls that took 2^i to 2^(i+1) - 1 TSC cycles from the jump table call to its
+ * return, interrupts and other tasks' time slices in between included. */
+#define SYSCALL_HIST_BUCKETS 32
+#define SYSSTATS_GET 0      // Copy the tables into a buffer
+#define SYSSTATS_ON 1
+#define SYSSTATS_OFF 2
+#define SYSSTATS_RESET 3    // Clears the scheduler's stats too
+#define SYSSTATS_SCHED 4    // Copy the scheduler's sched_stats_t into a buffer
+#define SYSSTATS_QUANTUM 5  // Set the per-class quanta from a uint32_t[SCHED_CLASSES] (0 keeps one), copy them back
+
+typedef struct syscall_stats {
+    uint32_t calls[NUM_SYSCALLS];   // Every call, halt and execute too. First, the entry code counts into it.
+    uint32_t hist[NUM_SYSCALLS][SYSCALL_HIST_BUCKETS];  // Calls that came back (halt never does, execute isn't timed)
+} syscall_stats_t;
+
+extern syscall_stats_t syscall_stats;
+extern uint32_t syscall_stats_on;
+
 // Jump table of system call functions
-extern void * syscall_jumptbl[16];
+extern void * syscall_jumptbl[NUM_SYSCALLS];
 
 // typedef struct dentry dentry_t;
 
 extern void syscall_handler(void);
+extern void sysenter_handler(void);
 extern int syscall_add(size_t, void *);
 extern int32_t syscall_init();
+extern int32_t sysenter_init();
 
 extern file_optbl_t regfile_optbl;
 extern file_optbl_t dir_optbl;
@@ -36,4 +109,17 @@ extern file_optbl_t rtc_optbl;
 /* MP3.4 added by MJ */
 extern int32_t getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t vidmap (uint8_t** screen_start);
+extern int32_t create (const uint8_t * filename);
+extern int32_t sync (void);
+extern int32_t getdents (int32_t fd, void * buf, int32_t nbytes);
+extern int32_t mmap (int32_t fd, uint8_t ** start);
+extern int32_t munmap (uint8_t * start);
+extern int32_t nop (void);
+extern int32_t readv (int32_t fd, const iovec_t * iov, int32_t iovcnt);
+extern int32_t writev (int32_t fd, const iovec_t * iov, int32_t iovcnt);
+extern int32_t ring_setup (sysring_t * ring);
+extern int32_t ring_enter (void);
+extern int32_t ring_drain (int from_tick);
+extern int32_t syscall_timed (uint32_t num, int32_t a0, int32_t a1, int32_t a2);
+extern int32_t sysstats (int32_t cmd, void * buf, int32_t nbytes);
 
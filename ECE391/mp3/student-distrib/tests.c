@@ -7,6 +7,14 @@
 #include "interrupts.h"
 #include "filesys.h"
 #include "console.h"
+#include "execcache.h"
+#include "bcache.h"
+#include "extent.h"
+#include "compress.h"
+#include "ata.h"
+#include "blk.h"
+#include "syscall.h"
+#include "scheduling.h"
 
 #define PASS 1
 #define FAIL 0
@@ -270,6 +278,43 @@ int vmem_pg_access_test(){
 	return result;
 }
 
+/**
+ * @brief Check the demand-paged user page tables: every user PDE points at that process' own
+ * 4 KB page table, and every PTE maps onto the right 4 KB frame of the process' 4 MB physical slot,
+ * except present pages shared from the exec cache, which must be read only.
+ * Slots with no process in them must not have any pages present.
+ * 
+ * @return int PASS or FAIL
+ */
+int user_ptable_test(){
+	TEST_HEADER;
+
+	int i, j;
+	int result = PASS;
+	uint32_t pte;
+
+	for(j = 0; j < MAX_PROCESS; j++){
+		if((process_pdir_table[j].pde[USER_IDX] & ADDR_MASK) != (uint32_t) &(user_ptable[j])){
+			result = FAIL;
+		}
+		for(i = 0; i < TBL_SIZE; i++){
+			pte = user_ptable[j].pte[i];
+			if((pte & PAGE_PRESENT) && (pte & ADDR_MASK) >= EXEC_CACHE_LOC && (pte & ADDR_MASK) < EXEC_CACHE_LOC + USER_PAGE_SIZE){
+				if(pte & PAGE_RW)
+					result = FAIL;
+			}
+			else if((pte & ADDR_MASK) != MB_8 + (j * USER_PAGE_SIZE) + (i * PAGE_SIZE)){
+				result = FAIL;
+			}
+			if(!(process_pdir_table[j].pde[USER_IDX] & PAGE_PRESENT) && (pte & PAGE_PRESENT)){
+				result = FAIL;
+			}
+		}
+	}
+
+	return result;
+}
+
 /**
  * @brief Purposely fail a test to see that assertion_failure is handled correctly
  * 
@@ -322,6 +367,277 @@ int rtc_garbage_test()
 	if (rtc_write(0, &garbage, 4) == -1) return PASS; else return FAIL;
 }
 
+/**
+ * @brief rtc_read has to sleep until the next interrupt, and waking a wait
+ * queue has to make the tasks on it runnable (moving them from the sleep list
+ * to the run queue) and empty it.
+ * 
+ * @return int PASS or FAIL
+ */
+int rtc_wait_test()
+{
+	static pcb_t pcb;
+	wait_queue_t wq;
+	task_t* task = &tasks[MAX_PROCESS - 1];
+	uint32_t start;
+	int result = PASS;
+	int i;
+	bool others;
+
+	rtc_open(NULL);
+	for (i = 0; i < 3; i++) {
+		start = rtc_ticks;
+		rtc_read(0, NULL, 0);
+		if (rtc_ticks == start)
+			result = FAIL;
+	}
+	rtc_close(0);
+
+	if (task->pcb != NULL)
+		return result;
+	others = task_any_runnable();
+	pcb.pid = MAX_PROCESS - 1;
+	task->pcb = &pcb;
+	task->enabled = true;
+	task->waiting = true;
+	task->boost = false;
+	task->ticks_left = 0;
+	task->list = NULL;
+	task_requeue(task);
+	wq.pids = 1 << pcb.pid;
+	wq.boost = false;
+	if (task_find(pcb.pid) != task || task->list != &sleep_list || (!others && task_any_runnable()))
+		result = FAIL;
+	wq_wake_all(&wq);
+	if (task->waiting || wq.pids != 0 || task->list == &sleep_list || task->list == NULL || !task_any_runnable())
+		result = FAIL;
+	task_list_remove(task);
+	task->pcb = NULL;
+	return result;
+}
+
+/**
+ * @brief The run queue: tasks come off in the order they went on, removing
+ * one from the middle keeps the links and the count right, and popping an
+ * empty list gives NULL.
+ * 
+ * @return int PASS or FAIL
+ */
+int run_queue_test()
+{
+	static task_t t[3];
+	task_list_t list = {NULL, NULL, 0};
+	int result = PASS;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		task_list_push(&list, &t[i]);
+	if (list.count != 3 || list.head != &t[0] || list.tail != &t[2])
+		result = FAIL;
+	task_list_remove(&t[1]);
+	if (list.count != 2 || t[0].next != &t[2] || t[2].prev != &t[0] || t[1].list != NULL)
+		result = FAIL;
+	task_list_remove(&t[1]);
+	if (task_list_pop(&list) != &t[0] || task_list_pop(&list) != &t[2] || task_list_pop(&list) != NULL)
+		result = FAIL;
+	if (list.count != 0 || list.head != NULL || list.tail != NULL)
+		result = FAIL;
+	return result;
+}
+
+/**
+ * @brief Priority classes: a boosted task is picked before the foreground
+ * one, which is picked before the background ones, and under load (all three
+ * always runnable) the rounds still give every task its quantum: over
+ * SCHED_TEST_TICKS ticks each gets its share of sched_quantum, to within a
+ * round. The shares are checked for the default quanta and again after
+ * changing them with sched_set_quantum, which has to turn down a bad class or
+ * a zero quantum. Runs on a saved copy of the run queue.
+ * 
+ * @return int PASS or FAIL
+ */
+#define SCHED_TEST_TICKS 500
+int sched_class_test()
+{
+	static pcb_t pcbs[3];
+	static task_t t[3];
+	/* Foreground and background quanta for each run, 0 keeps the default */
+	static const uint32_t quanta[2][2] = {{0, 0}, {5, 2}};
+	run_queue_t saved = run_queue;
+	console_t* saved_con = current_console;
+	uint32_t saved_quantum[SCHED_CLASSES];
+	uint32_t ran[3];
+	uint32_t round, share, i, q;
+	task_t* cur;
+	int result = PASS;
+
+	memcpy(saved_quantum, sched_quantum, sizeof(sched_quantum));
+	memset(&run_queue, 0, sizeof(run_queue));
+	current_console = &vterms[0];
+	for (i = 0; i < 3; i++) {
+		pcbs[i].con = (i == 0) ? 0 : 1;
+		t[i].pcb = &pcbs[i];
+		t[i].enabled = true;
+		t[i].waiting = false;
+		t[i].boost = (i == 2);
+		t[i].ticks_left = 0;
+		t[i].list = NULL;
+		runq_add(&t[i]);
+	}
+	/* Boosted (on a background terminal) first, then foreground, then background */
+	if (runq_pick() != &t[2] || runq_pick() != &t[0] || runq_pick() != &t[1] || runq_pick() != NULL)
+		result = FAIL;
+	t[2].boost = false;
+	if (sched_set_quantum(SCHED_CLASSES, 1) != -1 || sched_set_quantum(SCHED_CLASS_FG, 0) != -1)
+		result = FAIL;
+
+	for (q = 0; q < 2; q++) {
+		if (quanta[q][0] != 0 && (sched_set_quantum(SCHED_CLASS_FG, quanta[q][0]) != 0 ||
+		    sched_set_quantum(SCHED_CLASS_BG, quanta[q][1]) != 0 || sched_quantum[SCHED_CLASS_FG] != quanta[q][0]))
+			result = FAIL;
+		memset(&run_queue, 0, sizeof(run_queue));
+		for (i = 1; i < 3; i++) {
+			t[i].ticks_left = 0;
+			runq_add(&t[i]);
+		}
+		/* Same as the PIT handler: run the quantum out, go to the back, then pick */
+		ran[0] = ran[1] = ran[2] = 0;
+		cur = &t[0];
+		cur->ticks_left = sched_quantum[SCHED_CLASS_FG];
+		for (i = 0; i < SCHED_TEST_TICKS; i++) {
+			ran[cur - t]++;
+			if (--cur->ticks_left > 0)
+				continue;
+			runq_add(cur);
+			cur = runq_pick();
+		}
+		round = sched_quantum[SCHED_CLASS_FG] + 2 * sched_quantum[SCHED_CLASS_BG];
+		for (i = 0; i < 3; i++) {
+			share = (SCHED_TEST_TICKS / round) * sched_quantum[(i == 0) ? SCHED_CLASS_FG : SCHED_CLASS_BG];
+			if (ran[i] + round < share || ran[i] > share + round)
+				result = FAIL;
+		}
+	}
+	memcpy(sched_quantum, saved_quantum, sizeof(sched_quantum));
+	run_queue = saved;
+	current_console = saved_con;
+	return result;
+}
+
+/**
+ * @brief One run of sched_latency_test on the real tasks table: task 0
+ * reads the visible terminal and sleeps on a wait queue, tasks 1 to
+ * LAT_BENCH_BG are always runnable on the other terminals. Every few ticks a
+ * line comes in (wq_wake_all, as the keyboard handler does), and we count the
+ * PIT ticks, driven through sched_next, until task 0 runs; it then goes right
+ * back to sleep.
+ * 
+ * @param boost Whether the wait queue boosts the tasks it wakes
+ * @param sum Filled with the ticks summed over the LAT_BENCH_KEYS lines
+ * @param max Filled with the most ticks one line waited
+ * @return int PASS, or FAIL if task 0 didn't get to run within LAT_BENCH_LIMIT ticks
+ */
+#define LAT_BENCH_BG 4
+#define LAT_BENCH_KEYS 64
+#define LAT_BENCH_LIMIT 1000
+static int sched_latency_run(bool boost, uint32_t* sum, uint32_t* max)
+{
+	static pcb_t pcbs[LAT_BENCH_BG + 1];
+	wait_queue_t wq;
+	task_t* fg = &tasks[0];
+	task_t* next;
+	uint32_t key, tick, ticks, i;
+
+	memset(&run_queue, 0, sizeof(run_queue));
+	sleep_list.head = sleep_list.tail = NULL;
+	sleep_list.count = 0;
+	for (i = 0; i <= LAT_BENCH_BG; i++) {
+		pcbs[i].pid = i;
+		pcbs[i].con = (i == 0) ? 0 : 1 + i % 2;
+		tasks[i].pcb = &pcbs[i];
+		tasks[i].enabled = true;
+		tasks[i].waiting = (i == 0);
+		tasks[i].boost = false;
+		tasks[i].ticks_left = 0;
+		tasks[i].woken_at = 0;
+		tasks[i].list = NULL;
+		if (i == 0)
+			task_list_push(&sleep_list, &tasks[i]);
+		else if (i > 1)
+			runq_add(&tasks[i]);
+	}
+	cur_task = &tasks[1];
+	cur_task->ticks_left = sched_quantum[SCHED_CLASS_BG];
+	wq.pids = 1;
+	wq.boost = boost;
+
+	*sum = *max = 0;
+	for (key = 0; key < LAT_BENCH_KEYS; key++) {
+		/* The background tasks get a few ticks to themselves first, so lines come in at every point of a round */
+		for (tick = 0; tick < 1 + (key * 7) % (2 * LAT_BENCH_BG); tick++) {
+			if ((next = sched_next(true)) != NULL)
+				cur_task = next;
+		}
+		wq_wake_all(&wq);
+		for (ticks = 0; cur_task != fg; ticks++) {
+			if (ticks == LAT_BENCH_LIMIT)
+				return FAIL;
+			if ((next = sched_next(true)) != NULL)
+				cur_task = next;
+		}
+		*sum += ticks;
+		if (ticks > *max)
+			*max = ticks;
+		/* Echo, and read the next line */
+		fg->woken_at = 0;
+		task_set_state(fg, true, true);
+		wq.pids = 1;
+	}
+	return PASS;
+}
+
+/**
+ * @brief Keystroke latency under a CPU-bound background load. The echo itself
+ * happens in the keyboard interrupt, so what a shell's user waits for is the
+ * reader running after the line wakes it. sched_latency_run measures that in
+ * PIT ticks with and without the keyboard boost; with it every line has to be
+ * picked up at the very next tick. Saves and restores the scheduler state,
+ * with interrupts off so the PIT can't run on the fake tasks.
+ * 
+ * @return int PASS or FAIL
+ */
+int sched_latency_test()
+{
+	static task_t saved_tasks[MAX_PROCESS];
+	run_queue_t saved_rq = run_queue;
+	task_list_t saved_sleep = sleep_list;
+	task_t* saved_cur = cur_task;
+	console_t* saved_con = current_console;
+	uint32_t sum, max, flags;
+	int result = PASS;
+
+	cli_and_save(flags);
+	memcpy(saved_tasks, tasks, sizeof(tasks));
+	current_console = &vterms[0];
+
+	if (sched_latency_run(true, &sum, &max) == FAIL || max != 1)
+		result = FAIL;
+	printf("key wake-to-run, %d busy tasks: boost avg %d.%d max %d ticks",
+		LAT_BENCH_BG, sum / LAT_BENCH_KEYS, (sum * 10 / LAT_BENCH_KEYS) % 10, max);
+	if (sched_latency_run(false, &sum, &max) == FAIL)
+		result = FAIL;
+	printf(", no boost avg %d.%d max %d ticks (%d ms each)\n",
+		sum / LAT_BENCH_KEYS, (sum * 10 / LAT_BENCH_KEYS) % 10, max, 1000 / QUANTUM_RATE);
+
+	memcpy(tasks, saved_tasks, sizeof(tasks));
+	run_queue = saved_rq;
+	sleep_list = saved_sleep;
+	cur_task = saved_cur;
+	current_console = saved_con;
+	restore_flags(flags);
+	return result;
+}
+
 /**
  * @brief Open the files that we see in fsdir
  * 
@@ -683,9 +999,1595 @@ int syscall_functions_test()
 	);
 	if (retval1 != -1 || retval2 != -1) return FAIL; else return PASS;
 }
+/**
+ * @brief Check the system call table past the first 16 entries: the nop call (16) returns 0 through INT 0x80, an empty
+ * entry and the first number past the table return -1, and the SYSENTER MSRs point at sysenter_handler if the CPU has
+ * SYSENTER. SYSEXIT always goes to ring 3, so the SYSENTER path itself can only be called from a user program (sysbench).
+ * 
+ * @return int PASS or FAIL
+ */
+int syscall_nop_test()
+{
+	int retval[3];
+	int i;
+	uint32_t eip;
+	static const int nums[3] = {16, NUM_SYSCALLS - 1, NUM_SYSCALLS};
+
+	for (i = 0; i < 3; i++) {
+		asm volatile (
+			"int $0x80"
+			: "=a" (retval[i])
+			: "a" (nums[i])
+			: "memory"
+		);
+	}
+	if (retval[0] != 0 || retval[1] != -1 || retval[2] != -1)
+		return FAIL;
+	if (sysenter_init() == 0) {
+		asm volatile ("rdmsr" : "=a" (eip) : "c" (MSR_SYSENTER_EIP) : "edx");
+		if (eip != (uint32_t)sysenter_handler)
+			return FAIL;
+	}
+	return PASS;
+}
+/**
+ * @brief Check readv (17) and writev (18) turn down what a program shouldn't be able to pass them: an iovec array or
+ * a buffer outside the user page (kernel memory here), no buffers or more than IOV_MAX, and a bad descriptor.
+ * 
+ * @return int PASS or FAIL
+ */
+int syscall_iov_test()
+{
+	static uint8_t buf[16];
+	static iovec_t iov[IOV_MAX + 1];
+	static const int counts[4] = {1, 0, IOV_MAX + 1, 1};
+	static const int fds[4] = {1, 1, 1, NUM_FDS};
+	int retval;
+	int i, call;
+
+	for (i = 0; i <= IOV_MAX; i++) {
+		iov[i].base = buf;
+		iov[i].len = sizeof(buf);
+	}
+	for (call = 17; call <= 18; call++) {
+		for (i = 0; i < 4; i++) {
+			asm volatile (
+				"int $0x80"
+				: "=a" (retval)
+				: "a" (call), "b" (fds[i]), "c" (iov), "d" (counts[i])
+				: "memory"
+			);
+			if (retval != -1)
+				return FAIL;
+		}
+	}
+	return PASS;
+}
+
+/**
+ * @brief Syscall ring: ring_setup must refuse a ring outside the user page, and
+ * draining must run allowed calls, give -1 for the rest (execute, numbers out
+ * of range, bad fds) in order, and stop when the completion queue is full.
+ * Runs the drain on a stand-in PCB so no program is needed.
+ * 
+ * @return int PASS/FAIL
+ */
+int syscall_ring_test()
+{
+	static sysring_t ring;
+	static pcb_t pcb;
+	static const int32_t ops[5] = {SYS_NOP_NUM, SYS_EXECUTE_NUM, NUM_SYSCALLS + 1, -1, SYS_CLOSE_NUM};
+	static const int32_t res[5] = {0, -1, -1, -1, -1};
+	pcb_t * saved = cur_pcb;
+	int result = PASS;
+	int retval;
+	int i;
+
+	asm volatile (
+		"int $0x80"
+		: "=a" (retval)
+		: "a" (19), "b" (&ring)
+		: "memory"
+	);
+	if (retval != -1)
+		result = FAIL;
+
+	memset(&ring, 0, sizeof(ring));
+	pcb.ring = &ring;
+	cur_pcb = &pcb;
+	for (i = 0; i < 5; i++) {
+		ring.sq[i].op = ops[i];
+		ring.sq[i].args[0] = NUM_FDS;
+		ring.sq[i].user_data = i + 100;
+	}
+	ring.sq_tail = 5;
+	if (ring_drain(0) != 5 || ring.sq_head != 5 || ring.cq_tail != 5)
+		result = FAIL;
+	for (i = 0; i < 5; i++) {
+		if (ring.cq[i].user_data != i + 100 || ring.cq[i].res != res[i])
+			result = FAIL;
+	}
+	/* Completions aren't read, so only RING_ENTRIES - 5 more fit */
+	for (i = 5; i < RING_ENTRIES + 5; i++)
+		ring.sq[i & (RING_ENTRIES - 1)].op = SYS_NOP_NUM;
+	ring.sq_tail = RING_ENTRIES + 5;
+	if (ring_drain(0) != RING_ENTRIES - 5 || ring.sq_head != RING_ENTRIES || ring_drain(0) != 0)
+		result = FAIL;
+	ring.cq_head = ring.cq_tail;
+	if (ring_drain(1) != 5 || ring.sq_head != ring.sq_tail)
+		result = FAIL;
+	cur_pcb = saved;
+	return result;
+}
+
+/**
+ * @brief Syscall stats: with counting on, every nop through INT 0x80 must be
+ * counted and land in one histogram bucket; with it off nothing changes.
+ * Copying the tables into a buffer outside the user page must fail.
+ * 
+ * @return int PASS/FAIL
+ */
+int syscall_stats_test()
+{
+	static syscall_stats_t copy;
+	int result = PASS;
+	int retval;
+	int i, calls, sum;
+	uint32_t was_on = syscall_stats_on;
+
+	sysstats(SYSSTATS_RESET, NULL, 0);
+	sysstats(SYSSTATS_ON, NULL, 0);
+	for (i = 0; i < 10; i++) {
+		asm volatile (
+			"int $0x80"
+			: "=a" (retval)
+			: "a" (SYS_NOP_NUM)
+			: "memory"
+		);
+	}
+	sysstats(SYSSTATS_OFF, NULL, 0);
+	asm volatile (
+		"int $0x80"
+		: "=a" (retval)
+		: "a" (SYS_NOP_NUM)
+		: "memory"
+	);
+	calls = syscall_stats.calls[SYS_NOP_NUM];
+	for (i = sum = 0; i < SYSCALL_HIST_BUCKETS; i++)
+		sum += syscall_stats.hist[SYS_NOP_NUM][i];
+	if (calls != 10 || sum != 10)
+		result = FAIL;
+	asm volatile (
+		"int $0x80"
+		: "=a" (retval)
+		: "a" (21), "b" (SYSSTATS_GET), "c" (&copy), "d" (sizeof(copy))
+		: "memory"
+	);
+	if (retval != -1)
+		result = FAIL;
+	if (was_on)
+		sysstats(SYSSTATS_ON, NULL, 0);
+	return result;
+}
+
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Filesystem performance tests */
+#define LOOKUP_BENCH_ROUNDS 100
+
+/**
+ * @brief Check the dentry name index against the boot block: every dentry must be found by name
+ * with the same inode and type, and names that are not in the directory must fail.
+ * 
+ * @return int PASS/FAIL
+ */
+int dentry_index_test(){
+	TEST_HEADER;
+
+	int result = PASS;
+	int i;
+	dentry_t by_idx;
+	dentry_t by_name;
+	char name[MAX_FNAME_SIZE + 1];
+	/* Names that should not exist: a prefix, an extension, one that is too long and an empty one */
+	const char* missing[4] = {"she", "shell.exe", "verylargetextwithverylongname.txtt", ""};
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &by_idx);
+		strncpy(name, by_idx.fname, MAX_FNAME_SIZE);
+		name[MAX_FNAME_SIZE] = '\0';
+		if(read_dentry_by_name((uint8_t*)name, &by_name) == -1 ||
+			by_name.inode_num != by_idx.inode_num || by_name.ftype != by_idx.ftype){
+			result = FAIL;
+		}
+	}
+	for(i = 0; i < 4; i++){
+		if(read_dentry_by_name((uint8_t*)missing[i], &by_name) != -1)
+			result = FAIL;
+	}
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time name lookups through the dentry index against the old linear scan of the boot block.
+ * Every name in the directory is looked up (hits) along with the same number of names that are not there (misses).
+ * 
+ * @return none, prints the average number of cycles per lookup for each method
+ */
+void dentry_lookup_bench(){
+	TEST_HEADER;
+
+	int i, j;
+	int num_entries = get_num_dir_entries();
+	uint32_t start;
+	uint32_t scan_hit = 0, scan_miss = 0, idx_hit = 0, idx_miss = 0;
+	dentry_t dentry;
+	static char names[MAX_DENTRY_NUM][MAX_FNAME_SIZE + 1];
+	static char misses[MAX_DENTRY_NUM][MAX_FNAME_SIZE + 1];
+
+	/* Misses are the real names with the first letter changed, so they cost a full strncmp on the scan */
+	for(i = 0; i < num_entries; i++){
+		read_dentry_by_index(i, &dentry);
+		strncpy(names[i], dentry.fname, MAX_FNAME_SIZE);
+		names[i][MAX_FNAME_SIZE] = '\0';
+		strcpy(misses[i], names[i]);
+		misses[i][0] = '#';
+	}
+
+	for(j = 0; j < LOOKUP_BENCH_ROUNDS; j++){
+		for(i = 0; i < num_entries; i++){
+			start = rdtsc();
+			read_dentry_by_name_scan((uint8_t*)names[i], &dentry);
+			scan_hit += rdtsc() - start;
+			start = rdtsc();
+			read_dentry_by_name_scan((uint8_t*)misses[i], &dentry);
+			scan_miss += rdtsc() - start;
+			start = rdtsc();
+			read_dentry_by_name((uint8_t*)names[i], &dentry);
+			idx_hit += rdtsc() - start;
+			start = rdtsc();
+			read_dentry_by_name((uint8_t*)misses[i], &dentry);
+			idx_miss += rdtsc() - start;
+		}
+	}
+
+	num_entries *= LOOKUP_BENCH_ROUNDS;
+	printf("lookup cycles (hit/miss): scan %d/%d, index %d/%d\n", scan_hit / num_entries, scan_miss / num_entries,
+		idx_hit / num_entries, idx_miss / num_entries);
+}
+
+#define READ_CMP_BUF_SIZE (3 * BLOCK_SIZE)
+
+/**
+ * @brief The byte at a time read_data loop from checkpoint 2, kept here as the reference that the block copying
+ * read_data has to match byte for byte.
+ * 
+ * @return int number of bytes read
+ */
+static int read_data_bytewise(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+	int i;
+	int byte_offset = offset % BLOCK_SIZE;
+	int index_offset = offset / BLOCK_SIZE;
+	int32_t dataBlockCount = get_num_data_blocks();
+	int bytes_read = 0;
+	uint32_t bytes_max;
+	uint8_t start_flag = 0;
+
+	if(inode > get_num_inodes())
+		return 0;
+	inode_t * inodeptr = (inode_t*)((uint32_t)filesys_addr + (inode * BLOCK_SIZE) + BLOCK_SIZE);
+	bytes_max = inodeptr->length;
+
+	for(i = 0; i < length; i++){
+		if(bytes_read + offset > bytes_max)
+			return bytes_read;
+		if(inode_data_block(inodeptr, index_offset) > dataBlockCount)
+			return bytes_read;
+		if ((get_data_block(index_offset, inodeptr) + byte_offset) % BLOCK_SIZE == 0 && start_flag != 0) {
+			byte_offset = 0;
+			index_offset++;
+		}
+		buf[i] = *(uint8_t*)(get_data_block(index_offset, inodeptr) + byte_offset);
+		byte_offset++;
+		bytes_read++;
+		start_flag = 1;
+	}
+	return bytes_read;
+}
+
+/**
+ * @brief Read every regular file at offsets and lengths around block boundaries and the end of the file with both
+ * read_data and the old byte loop, and make sure the byte counts and buffers are identical.
+ * 
+ * @return int PASS/FAIL
+ */
+int read_data_regression_test(){
+	TEST_HEADER;
+
+	static uint8_t new_buf[READ_CMP_BUF_SIZE];
+	static uint8_t ref_buf[READ_CMP_BUF_SIZE];
+	int result = PASS;
+	int i, j, k, b;
+	int new_cnt, ref_cnt;
+	uint32_t len;
+	dentry_t dentry;
+	const uint32_t lengths[7] = {0, 1, 7, BLOCK_SIZE - 1, BLOCK_SIZE, BLOCK_SIZE + 1, READ_CMP_BUF_SIZE};
+	uint32_t offsets[9];
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		len = get_inode_len(dentry.inode_num);
+		offsets[0] = 0;
+		offsets[1] = 1;
+		offsets[2] = BLOCK_SIZE - 1;
+		offsets[3] = BLOCK_SIZE;
+		offsets[4] = BLOCK_SIZE + 1;
+		offsets[5] = (len > 0) ? len - 1 : 0;
+		offsets[6] = len;
+		offsets[7] = len + 1;
+		offsets[8] = len / 2;
+		for(j = 0; j < 9; j++){
+			for(k = 0; k < 7; k++){
+				/* Poison both buffers so bytes that were not written also have to match */
+				for(b = 0; b < READ_CMP_BUF_SIZE; b++){
+					new_buf[b] = 0xA5;
+					ref_buf[b] = 0xA5;
+				}
+				new_cnt = read_data(dentry.inode_num, offsets[j], new_buf, lengths[k]);
+				ref_cnt = read_data_bytewise(dentry.inode_num, offsets[j], ref_buf, lengths[k]);
+				for(b = 0; b < READ_CMP_BUF_SIZE && new_buf[b] == ref_buf[b]; b++);
+				if(new_cnt != ref_cnt || b != READ_CMP_BUF_SIZE){
+					printf("read_data mismatch: inode %d offset %d length %d (%d vs %d)\n", dentry.inode_num, offsets[j], lengths[k], new_cnt, ref_cnt);
+					result = FAIL;
+				}
+			}
+		}
+	}
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time reading every regular file front to back in 1 KB chunks (what cat does) with read_data and the old byte loop.
+ * 
+ * @return none, prints the average number of cycles per KB for each
+ */
+void read_data_bench(){
+	TEST_HEADER;
+
+	static uint8_t buf[1024];
+	int i, cnt;
+	uint32_t pos, start;
+	uint32_t kb = 0, old_cycles = 0, new_cycles = 0;
+	dentry_t dentry;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		pos = 0;
+		start = rdtsc();
+		while((cnt = read_data_bytewise(dentry.inode_num, pos, buf, 1024)) > 0)
+			pos += cnt;
+		old_cycles += rdtsc() - start;
+		pos = 0;
+		start = rdtsc();
+		while((cnt = read_data(dentry.inode_num, pos, buf, 1024)) > 0)
+			pos += cnt;
+		new_cycles += rdtsc() - start;
+		kb += pos / 1024 + 1;
+	}
+	printf("read cycles per KB: byte loop %d, block copy %d\n", old_cycles / kb, new_cycles / kb);
+}
+
+
+/**
+ * @brief Run every executable through the exec image cache twice. The first get must read the image in (miss) and the
+ * second must hand back the same prepared image (hit), with the right entry point and an exact copy of the file.
+ * Files that aren't executables must not be cached or counted.
+ * 
+ * @return int PASS/FAIL
+ */
+int exec_cache_test(){
+	TEST_HEADER;
+
+	static uint8_t file_buf[READ_CMP_BUF_SIZE];
+	int result = PASS;
+	int i, b;
+	uint32_t pos, cnt, entry;
+	dentry_t dentry;
+	exec_image_t* first;
+	exec_image_t* second;
+	exec_cache_stats_t before, after;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		exec_cache_get_stats(&before);
+		first = exec_cache_get(dentry.inode_num);
+		second = exec_cache_get(dentry.inode_num);
+		exec_cache_get_stats(&after);
+
+		read_data(dentry.inode_num, 0, file_buf, MAX_TEMP_BUF);
+		if(exec_check_header(file_buf, &entry) == -1){
+			/* Not an executable, nothing should have happened */
+			if(first != NULL || second != NULL || after.misses != before.misses || after.hits != before.hits)
+				result = FAIL;
+			continue;
+		}
+		/* Too big to cache, we just run these from the file */
+		if(first == NULL && second == NULL)
+			continue;
+
+		if(first != second || first->entry != entry || first->size != get_inode_len(dentry.inode_num) || first->refcount < 2 ||
+			after.hits != before.hits + 1 || after.misses > before.misses + 1){
+			result = FAIL;
+		}
+		for(pos = 0; pos < first->size; pos += cnt){
+			cnt = read_data(dentry.inode_num, pos, file_buf, READ_CMP_BUF_SIZE);
+			for(b = 0; b < cnt && pos + b < first->size && first->base[pos + b] == file_buf[b]; b++);
+			if(b < cnt && pos + b < first->size){
+				result = FAIL;
+				break;
+			}
+		}
+		exec_cache_put(second);
+		exec_cache_put(first);
+	}
+
+	exec_cache_get_stats(&after);
+	printf("exec cache: %d hits, %d misses, %d evictions, %d uncached\n", after.hits, after.misses, after.evictions, after.uncached);
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Swap one PDE of whatever page directory is loaded, so the tests can reach a process' user or mmap page
+ * table through it (and put the old PDE back afterwards).
+ * 
+ * @param idx PDE index, USER_IDX or MMAP_IDX
+ * @param pde Value to store
+ * @return uint32_t The PDE that was there before
+ */
+static uint32_t test_set_pde(uint32_t idx, uint32_t pde){
+	page_dir_t* dir;
+	uint32_t cr3, prev;
+
+	asm volatile("movl %%cr3, %0" : "=r" (cr3));
+	dir = (page_dir_t*)(cr3 & ADDR_MASK);
+	prev = dir->pde[idx];
+	dir->pde[idx] = pde;
+	asm volatile("movl %0, %%cr3" : : "r" (cr3) : "memory");
+	return prev;
+}
+
+/**
+ * @brief Copy on write: two processes running shell from the exec cache read its first page, which must map both of
+ * them read only onto the same cache frame. Then one of them writes to the page, which faults. The writer must end up
+ * on its own writable frame holding the image with its byte changed, while the other process and the cache still see
+ * the original bytes.
+ * 
+ * @return int PASS/FAIL
+ */
+int cow_test(){
+	TEST_HEADER;
+
+	static pcb_t pcbs[2];
+	pcb_t* saved_pcb = cur_pcb;
+	exec_image_t* image;
+	dentry_t dentry;
+	volatile uint8_t* page = (uint8_t*)LOAD_LOC;
+	uint32_t idx = (LOAD_LOC - USER_LOC) / PAGE_SIZE;
+	uint32_t shared, pte, old_pde;
+	uint8_t orig;
+	int pids[2];
+	int result = PASS;
+	int i, n, pid;
+
+	/* Two slots no process is using */
+	for(pid = MAX_PROCESS - 1, n = 0; pid >= 0 && n < 2; pid--){
+		if(!(process_pdir_table[pid].pde[USER_IDX] & PAGE_PRESENT))
+			pids[n++] = pid;
+	}
+	if(n < 2 || read_dentry_by_name((uint8_t*)"shell", &dentry) != 0)
+		return FAIL;
+	image = exec_cache_get(dentry.inode_num);
+	if(image == NULL || image->size < PAGE_SIZE){
+		exec_cache_put(image);
+		return FAIL;
+	}
+	shared = (uint32_t)image->base;
+	orig = image->base[0];
+
+	for(i = 0; i < 2; i++){
+		pcbs[i].pid = pids[i];
+		pcbs[i].exe_inode = dentry.inode_num;
+		pcbs[i].exe_size = image->size;
+		pcbs[i].exe_addr = LOAD_LOC;
+		pcbs[i].exe_image = image;
+		user_ptable[pids[i]].pte[idx] = MB_8 + (pids[i] * USER_PAGE_SIZE) + (idx * PAGE_SIZE) + USER_PTE_BITS;
+	}
+	old_pde = test_set_pde(USER_IDX, (uint32_t)&user_ptable[pids[0]] + USER_BITS + PAGE_PRESENT);
+
+	/* First touches are reads, both get the cache frame read only */
+	for(i = 0; i < 2; i++){
+		cur_pcb = &pcbs[i];
+		test_set_pde(USER_IDX, (uint32_t)&user_ptable[pids[i]] + USER_BITS + PAGE_PRESENT);
+		if(page[0] != orig)
+			result = FAIL;
+		pte = user_ptable[pids[i]].pte[idx];
+		if((pte & ADDR_MASK) != shared || !(pte & PAGE_PRESENT) || (pte & PAGE_RW))
+			result = FAIL;
+	}
+
+	/* The second process writes, that has to fault and give it its own copy */
+	page[0] = orig + 1;
+	pte = user_ptable[pids[1]].pte[idx];
+	if((pte & ADDR_MASK) == shared || !(pte & PAGE_RW) || page[0] != (uint8_t)(orig + 1))
+		result = FAIL;
+	for(n = 1; n < PAGE_SIZE && page[n] == image->base[n]; n++);
+	if(n != PAGE_SIZE || image->base[0] != orig)
+		result = FAIL;
+
+	/* The first one still reads the original through the cache frame */
+	cur_pcb = &pcbs[0];
+	test_set_pde(USER_IDX, (uint32_t)&user_ptable[pids[0]] + USER_BITS + PAGE_PRESENT);
+	pte = user_ptable[pids[0]].pte[idx];
+	if(page[0] != orig || (pte & ADDR_MASK) != shared || (pte & PAGE_RW))
+		result = FAIL;
+
+	for(i = 0; i < 2; i++)
+		user_ptable[pids[i]].pte[idx] = MB_8 + (pids[i] * USER_PAGE_SIZE) + (idx * PAGE_SIZE) + USER_PTE_BITS;
+	test_set_pde(USER_IDX, old_pde);
+	cur_pcb = saved_pcb;
+	exec_cache_put(image);
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+#define WRITE_BENCH_KB 256
+
+/**
+ * @brief Create a file and write to it: a fresh write, an overwrite in the middle that crosses a block boundary, and a
+ * write past the end that has to zero the gap. Read it back before and after flushing the buffer cache.
+ * Skipped (PASS) if the filesystem was mounted read only.
+ * 
+ * @return int PASS/FAIL
+ */
+int fs_write_test(){
+	TEST_HEADER;
+
+	static uint8_t expect[3 * BLOCK_SIZE];
+	static uint8_t got[3 * BLOCK_SIZE];
+	int result = PASS;
+	int i;
+	uint32_t len;
+	dentry_t dentry;
+
+	if(fs_create((uint8_t*)"write_test.txt") == -1 && read_dentry_by_name((uint8_t*)"write_test.txt", &dentry) == -1)
+		return PASS;
+	read_dentry_by_name((uint8_t*)"write_test.txt", &dentry);
+	if(fs_create((uint8_t*)"write_test.txt") != -1)
+		result = FAIL;
+
+	/* 5000 bytes of a pattern, then overwrite 200 bytes around the first block boundary */
+	for(i = 0; i < 5000; i++)
+		expect[i] = i % 251;
+	if(write_data(dentry.inode_num, 0, expect, 5000) != 5000)
+		result = FAIL;
+	for(i = BLOCK_SIZE - 100; i < BLOCK_SIZE + 100; i++)
+		expect[i] = 'x';
+	if(write_data(dentry.inode_num, BLOCK_SIZE - 100, expect + BLOCK_SIZE - 100, 200) != 200)
+		result = FAIL;
+	/* Start past the end, the bytes in between must read back as zeros */
+	for(i = 5000; i < 9000; i++)
+		expect[i] = 0;
+	for(i = 9000; i < 9100; i++)
+		expect[i] = 'y';
+	if(write_data(dentry.inode_num, 9000, expect + 9000, 100) != 100)
+		result = FAIL;
+
+	len = get_inode_len(dentry.inode_num);
+	if(len < 9100)
+		result = FAIL;
+	read_data(dentry.inode_num, 0, got, 9100);
+	for(i = 0; i < 9100 && got[i] == expect[i]; i++);
+	if(i != 9100)
+		result = FAIL;
+
+	fs_flush();
+	for(i = 0; i < 9100; i++)
+		got[i] = 0;
+	read_data(dentry.inode_num, 0, got, 9100);
+	for(i = 0; i < 9100 && got[i] == expect[i]; i++);
+	if(i != 9100)
+		result = FAIL;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time sequential and random 1 KB writes into a WRITE_BENCH_KB file, batching dirty blocks in the buffer cache
+ * (write back, with the flush at the end included) against writing each block through to the image.
+ * 
+ * @return none, prints the average number of cycles per KB written for each
+ */
+void fs_write_bench(){
+	TEST_HEADER;
+
+	static uint8_t buf[1024];
+	int i, mode;
+	uint32_t start, seq, rnd, rng;
+	dentry_t dentry;
+
+	if(fs_create((uint8_t*)"write_bench.dat") == -1 && read_dentry_by_name((uint8_t*)"write_bench.dat", &dentry) == -1){
+		printf("filesystem is read only\n");
+		return;
+	}
+	read_dentry_by_name((uint8_t*)"write_bench.dat", &dentry);
+	for(i = 0; i < 1024; i++)
+		buf[i] = i;
+	/* Grow the file first so both modes only time overwrites */
+	for(i = 0; i < WRITE_BENCH_KB; i++)
+		write_data(dentry.inode_num, i * 1024, buf, 1024);
+	fs_flush();
+
+	for(mode = 0; mode < 2; mode++){
+		bcache_set_writethrough(mode == 1);
+
+		start = rdtsc();
+		for(i = 0; i < WRITE_BENCH_KB; i++)
+			write_data(dentry.inode_num, i * 1024, buf, 1024);
+		fs_flush();
+		seq = rdtsc() - start;
+
+		/* Same offsets every run, a small LCG picks the KB to write */
+		rng = 1;
+		start = rdtsc();
+		for(i = 0; i < WRITE_BENCH_KB; i++){
+			rng = rng * 1103515245 + 12345;
+			write_data(dentry.inode_num, ((rng >> 16) % WRITE_BENCH_KB) * 1024, buf, 1024);
+		}
+		fs_flush();
+		rnd = rdtsc() - start;
+
+		printf("%s write cycles per KB: sequential %d, random %d\n", mode ? "write through" : "write back",
+			seq / WRITE_BENCH_KB, rnd / WRITE_BENCH_KB);
+	}
+	bcache_set_writethrough(false);
+}
+
+#define BCACHE_TEST_BLOCKS (BCACHE_SIZE + 4)
+
+/**
+ * @brief Check the buffer cache's LRU order, pinning and counters. Writing BCACHE_TEST_BLOCKS blocks of a file leaves
+ * the last BCACHE_SIZE of them cached, with block 4 least recently used. A read of a cached block is a read hit, of
+ * block 0 a read miss. With block 4 pinned, rewriting blocks 0-3 has to evict 5-8 instead, and 10 (just read) stays.
+ * Skipped (PASS) on a read only filesystem.
+ * 
+ * @return int PASS/FAIL
+ */
+int bcache_test(){
+	TEST_HEADER;
+
+	static const uint8_t name[] = "bcache_test.dat";
+	static uint8_t buf[BLOCK_SIZE];
+	dentry_t dentry;
+	inode_t* inodeptr;
+	bcache_stats_t before, after;
+	uint8_t* pinned;
+	uint32_t b, i;
+	int result = PASS;
+
+	if(read_dentry_by_name(name, &dentry) != 0 && (fs_create(name) != 0 || read_dentry_by_name(name, &dentry) != 0))
+		return PASS;
+	inodeptr = get_inode(dentry.inode_num);
+	for(b = 0; b < BCACHE_TEST_BLOCKS; b++){
+		memset(buf, b, BLOCK_SIZE);
+		if(write_data(dentry.inode_num, b * BLOCK_SIZE, buf, BLOCK_SIZE) != BLOCK_SIZE)
+			return PASS;
+	}
+	fs_flush();
+
+	bcache_get_stats(&before);
+	read_data(dentry.inode_num, 10 * BLOCK_SIZE, buf, BLOCK_SIZE);
+	for(i = 0; i < BLOCK_SIZE && buf[i] == 10; i++);
+	if(i != BLOCK_SIZE)
+		result = FAIL;
+	read_data(dentry.inode_num, 0, buf, BLOCK_SIZE);
+	for(i = 0; i < BLOCK_SIZE && buf[i] == 0; i++);
+	if(i != BLOCK_SIZE)
+		result = FAIL;
+	bcache_get_stats(&after);
+	if(after.read_hits != before.read_hits + 1 || after.read_misses != before.read_misses + 1)
+		result = FAIL;
+
+	pinned = bcache_pin(data_blk_num(inode_data_block(inodeptr, 4)));
+	if(pinned == NULL || pinned[0] != 4)
+		result = FAIL;
+	bcache_get_stats(&before);
+	for(b = 0; b < 4; b++){
+		memset(buf, b, BLOCK_SIZE);
+		write_data(dentry.inode_num, b * BLOCK_SIZE, buf, BLOCK_SIZE);
+	}
+	bcache_get_stats(&after);
+	if(after.misses != before.misses + 4 || after.evictions != before.evictions + 4)
+		result = FAIL;
+	if(bcache_lookup(data_blk_num(inode_data_block(inodeptr, 4))) != pinned ||
+	   bcache_lookup(data_blk_num(inode_data_block(inodeptr, 10))) == NULL)
+		result = FAIL;
+	for(b = 5; b <= 8; b++){
+		if(bcache_lookup(data_blk_num(inode_data_block(inodeptr, b))) != NULL)
+			result = FAIL;
+	}
+	if(pinned != NULL)
+		bcache_unpin(pinned);
+	fs_flush();
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+#define TEST_FD 2
+
+/**
+ * @brief Point a spare descriptor of a test PCB at a file, the tests can run before any process exists.
+ * 
+ * @param pcb PCB to use if there is no current process
+ * @param inode File to read
+ * @return filedesc_t* the descriptor, numbered TEST_FD
+ */
+static filedesc_t* test_fd(pcb_t* pcb, uint32_t inode){
+	filedesc_t* fdptr;
+
+	if(cur_pcb == NULL)
+		cur_pcb = pcb;
+	fdptr = syscall_getfdptr(TEST_FD);
+	fdptr->flags.in_use = 1;
+	fdptr->flags.streaming = 0;
+	fdptr->inode = inode;
+	fdptr->pos = 0;
+	return fdptr;
+}
+
+/**
+ * @brief Read every regular file with file_read in chunks of changing size and check each chunk against read_data at
+ * the same position, jumping backwards now and then to break the stream. If the filesystem is writable, also write
+ * into a file in the middle of streaming it and check the reader sees the new bytes.
+ * 
+ * @return int PASS/FAIL
+ */
+int file_stream_test(){
+	TEST_HEADER;
+
+	static uint8_t got[3 * BLOCK_SIZE];
+	static uint8_t expect[3 * BLOCK_SIZE];
+	static pcb_t test_pcb;
+	static const int chunks[] = {1, 1024, 4096, 700, 9000, 4095, 3};
+	pcb_t* saved_pcb = cur_pcb;
+	int result = PASS;
+	int i, j, b, n, want, ref;
+	uint32_t pos;
+	dentry_t dentry;
+	filedesc_t* fdptr;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		fdptr = test_fd(&test_pcb, dentry.inode_num);
+		for(j = 0, pos = 0; result == PASS; j++){
+			want = chunks[j % (sizeof(chunks) / sizeof(chunks[0]))];
+			if(want > 3 * BLOCK_SIZE)
+				want = 3 * BLOCK_SIZE;
+			/* Every 16th read goes back a bit, which isn't sequential */
+			if(j % 16 == 15 && pos > 100)
+				fdptr->pos = pos = pos - 100;
+			/* Change the file under the reader (write_test.txt comes from fs_write_test) */
+			if(j == 5 && strncmp((int8_t*)dentry.fname, "write_test.txt", MAX_FNAME_SIZE) == 0){
+				expect[0] = 'z';
+				write_data(dentry.inode_num, pos + 10, expect, 1);
+			}
+			ref = read_data(dentry.inode_num, pos, expect, want);
+			n = file_read(TEST_FD, got, want);
+			for(b = 0; b < n && got[b] == expect[b]; b++);
+			if(n != ref || b != n || fdptr->pos != pos + n){
+				printf("file_read mismatch: inode %d pos %d length %d (%d vs %d)\n", dentry.inode_num, pos, want, n, ref);
+				result = FAIL;
+			}
+			pos += n;
+			if(n == 0)
+				break;
+		}
+		fdptr->flags.in_use = 0;
+	}
+	cur_pcb = saved_pcb;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time reading every regular file front to back in 1 KB chunks through file_read (streaming) against calling
+ * read_data for every chunk, which is what file_read did before.
+ * 
+ * @return none, prints the average number of cycles per KB for each
+ */
+void file_stream_bench(){
+	TEST_HEADER;
+
+	static uint8_t buf[1024];
+	static pcb_t test_pcb;
+	pcb_t* saved_pcb = cur_pcb;
+	int i, cnt;
+	uint32_t pos, start;
+	uint32_t kb = 0, plain_cycles = 0, stream_cycles = 0;
+	dentry_t dentry;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		pos = 0;
+		start = rdtsc();
+		while((cnt = read_data(dentry.inode_num, pos, buf, 1024)) > 0)
+			pos += cnt;
+		plain_cycles += rdtsc() - start;
+		test_fd(&test_pcb, dentry.inode_num);
+		start = rdtsc();
+		while(file_read(TEST_FD, buf, 1024) > 0);
+		stream_cycles += rdtsc() - start;
+		syscall_getfdptr(TEST_FD)->flags.in_use = 0;
+		kb += pos / 1024 + 1;
+	}
+	cur_pcb = saved_pcb;
+	printf("sequential read cycles per KB: read_data %d, file_read streaming %d\n", plain_cycles / kb, stream_cycles / kb);
+}
+
+/**
+ * @brief Check every file's extent list against its inode: each block extent_find gives back has to be the one in the
+ * inode, and a run can only claim blocks that really follow each other. The per file numbers have to add up to the
+ * totals.
+ * 
+ * @return int PASS/FAIL
+ */
+int extent_test(){
+	TEST_HEADER;
+
+	int result = PASS;
+	int i;
+	uint32_t j, run, data_block, num_blocks;
+	uint32_t blocks = 0, extents = 0;
+	dentry_t dentry;
+	inode_t* inodeptr;
+	extent_stats_t stats;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2 || extent_get_stats(dentry.inode_num, &stats) == -1)
+			continue;
+		inodeptr = get_inode(dentry.inode_num);
+		num_blocks = (inodeptr->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		if(stats.blocks != num_blocks || (num_blocks > 0 && stats.extents == 0))
+			result = FAIL;
+		for(j = 0; j < stats.blocks; j++){
+			run = extent_find(dentry.inode_num, j, &data_block);
+			if(run == 0 || data_block != inode_data_block(inodeptr, j) ||
+				(run > 1 && inode_data_block(inodeptr, j + 1) != data_block + 1)){
+				printf("extent mismatch: inode %d block %d\n", dentry.inode_num, j);
+				result = FAIL;
+				break;
+			}
+		}
+		blocks += stats.blocks;
+		extents += stats.extents;
+	}
+	extent_get_stats(EXTENT_ALL_FILES, &stats);
+	if(stats.blocks != blocks || stats.extents != extents)
+		result = FAIL;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Print how every file is laid out in the image: its blocks, how many runs they are in and the longest run.
+ * 
+ * @return none
+ */
+void fs_frag_report(){
+	TEST_HEADER;
+
+	int i;
+	dentry_t dentry;
+	extent_stats_t stats;
+	int8_t name[MAX_FNAME_SIZE + 1];
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2 || extent_get_stats(dentry.inode_num, &stats) == -1 || stats.blocks == 0)
+			continue;
+		strncpy(name, (int8_t*)dentry.fname, MAX_FNAME_SIZE);
+		name[MAX_FNAME_SIZE] = '\0';
+		printf("%s: %d blocks in %d extents, longest %d\n", name, stats.blocks, stats.extents, stats.largest);
+	}
+	extent_get_stats(EXTENT_ALL_FILES, &stats);
+	printf("all files: %d blocks in %d extents, longest %d\n", stats.blocks, stats.extents, stats.largest);
+}
+
+/**
+ * @brief List the directory with getdents through a buffer that holds 3 entries and check every entry against
+ * read_dentry_by_index. A buffer too small for one entry is an error, and once everything is read we get 0.
+ * 
+ * @return int PASS/FAIL
+ */
+int dir_getdents_test(){
+	TEST_HEADER;
+
+	static pcb_t test_pcb;
+	dirent_t ents[3];
+	pcb_t* saved_pcb = cur_pcb;
+	filedesc_t* fdptr;
+	dentry_t dentry;
+	int result = PASS;
+	int i, cnt;
+	uint32_t idx = 0;
+
+	fdptr = test_fd(&test_pcb, 0);
+	fdptr->optbl = &dir_optbl;
+	if(dir_getdents(TEST_FD, ents, sizeof(dirent_t) - 1) != -1)
+		result = FAIL;
+	while((cnt = dir_getdents(TEST_FD, ents, sizeof(ents))) > 0){
+		if(cnt % sizeof(dirent_t) != 0)
+			result = FAIL;
+		for(i = 0; i < cnt / sizeof(dirent_t); i++, idx++){
+			read_dentry_by_index(idx, &dentry);
+			if(strncmp(ents[i].fname, dentry.fname, MAX_FNAME_SIZE) != 0 || ents[i].ftype != dentry.ftype ||
+				ents[i].inode_num != dentry.inode_num ||
+				ents[i].size != ((dentry.ftype == 2) ? get_inode_len(dentry.inode_num) : 0)){
+				printf("getdents mismatch at entry %d\n", idx);
+				result = FAIL;
+			}
+		}
+	}
+	if(cnt != 0 || idx != get_num_dir_entries() || dir_getdents(TEST_FD, ents, sizeof(ents)) != 0)
+		result = FAIL;
+	fdptr->flags.in_use = 0;
+	cur_pcb = saved_pcb;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Map every regular file with mmap_file and check the mapping against read_data byte for byte, and that every
+ * page is a read only user page. Then fill every mmap slot, check one more mapping fails, free one and map again,
+ * and check mmap_clear leaves nothing mapped.
+ * 
+ * @return int PASS/FAIL
+ */
+int mmap_test(){
+	TEST_HEADER;
+
+	static uint8_t expect[BLOCK_SIZE];
+	static pcb_t test_pcb;
+	pcb_t* saved_pcb = cur_pcb;
+	uint8_t* starts[MAX_MMAPS];
+	uint8_t* start;
+	dentry_t dentry;
+	int result = PASS;
+	int i, n, cnt, len;
+	uint32_t pos, b, old_pde, first_inode = 0;
+
+	cur_pcb = &test_pcb;
+	old_pde = test_set_pde(MMAP_IDX, (uint32_t)&mmap_ptable[(int)test_pcb.pid] + MMAP_PDE_BITS);
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		len = mmap_file(dentry.inode_num, &start);
+		if(len != get_inode_len(dentry.inode_num)){
+			printf("mmap of %d failed\n", dentry.inode_num);
+			result = FAIL;
+			continue;
+		}
+		if(len == 0)
+			continue;
+		if(first_inode == 0)
+			first_inode = dentry.inode_num;
+		for(b = 0; b < (len + PAGE_SIZE - 1) / PAGE_SIZE; b++){
+			if((mmap_ptable[(int)test_pcb.pid].pte[((uint32_t)start - MMAP_LOC) / PAGE_SIZE + b] & ~ADDR_MASK) != MMAP_PTE_BITS)
+				result = FAIL;
+		}
+		for(pos = 0; pos < len; pos += cnt){
+			cnt = read_data(dentry.inode_num, pos, expect, BLOCK_SIZE);
+			if(cnt > len - pos)
+				cnt = len - pos;
+			for(n = 0; n < cnt && start[pos + n] == expect[n]; n++);
+			if(n != cnt){
+				printf("mmap mismatch: inode %d offset %d\n", dentry.inode_num, pos + n);
+				result = FAIL;
+				break;
+			}
+		}
+		if(mmap_unmap(start) != 0 || mmap_unmap(start) != -1)
+			result = FAIL;
+	}
+
+	/* Fill every slot with the same file, one more has to fail */
+	for(i = 0; i < MAX_MMAPS; i++){
+		if(first_inode == 0 || mmap_file(first_inode, &starts[i]) <= 0)
+			result = FAIL;
+	}
+	if(first_inode != 0 && mmap_file(first_inode, &start) != -1)
+		result = FAIL;
+	if(mmap_unmap(starts[1]) != 0 || mmap_file(first_inode, &start) <= 0 || start != starts[1])
+		result = FAIL;
+	mmap_clear();
+	for(i = 0; i < TBL_SIZE; i++){
+		if(mmap_ptable[(int)test_pcb.pid].pte[i] != 0)
+			result = FAIL;
+	}
+	test_set_pde(MMAP_IDX, old_pde);
+	cur_pcb = saved_pcb;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time what grep does to every regular file, reading it in 1 KB chunks through file_read and looking at every
+ * byte, against mapping it with mmap_file and looking at the bytes in place.
+ * 
+ * @return none, prints the average number of cycles per KB for each
+ */
+void mmap_bench(){
+	TEST_HEADER;
+
+	static uint8_t buf[1024];
+	static pcb_t test_pcb;
+	pcb_t* saved_pcb = cur_pcb;
+	uint8_t* start;
+	dentry_t dentry;
+	int i, n, cnt, len;
+	uint32_t kb = 0, lines = 0, read_cycles = 0, mmap_cycles = 0;
+	uint32_t tsc, old_pde;
+
+	cur_pcb = &test_pcb;
+	old_pde = test_set_pde(MMAP_IDX, (uint32_t)&mmap_ptable[(int)test_pcb.pid] + MMAP_PDE_BITS);
+	for(i = 0; i < get_num_dir_entries(); i++){
+		read_dentry_by_index(i, &dentry);
+		if(dentry.ftype != 2)
+			continue;
+		test_fd(&test_pcb, dentry.inode_num);
+		tsc = rdtsc();
+		while((cnt = file_read(TEST_FD, buf, 1024)) > 0){
+			for(n = 0; n < cnt; n++)
+				lines += (buf[n] == '\n');
+		}
+		read_cycles += rdtsc() - tsc;
+		syscall_getfdptr(TEST_FD)->flags.in_use = 0;
+		tsc = rdtsc();
+		len = mmap_file(dentry.inode_num, &start);
+		for(n = 0; n < len; n++)
+			lines += (start[n] == '\n');
+		if(len > 0)
+			mmap_unmap(start);
+		mmap_cycles += rdtsc() - tsc;
+		kb += get_inode_len(dentry.inode_num) / 1024 + 1;
+	}
+	test_set_pde(MMAP_IDX, old_pde);
+	cur_pcb = saved_pcb;
+	printf("scan cycles per KB: file_read %d, mmap %d (%d lines)\n", read_cycles / kb, mmap_cycles / kb, lines / 2);
+}
+
+#define LARGE_FILE_BLOCKS (INODE_DIRECT_BLOCKS + BLOCK_PTRS + 8)
+
+/**
+ * @brief Write a file past the end of the indirect block, so it needs the double indirect block too, with every block
+ * stamped with its index. Read it back with read_data in 64 KB pieces, check the block map against the extent list,
+ * and check the free count went down by the data blocks plus the 3 indirect blocks. Skipped (PASS) on a read only or
+ * flat filesystem.
+ * 
+ * @return int PASS/FAIL
+ */
+int large_file_test(){
+	TEST_HEADER;
+
+	static const uint8_t name[] = "large_file_test";
+	static uint8_t buf[16 * BLOCK_SIZE];
+	dentry_t dentry;
+	inode_t* inodeptr;
+	int result = PASS;
+	uint32_t i, j, b, free_before, data_block, run;
+
+	if(fs_free_blocks() < LARGE_FILE_BLOCKS + 3 || inode_max_blocks() < LARGE_FILE_BLOCKS)
+		return PASS;
+	if(read_dentry_by_name(name, &dentry) == 0 || fs_create(name) != 0 || read_dentry_by_name(name, &dentry) != 0)
+		return PASS;
+	inodeptr = get_inode(dentry.inode_num);
+
+	free_before = fs_free_blocks();
+	for(b = 0; b < LARGE_FILE_BLOCKS; b++){
+		for(j = 0; j < BLOCK_SIZE / 4; j++)
+			((uint32_t*)buf)[j] = b;
+		if(write_data(dentry.inode_num, b * BLOCK_SIZE, buf, BLOCK_SIZE) != BLOCK_SIZE){
+			printf("large file write failed at block %d\n", b);
+			result = FAIL;
+			break;
+		}
+	}
+	if(inodeptr->length != LARGE_FILE_BLOCKS * BLOCK_SIZE || fs_free_blocks() != free_before - LARGE_FILE_BLOCKS - 3)
+		result = FAIL;
+
+	/* Reads come out of the buffer cache until everything is written back, check both ways */
+	for(i = 0; i < 2; i++){
+		for(b = 0; b < LARGE_FILE_BLOCKS; b += sizeof(buf) / BLOCK_SIZE){
+			read_data(dentry.inode_num, b * BLOCK_SIZE, buf, sizeof(buf));
+			for(j = 0; j < sizeof(buf) / 4 && b + j / (BLOCK_SIZE / 4) < LARGE_FILE_BLOCKS; j++){
+				if(((uint32_t*)buf)[j] != b + j / (BLOCK_SIZE / 4)){
+					printf("large file mismatch at block %d\n", b + j / (BLOCK_SIZE / 4));
+					result = FAIL;
+					break;
+				}
+			}
+		}
+		fs_flush();
+	}
+	for(b = 0; b < LARGE_FILE_BLOCKS; b++){
+		run = extent_find(dentry.inode_num, b, &data_block);
+		if(run == 0 || data_block != inode_data_block(inodeptr, b))
+			result = FAIL;
+	}
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+#define DIR_TREE_FILES 100
+
+/**
+ * @brief Build tree_test/sub with up to DIR_TREE_FILES files in it (fewer if the image runs out of inodes), each
+ * holding its own index, and look every one up by path. Checks ".." and extra slashes, that a file in the middle of a
+ * path or a missing directory fails, and that getdents on the subdirectory lists exactly what dir_entry has. Then
+ * prints the average cycles to look up a file in the subdirectory. Skipped (PASS) on a read only filesystem.
+ * 
+ * @return int PASS/FAIL
+ */
+int dir_tree_test(){
+	TEST_HEADER;
+
+	static pcb_t test_pcb;
+	static dirent_t ents[16];
+	pcb_t* saved_pcb = cur_pcb;
+	int8_t path[MAX_PATH_SIZE + 1];
+	dentry_t dentry;
+	dentry_t sub;
+	filedesc_t* fdptr;
+	int result = PASS;
+	int num_files, i, cnt;
+	uint32_t data, idx = 0, start, cycles = 0;
+
+	if(fs_mkdir((uint8_t*)"tree_test") != 0)
+		return PASS;
+	if(fs_mkdir((uint8_t*)"/tree_test/sub") != 0 || fs_mkdir((uint8_t*)"tree_test/sub") != -1 ||
+		read_dentry_by_name((uint8_t*)"tree_test//sub/", &sub) != 0 || sub.ftype != 1){
+		assertion_failure();
+		return FAIL;
+	}
+
+	for(num_files = 0; num_files < DIR_TREE_FILES; num_files++){
+		strcpy(path, "tree_test/sub/file");
+		itoa(num_files, path + strlen(path), 10);
+		if(fs_create((uint8_t*)path) != 0)
+			break;
+		read_dentry_by_name((uint8_t*)path, &dentry);
+		data = num_files;
+		if(dentry.ftype != 2 || write_data(dentry.inode_num, 0, (uint8_t*)&data, sizeof(data)) != sizeof(data))
+			result = FAIL;
+	}
+	if(dir_num_entries(sub.inode_num) != num_files || fs_create((uint8_t*)"tree_test/sub/file0") != -1)
+		result = FAIL;
+
+	for(i = 0; i < num_files; i++){
+		strcpy(path, (i % 2) ? "/tree_test/sub/file" : "tree_test/../tree_test/./sub/file");
+		itoa(i, path + strlen(path), 10);
+		start = rdtsc();
+		cnt = read_dentry_by_name((uint8_t*)path, &dentry);
+		cycles += rdtsc() - start;
+		data = -1;
+		if(cnt != 0 || read_data(dentry.inode_num, 0, (uint8_t*)&data, sizeof(data)) != sizeof(data) || data != i)
+			result = FAIL;
+	}
+	if(num_files > 0 && (read_dentry_by_name((uint8_t*)"tree_test/sub/file0/x", &dentry) != -1 ||
+		fs_create((uint8_t*)"tree_test/sub/file0/x") != -1))
+		result = FAIL;
+	if(read_dentry_by_name((uint8_t*)"tree_test/nothing/file0", &dentry) != -1 ||
+		fs_create((uint8_t*)"tree_test/nothing/file0") != -1 || read_dentry_by_name((uint8_t*)"", &dentry) != -1)
+		result = FAIL;
+	/* ".." at the root stays at the root */
+	if(read_dentry_by_name((uint8_t*)"../tree_test/sub", &dentry) != 0 || dentry.inode_num != sub.inode_num)
+		result = FAIL;
+
+	fdptr = test_fd(&test_pcb, sub.inode_num);
+	fdptr->optbl = &dir_optbl;
+	while((cnt = dir_getdents(TEST_FD, ents, sizeof(ents))) > 0){
+		for(i = 0; i < cnt / sizeof(dirent_t); i++, idx++){
+			dir_entry(sub.inode_num, idx, &dentry);
+			if(strncmp(ents[i].fname, dentry.fname, MAX_FNAME_SIZE) != 0 || ents[i].inode_num != dentry.inode_num)
+				result = FAIL;
+		}
+	}
+	if(cnt != 0 || idx != num_files)
+		result = FAIL;
+	fdptr->flags.in_use = 0;
+	cur_pcb = saved_pcb;
+
+	if(num_files > 0)
+		printf("%d files in tree_test/sub, %d cycles per path lookup\n", num_files, cycles / num_files);
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+#define COMPRESS_WINDOW (4 * BLOCK_SIZE)
+#define COMPRESS_PIECE 1000
+
+/**
+ * @brief Check lz_decompress on a hand made block (literals, a match that overlaps itself, a literal only last
+ * sequence) and on broken ones. Then read every compressed file in the root in COMPRESS_WINDOW pieces (whole chunks,
+ * decompressed straight into the buffer) and again in COMPRESS_PIECE byte pieces (through the chunk cache) and check
+ * they match, and that compressed files can't be written or mapped. Prints the cycles per KB of the small reads.
+ * 
+ * @return int PASS/FAIL
+ */
+int compress_test(){
+	TEST_HEADER;
+
+	/* "abc", then 5 bytes from 3 back ("abcab"), then "x" */
+	static uint8_t block[] = {0x31, 'a', 'b', 'c', 3, 0, 0x10, 'x'};
+	static uint8_t window[COMPRESS_WINDOW + 1];
+	static uint8_t pieces[COMPRESS_WINDOW + COMPRESS_PIECE];
+	uint8_t out[16];
+	uint8_t* start;
+	dentry_t dentry;
+	compress_stats_t stats;
+	int result = PASS;
+	int i, files = 0;
+	uint32_t size, pos, j, got, cycles = 0, kb = 0, t;
+
+	if(lz_decompress(block, sizeof(block), out, sizeof(out)) != 9 || strncmp((int8_t*)out, "abcabcabx", 9) != 0)
+		result = FAIL;
+	/* Cut off in the offset, no room for the output, offset before the start */
+	if(lz_decompress(block, 5, out, sizeof(out)) != -1 || lz_decompress(block, sizeof(block), out, 8) != -1)
+		result = FAIL;
+	block[4] = 4;
+	if(lz_decompress(block, sizeof(block), out, sizeof(out)) != -1)
+		result = FAIL;
+	block[4] = 3;
+
+	for(i = 0; i < get_num_dir_entries(); i++){
+		if(read_dentry_by_index(i, &dentry) != 0 || dentry.ftype != 2 || !(get_inode(dentry.inode_num)->length & INODE_COMPRESSED))
+			continue;
+		files++;
+		size = get_inode_len(dentry.inode_num);
+		for(pos = 0; pos < size; pos += COMPRESS_WINDOW){
+			got = read_data(dentry.inode_num, pos, window, COMPRESS_WINDOW);
+			t = rdtsc();
+			for(j = 0; j < got; j += COMPRESS_PIECE)
+				read_data(dentry.inode_num, pos + j, pieces + j, COMPRESS_PIECE);
+			cycles += rdtsc() - t;
+			for(j = 0; j < got && window[j] == pieces[j]; j++);
+			/* Past the end of the file there is the one extra byte read_data always gives, and nothing after it */
+			if(got != ((size - pos < COMPRESS_WINDOW) ? size - pos + 1 : COMPRESS_WINDOW) || j != got){
+				printf("compressed read mismatch in %d at %d\n", dentry.inode_num, pos);
+				result = FAIL;
+			}
+		}
+		kb += size / 1024;
+		if(write_data(dentry.inode_num, 0, block, 1) != -1 || mmap_file(dentry.inode_num, &start) != -1)
+			result = FAIL;
+	}
+
+	if(files > 0){
+		compress_get_stats(&stats);
+		printf("%d compressed files, %d cycles per KB in %d byte reads, chunk cache %d hits %d misses %d whole\n", files,
+			(kb > 0) ? cycles / kb : 0, COMPRESS_PIECE, stats.hits, stats.misses, stats.direct);
+	}
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+#define ATA_TEST_BLOCKS 16
+#define ATA_BENCH_BLOCKS 256
+
+/**
+ * @brief Read the first ATA_TEST_BLOCKS blocks of the disk with PIO and with DMA and check they match, check a read
+ * past the end fails, and send a pattern through the last block of the disk both ways (writing with one mode, reading
+ * with the other) before putting the block back. Skipped (PASS) if there is no disk or no bus master.
+ * 
+ * @return int PASS/FAIL
+ */
+int ata_test(){
+	TEST_HEADER;
+
+	static uint8_t pio[ATA_TEST_BLOCKS * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+	static uint8_t dma[ATA_TEST_BLOCKS * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+	static uint8_t saved[BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+	uint32_t mode = ata_get_mode();
+	uint32_t last = ata_blkdev.nblocks - 1;
+	int result = PASS;
+	int i, pass;
+
+	if(ata_blkdev.nblocks < ATA_TEST_BLOCKS || ata_set_mode(ATA_MODE_DMA) == -1)
+		return PASS;
+
+	ata_set_mode(ATA_MODE_PIO);
+	if(ata_blkdev.read_many(0, ATA_TEST_BLOCKS, pio) != 0)
+		result = FAIL;
+	ata_set_mode(ATA_MODE_DMA);
+	if(ata_blkdev.read_many(0, ATA_TEST_BLOCKS, dma) != 0)
+		result = FAIL;
+	for(i = 0; i < ATA_TEST_BLOCKS * BLOCK_SIZE && pio[i] == dma[i]; i++);
+	if(i != ATA_TEST_BLOCKS * BLOCK_SIZE)
+		result = FAIL;
+	if(ata_read(ata_num_sectors() - 1, 2, pio) != -1 || ata_blkdev.read(ata_blkdev.nblocks, pio) != -1)
+		result = FAIL;
+
+	if(ata_blkdev.read(last, saved) != 0)
+		result = FAIL;
+	for(pass = 0; pass < 2 && result == PASS; pass++){
+		for(i = 0; i < BLOCK_SIZE; i++)
+			pio[i] = (uint8_t)(i * 7 + pass);
+		ata_set_mode(pass ? ATA_MODE_DMA : ATA_MODE_PIO);
+		if(ata_blkdev.write(last, pio) != 0)
+			result = FAIL;
+		ata_set_mode(pass ? ATA_MODE_PIO : ATA_MODE_DMA);
+		if(ata_blkdev.read(last, dma) != 0)
+			result = FAIL;
+		for(i = 0; i < BLOCK_SIZE && pio[i] == dma[i]; i++);
+		if(i != BLOCK_SIZE)
+			result = FAIL;
+	}
+	if(ata_blkdev.write(last, saved) != 0)
+		result = FAIL;
+	ata_set_mode(mode);
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time reading the first ATA_BENCH_BLOCKS blocks of the disk (or all of it, if it is smaller) with PIO and with
+ * DMA, ATA_TEST_BLOCKS blocks per call. With PIO the CPU moves every word itself, with DMA it only sets up the
+ * transfer and waits for the interrupt, and that wait is time other tasks can have.
+ * 
+ * @return none, prints the cycles per KB for each mode and how many times the transfers slept waiting for IRQ 14
+ */
+void ata_bench(){
+	TEST_HEADER;
+
+	static uint8_t buf[ATA_TEST_BLOCKS * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+	uint32_t mode = ata_get_mode();
+	uint32_t blocks = (ata_blkdev.nblocks < ATA_BENCH_BLOCKS) ? ata_blkdev.nblocks : ATA_BENCH_BLOCKS;
+	uint32_t cycles[2], sleeps[2];
+	uint32_t b, t, m;
+	ata_stats_t stats;
+
+	blocks -= blocks % ATA_TEST_BLOCKS;
+	if(blocks == 0 || ata_set_mode(ATA_MODE_DMA) == -1){
+		printf("no disk to time\n");
+		return;
+	}
+	for(m = ATA_MODE_PIO; m <= ATA_MODE_DMA; m++){
+		ata_set_mode(m);
+		ata_get_stats(&stats);
+		sleeps[m] = stats.sleeps;
+		t = rdtsc();
+		for(b = 0; b < blocks; b += ATA_TEST_BLOCKS)
+			ata_blkdev.read_many(b, ATA_TEST_BLOCKS, buf);
+		cycles[m] = rdtsc() - t;
+		ata_get_stats(&stats);
+		sleeps[m] = stats.sleeps - sleeps[m];
+	}
+	ata_set_mode(mode);
+	printf("disk read of %d KB, cycles per KB: PIO %d, DMA %d (%d and %d sleeps waiting for IRQ 14)\n",
+		blocks * BLOCK_SIZE / 1024, cycles[0] / (blocks * BLOCK_SIZE / 1024), cycles[1] / (blocks * BLOCK_SIZE / 1024),
+		sleeps[0], sleeps[1]);
+}
+
+#define BLK_SIM_BLOCKS 128
+#define BLK_STREAMS 8
+#define BLK_STREAM_BLOCKS 8
+#define BLK_OP_COST 20000
+#define BLK_SEEK_COST 200
+
+static uint8_t blk_sim_mem[BLK_SIM_BLOCKS * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static uint8_t blk_dst[BLK_STREAMS * BLK_STREAM_BLOCKS * BLOCK_SIZE] __attribute__((aligned (BLOCK_SIZE)));
+static blk_queue_t blk_test_queue;
+static blk_request_t blk_reqs[BLK_STREAMS * BLK_STREAM_BLOCKS];
+static uint32_t blk_done_order[BLK_STREAMS * BLK_STREAM_BLOCKS];
+static uint32_t blk_done_count, blk_done_failed;
+
+/**
+ * @brief Completion callback for the block layer tests, records the order requests finished in
+ * 
+ * @param req the request
+ * @param status 0 on success, -1 on failure
+ */
+static void blk_test_done(blk_request_t* req, int32_t status){
+	if(blk_done_count < BLK_STREAMS * BLK_STREAM_BLOCKS)
+		blk_done_order[blk_done_count] = req->blk;
+	blk_done_count++;
+	if(status != 0)
+		blk_done_failed++;
+}
+
+/**
+ * @brief Fill in and submit one single block request of the block layer tests
+ * 
+ * @param i index in blk_reqs
+ * @param blk block number
+ * @param buf buffer for the block
+ * @param write true to write
+ */
+static void blk_test_submit(uint32_t i, uint32_t blk, uint8_t* buf, bool write){
+	blk_reqs[i].blk = blk;
+	blk_reqs[i].count = 1;
+	blk_reqs[i].buf = buf;
+	blk_reqs[i].write = write;
+	blk_reqs[i].done = blk_test_done;
+	blk_submit(&blk_test_queue, &blk_reqs[i]);
+}
+
+/**
+ * @brief Check the block layer on the simulated device: the elevator sends requests out going up from the last op and
+ * then back around, FIFO keeps the order they came in, consecutive blocks are merged into one op (in separate buffers
+ * too) but reads and writes are not, the data ends up in the right buffers and a failed op fails only its own requests
+ * 
+ * @return PASS or FAIL
+ */
+int blk_test(){
+	TEST_HEADER;
+
+	static const uint32_t blocks[6] = {40, 10, 11, 12, 41, 5};
+	static const uint32_t sorted[6] = {5, 10, 11, 12, 40, 41};
+	uint32_t i, j;
+	blk_stats_t stats;
+	int result = PASS;
+
+	for(i = 0; i < BLK_SIM_BLOCKS * BLOCK_SIZE; i++)
+		blk_sim_mem[i] = (uint8_t)(i * 7 + i / BLOCK_SIZE);
+	blk_sim_init(blk_sim_mem, BLK_SIM_BLOCKS, 0, 0);
+
+	/* Elevator, merging 10-12 and 40-41 */
+	blk_queue_init(&blk_test_queue, &blk_simdev);
+	blk_done_count = blk_done_failed = 0;
+	for(i = 0; i < 6; i++)
+		blk_test_submit(i, blocks[i], blk_dst + i * BLOCK_SIZE, false);
+	if(blk_unplug(&blk_test_queue) != 0 || blk_done_count != 6 || blk_done_failed != 0)
+		result = FAIL;
+	for(i = 0; i < 6 && result == PASS; i++){
+		if(blk_done_order[i] != sorted[i])
+			result = FAIL;
+		for(j = 0; j < BLOCK_SIZE; j++){
+			if(blk_dst[i * BLOCK_SIZE + j] != blk_sim_mem[blocks[i] * BLOCK_SIZE + j])
+				result = FAIL;
+		}
+	}
+	blk_get_stats(&blk_test_queue, &stats);
+	if(stats.submitted != 6 || stats.ops != 3 || stats.merged != 3 || stats.blocks != 6)
+		result = FAIL;
+
+	/* The last op ended at 42, so 50 and 60 go before 3 */
+	blk_done_count = 0;
+	blk_test_submit(0, 3, blk_dst, false);
+	blk_test_submit(1, 60, blk_dst, false);
+	blk_test_submit(2, 50, blk_dst, false);
+	blk_unplug(&blk_test_queue);
+	if(blk_done_order[0] != 50 || blk_done_order[1] != 60 || blk_done_order[2] != 3)
+		result = FAIL;
+
+	/* FIFO without merging */
+	blk_set_sched(&blk_test_queue, BLK_SCHED_FIFO, false);
+	blk_done_count = 0;
+	for(i = 0; i < 6; i++)
+		blk_test_submit(i, blocks[i], blk_dst + i * BLOCK_SIZE, false);
+	blk_unplug(&blk_test_queue);
+	for(i = 0; i < 6; i++){
+		if(blk_done_order[i] != blocks[i])
+			result = FAIL;
+	}
+
+	/* Writes to 100-103 in reversed buffers, 102 is a read so nothing merges across it */
+	blk_queue_init(&blk_test_queue, &blk_simdev);
+	for(i = 0; i < 4; i++){
+		memset(blk_dst + i * BLOCK_SIZE, 0xA0 + i, BLOCK_SIZE);
+		blk_test_submit(i, 100 + i, blk_dst + (3 - i) * BLOCK_SIZE, i != 2);
+	}
+	blk_unplug(&blk_test_queue);
+	blk_get_stats(&blk_test_queue, &stats);
+	if(stats.ops != 3 || blk_sim_mem[100 * BLOCK_SIZE] != 0xA3 || blk_sim_mem[101 * BLOCK_SIZE] != 0xA2 ||
+	   blk_sim_mem[103 * BLOCK_SIZE] != 0xA0 || blk_dst[BLOCK_SIZE] != blk_sim_mem[102 * BLOCK_SIZE])
+		result = FAIL;
+
+	/* Off the end of the device */
+	blk_done_count = blk_done_failed = 0;
+	blk_reqs[0].blk = BLK_SIM_BLOCKS - 1;
+	blk_reqs[0].count = 2;
+	blk_reqs[0].buf = blk_dst;
+	blk_reqs[0].write = false;
+	blk_reqs[0].done = blk_test_done;
+	blk_submit(&blk_test_queue, &blk_reqs[0]);
+	blk_test_submit(1, 10, blk_dst + 2 * BLOCK_SIZE, false);
+	if(blk_unplug(&blk_test_queue) != 1 || blk_done_count != 2 || blk_done_failed != 1)
+		result = FAIL;
+	if(blk_rw(&blk_test_queue, BLK_SIM_BLOCKS, 1, blk_dst, false) != -1 ||
+	   blk_rw(&blk_test_queue, 30, 3, blk_dst, false) != 0 || blk_dst[BLOCK_SIZE] != blk_sim_mem[31 * BLOCK_SIZE])
+		result = FAIL;
+
+	if(result == FAIL)
+		assertion_failure();
+	return result;
+}
+
+/**
+ * @brief Time the block layer on the simulated device (BLK_OP_COST cycles per op plus BLK_SEEK_COST per block
+ * between ops). BLK_STREAMS readers each want BLK_STREAM_BLOCKS consecutive blocks from their own part of the device,
+ * and their requests come in interleaved (one block from each in turn), the way they would from tasks taking turns.
+ * FIFO without merging does what they asked in that order, the elevator with merging gets it down to one op per stream
+ * in a single sweep.
+ * 
+ * @return none, prints ops, blocks seeked and simulated and real cycles for every scheduler and merge setting
+ */
+void blk_bench(){
+	TEST_HEADER;
+
+	static const char* names[2] = {"FIFO", "elevator"};
+	uint32_t sched, merge, s, k, i, t, sim;
+	blk_stats_t stats;
+
+	for(sched = BLK_SCHED_FIFO; sched <= BLK_SCHED_ELEVATOR; sched++){
+		for(merge = 0; merge < 2; merge++){
+			blk_sim_init(blk_sim_mem, BLK_SIM_BLOCKS, BLK_OP_COST, BLK_SEEK_COST);
+			blk_queue_init(&blk_test_queue, &blk_simdev);
+			blk_set_sched(&blk_test_queue, sched, merge);
+			t = rdtsc();
+			for(k = 0, i = 0; k < BLK_STREAM_BLOCKS; k++){
+				for(s = 0; s < BLK_STREAMS; s++, i++){
+					blk_test_submit(i, s * (BLK_SIM_BLOCKS / BLK_STREAMS) + k,
+						blk_dst + (s * BLK_STREAM_BLOCKS + k) * BLOCK_SIZE, false);
+				}
+			}
+			blk_unplug(&blk_test_queue);
+			t = rdtsc() - t;
+			sim = blk_sim_cycles();
+			blk_get_stats(&blk_test_queue, &stats);
+			printf("%s, merging %s: %d ops, seek %d blocks, %d simulated cycles, %d cycles\n", names[sched],
+				merge ? "on" : "off", stats.ops, stats.seek, sim, t);
+		}
+	}
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -698,6 +2600,7 @@ void launch_tests(){
 	TEST_OUTPUT("page_init_test", page_init_test());
 	TEST_OUTPUT("kernel_pg_access_test", kernel_pg_access_test());
 	TEST_OUTPUT("vmem_pg_access_test",vmem_pg_access_test());
+	TEST_OUTPUT("user_ptable_test", user_ptable_test());
 	printf("Press RETURN to continue...");
 	console_getchar(&garbage);
 	console_clrsc();
@@ -753,11 +2656,43 @@ void launch_tests(){
 	printf("[TEST BAT 4: RTC]\n");
 	// TEST_OUTPUT("rtc_test", rtc_test());
 	TEST_OUTPUT("rtc_garbage_test", rtc_garbage_test());
+	TEST_OUTPUT("rtc_wait_test", rtc_wait_test());
+	TEST_OUTPUT("run_queue_test", run_queue_test());
+	TEST_OUTPUT("sched_class_test", sched_class_test());
+	TEST_OUTPUT("sched_latency_test", sched_latency_test());
 	TEST_OUTPUT("test_exec_stuff",exec_elf_check_test());
 
 	printf("[TEST BAT 5: SYSTEM CALLS]\n");
 	TEST_OUTPUT("syscall_invalid_test", syscall_invalid_test());
 	TEST_OUTPUT("syscall_null_test", syscall_null_test());
 	TEST_OUTPUT("syscall_functions_test", syscall_functions_test());
+	TEST_OUTPUT("syscall_nop_test", syscall_nop_test());
+	TEST_OUTPUT("syscall_iov_test", syscall_iov_test());
+	TEST_OUTPUT("syscall_ring_test", syscall_ring_test());
+	TEST_OUTPUT("syscall_stats_test", syscall_stats_test());
+	printf("[TEST BAT 6: FILESYSTEM PERFORMANCE]\n");
+	TEST_OUTPUT("dentry_index_test", dentry_index_test());
+	dentry_lookup_bench();
+	TEST_OUTPUT("read_data_regression_test", read_data_regression_test());
+	read_data_bench();
+	TEST_OUTPUT("exec_cache_test", exec_cache_test());
+	TEST_OUTPUT("cow_test", cow_test());
+	TEST_OUTPUT("fs_write_test", fs_write_test());
+	fs_write_bench();
+	TEST_OUTPUT("bcache_test", bcache_test());
+	TEST_OUTPUT("file_stream_test", file_stream_test());
+	file_stream_bench();
+	TEST_OUTPUT("extent_test", extent_test());
+	fs_frag_report();
+	TEST_OUTPUT("dir_getdents_test", dir_getdents_test());
+	TEST_OUTPUT("mmap_test", mmap_test());
+	mmap_bench();
+	TEST_OUTPUT("large_file_test", large_file_test());
+	TEST_OUTPUT("dir_tree_test", dir_tree_test());
+	TEST_OUTPUT("compress_test", compress_test());
+	TEST_OUTPUT("ata_test", ata_test());
+	ata_bench();
+	TEST_OUTPUT("blk_test", blk_test());
+	blk_bench();
 	printf("[TESTS COMPLETE]\n");
 }
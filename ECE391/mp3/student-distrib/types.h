@@ -32,8 +32,10 @@ typedef uint32_t size_t;
 #define BLOCK_SIZE 4096     /* The file system is divided into 4 KB blocks */
 #define MAX_DENTRY_NUM 63   /* There can be up to 63 directory entries */
 #define MAX_FNAME_SIZE 32   /* File names are up to 32 chars */
+#define MAX_PATH_SIZE 128   /* Paths (names joined with '/') are up to 128 chars, as long as a command line */
 #define DENTRY_SIZE 0x40    /* Size in bytes of directory entries */
 #define MAX_OPEN_FILES 8    /* Max number of files open at once */
+#define MAX_MMAPS 8         /* Max number of files a process can have mapped at once */
 
 typedef struct dentry {
     char        fname[MAX_FNAME_SIZE];
@@ -50,9 +52,18 @@ typedef struct inode {
     uint32_t data_blocks[1023]; // This is the max number of datablocks in each inode
 } inode_t;
 
+/* One directory entry as the getdents system call hands it to user programs, packed back to back in their buffer */
+typedef struct dirent {
+    char        fname[MAX_FNAME_SIZE];  /* Null terminated unless it is MAX_FNAME_SIZE chars long, like in a dentry */
+    uint32_t    ftype;                  /* 0 rtc, 1 directory, 2 regular file */
+    uint32_t    inode_num;
+    uint32_t    size;                   /* Length in bytes of a regular file, 0 for anything else */
+} dirent_t;
+
 typedef struct fd_flags {
     bool in_use         :   1;
-    int  pad1           :   31; // If you add more fields make this smaller
+    bool streaming      :   1;  // The stream fields in filedesc_t are valid (see file_read)
+    int  pad1           :   30; // If you add more fields make this smaller
 } fd_flags_t;
 
 typedef struct file_optbl {
@@ -67,8 +78,30 @@ typedef struct filedesc {
     uint32_t inode;
     uint32_t pos;
     fd_flags_t flags;
+    /* Streaming state for sequential file reads, only valid while flags.streaming is set */
+    uint32_t stream_pos;        /* File position the window starts at, a read from anywhere else is not sequential */
+    uint8_t* stream_ptr;        /* Address of the byte at stream_pos */
+    uint32_t stream_left;       /* Bytes left in the window: the rest of a run of contiguous blocks read ahead */
+    uint32_t stream_gen;        /* Buffer cache generation the window was set up in, see bcache_generation */
 } filedesc_t;
 
+/* A prepared executable in the exec image cache (see execcache.c) */
+typedef struct exec_image {
+    uint32_t    inode;          /* Inode of the executable this image was read from */
+    uint32_t    size;           /* Size in bytes of the executable */
+    uint32_t    entry;          /* Entry point, already pulled out of the ELF header */
+    uint8_t*    base;           /* Start of the contiguous copy of the file (page aligned) */
+    uint32_t    refcount;       /* Number of processes running from this image, can't be evicted while non-zero */
+    uint32_t    last_used;      /* Cache tick of the last execute() of this image, for LRU eviction */
+    bool        valid;          /* Slot holds a complete image */
+} exec_image_t;
+
+/* A file mapped into a process' mmap region (see mmap_file), pages == 0 if the slot is free */
+typedef struct mmap_area {
+    uint32_t    idx;            /* Index of the first page in the process' mmap page table */
+    uint32_t    pages;          /* Number of pages mapped */
+} mmap_area_t;
+
 /* Structure for the Process Control block */
 typedef struct pcb{
     filedesc_t  file_array[MAX_OPEN_FILES];     /* File array for file descriptor info for current process */
@@ -80,6 +113,12 @@ typedef struct pcb{
     char        args[128];                      /* Buffer of arguments, 128 because that is max kbdr buffer size */
     bool        vidmap_check;                   /* Var to check if current process has called vidmap, so halt can teardown user vidmapping */
     int con;                                    /* Pointer to the console this process should read from and write to. */
+    uint32_t    exe_inode;                      /* Inode of the executable, user pages are filled from it on first touch */
+    uint32_t    exe_size;                       /* Size in bytes of the executable */
+    uint32_t    exe_addr;                       /* Virtual address the executable is loaded at */
+    exec_image_t* exe_image;                    /* Cached image the pages are filled from, NULL to read them from the file */
+    mmap_area_t mmaps[MAX_MMAPS];               /* Files mapped with mmap, halt unmaps whatever is left */
+    struct sysring* ring;                       /* Syscall ring registered with ring_setup, NULL if none */
 } pcb_t;
 
 /* Fastcall macro */
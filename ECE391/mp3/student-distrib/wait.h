@@ -0,0 +1,32 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+#include "types.h"
+#include "lib.h"
+
+/* Wait queues. A task that has to wait for an interrupt (a finished line from the keyboard, an RTC tick) sleeps on a
+ * queue instead of spinning through its time slices: it is marked waiting, the scheduler skips it, and the interrupt
+ * handler wakes everything on the queue. When no task can run, the sleeping task idles with hlt. */
+typedef struct wait_queue {
+    volatile uint32_t pids;     /* Bit per process sleeping on the queue */
+    bool boost;                 /* Tasks woken from this queue get the interactive boost (see wq_wake_all) */
+} wait_queue_t;
+
+/* Sleep on wq until the next wq_wake_all (or any interrupt, when there is no task to put to sleep). Call with
+ * interrupts off, returns with them off. */
+void wq_sleep(wait_queue_t* wq);
+/* Make every task sleeping on wq runnable again */
+void wq_wake_all(wait_queue_t* wq);
+
+/* Sleep on wq until cond is true. cond is checked with interrupts off, so a wakeup can't come in between the check
+ * and going to sleep. */
+#define wait_event(wq, cond)            \
+do {                                    \
+    uint32_t wait_flags;                \
+    cli_and_save(wait_flags);           \
+    while (!(cond))                     \
+        wq_sleep(wq);                   \
+    restore_flags(wait_flags);          \
+} while (0)
+
+#endif
@@ -2,22 +2,106 @@
 
 #include "ece391support.h"
 #include "ece391syscall.h"
+#include "ece391sysnum.h"
+
+#define RING_BUFS 16
+
+/* cat -m file: map the file with mmap and write it out from there */
+int32_t
+cat_mapped (int32_t fd)
+{
+    int32_t len;
+    uint8_t* start;
+
+    if (-1 == (len = ece391_mmap (fd, &start))) {
+        ece391_fdputs (1, (uint8_t*)"file map failed\n");
+	return 3;
+    }
+    if (0 == len)
+        return 0;
+    if (-1 == ece391_write (1, start, len))
+        return 3;
+    ece391_munmap (start);
+    return 0;
+}
+
+/*
+ * cat -r file: read and write through a syscall ring.  Each trap writes out
+ * what the last one read and reads the next RING_BUFS blocks, instead of
+ * one trap per read and one per write.
+ */
+int32_t
+cat_ring (int32_t fd)
+{
+    static ece391_ring_t ring;
+    static uint8_t bufs[RING_BUFS][1024];
+    ece391_ring_cqe_t cqe;
+    int32_t i, queued, full;
+
+    if (-1 == ece391_ring_setup (&ring)) {
+        ece391_fdputs (1, (uint8_t*)"ring setup failed\n");
+	return 3;
+    }
+    /* user_data is the buffer number for reads, RING_BUFS more than it for writes */
+    for (i = 0; i < RING_BUFS; i++)
+        ece391_ring_push (&ring, SYS_READ, fd, (int32_t)bufs[i], 1024, i);
+    for (queued = RING_BUFS; 0 != queued; ) {
+        if (-1 == ece391_ring_enter ())
+	    return 3;
+	queued = full = 0;
+	while (ece391_ring_pop (&ring, &cqe)) {
+	    if (-1 == cqe.res) {
+	        ece391_fdputs (1, (uint8_t*)"file read failed\n");
+		return 3;
+	    }
+	    if (cqe.user_data >= RING_BUFS || 0 == cqe.res)
+	        continue;
+	    ece391_ring_push (&ring, SYS_WRITE, 1, (int32_t)bufs[cqe.user_data], cqe.res, RING_BUFS + cqe.user_data);
+	    queued++;
+	    if (1024 == cqe.res)
+	        full++;
+	}
+	/* Every buffer came back full, so there may be more; the reads go after the writes of the same buffers */
+	if (RING_BUFS == full) {
+	    for (i = 0; i < RING_BUFS; i++)
+	        ece391_ring_push (&ring, SYS_READ, fd, (int32_t)bufs[i], 1024, i);
+	    queued += RING_BUFS;
+	}
+    }
+    ece391_ring_setup (0);
+    return 0;
+}
 
 int main ()
 {
     int32_t fd, cnt;
     uint8_t buf[1024];
+    uint8_t* fname = buf;
+    int32_t mapped = 0;
+    int32_t ring = 0;
 
     if (0 != ece391_getargs (buf, 1024)) {
         ece391_fdputs (1, (uint8_t*)"could not read arguments\n");
 	return 3;
     }
+    if ('-' == buf[0] && 'm' == buf[1] && ' ' == buf[2]) {
+        mapped = 1;
+	fname = buf + 3;
+    } else if ('-' == buf[0] && 'r' == buf[1] && ' ' == buf[2]) {
+        ring = 1;
+	fname = buf + 3;
+    }
 
-    if (-1 == (fd = ece391_open (buf))) {
+    if (-1 == (fd = ece391_open (fname))) {
         ece391_fdputs (1, (uint8_t*)"file not found\n");
 	return 2;
     }
 
+    if (mapped)
+        return cat_mapped (fd);
+    if (ring)
+        return cat_ring (fd);
+
     while (0 != (cnt = ece391_read (fd, buf, 1024))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
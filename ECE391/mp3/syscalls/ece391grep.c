@@ -4,15 +4,17 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
-#define SBUFSIZE 33
+#define NUM_DENTS 16
 
 int32_t
 do_one_file (const char* s, const char* fname) 
 {
     int32_t fd, cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
+    const uint8_t* match[4] = {0, (uint8_t*)":", 0, (uint8_t*)"\n"};	/* fname, ":", the line, "\n" */
 
     s_len = ece391_strlen ((uint8_t*)s);
+    match[0] = (uint8_t*)fname;
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
@@ -42,10 +44,8 @@ do_one_file (const char* s, const char* fname)
 	    for (check = line_start; check < line_end; check++) {
 		if (s[0] == data[check] && 
 		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
-		    ece391_fdputs (1, data + line_start);
-		    ece391_fdputs (1, (uint8_t*)"\n");
+		    match[2] = data + line_start;
+		    ece391_fdputsv (1, match, 4);
 		    break;
 		}
 	    }
@@ -65,32 +65,89 @@ do_one_file (const char* s, const char* fname)
     return 0;
 }
 
+/* grep -m: search the file in place through mmap instead of reading it into a buffer */
+int32_t
+do_one_file_mapped (const char* s, const char* fname)
+{
+    int32_t fd, len, line_start, line_end, check, i, s_len;
+    uint8_t* data;
+    ece391_iovec_t iov[4];	/* fname, ":", the line, "\n" */
+
+    s_len = ece391_strlen ((uint8_t*)s);
+    ece391_iovec_set (&iov[0], fname, ece391_strlen ((uint8_t*)fname));
+    ece391_iovec_set (&iov[1], ":", 1);
+    ece391_iovec_set (&iov[3], "\n", 1);
+    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
+        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+        return -1;
+    }
+    if (-1 == (len = ece391_mmap (fd, &data))) {
+        ece391_fdputs (1, (uint8_t*)"file map failed\n");
+        return -1;
+    }
+    for (line_start = 0; line_start < len; line_start = line_end + 1) {
+        line_end = line_start;
+	while (line_end < len && '\n' != data[line_end])
+	    line_end++;
+	/* the file isn't null terminated, so stop comparing at the end of the line */
+	for (check = line_start; check + s_len <= line_end; check++) {
+	    for (i = 0; i < s_len && s[i] == data[check + i]; i++);
+	    if (i == s_len) {
+		ece391_iovec_set (&iov[2], data + line_start, line_end - line_start);
+		ece391_writev (1, iov, 4);
+		break;
+	    }
+	}
+    }
+    if (0 != len)
+        ece391_munmap (data);
+    if (-1 == ece391_close (fd)) {
+        ece391_fdputs (1, (uint8_t*)"file close failed\n");
+        return -1;
+    }
+    return 0;
+}
+
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i, len;
+    ece391_dirent_t dents[NUM_DENTS];
+    uint8_t buf[ECE391_NAME_LEN + 1];
     uint8_t search[BUFSIZE];
+    uint8_t* pattern = search;
+    int32_t mapped = 0;
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
         ece391_fdputs (1, (uint8_t*)"could not read argument\n");
         return 3;
     }
+    if ('-' == search[0] && 'm' == search[1] && ' ' == search[2]) {
+        mapped = 1;
+	pattern = search + 3;
+    }
 
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    while (0 != (cnt = ece391_getdents (fd, dents, sizeof (dents)))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (i = 0; i < cnt / sizeof (ece391_dirent_t); i++) {
+	    if (2 != dents[i].type) /* only regular files have text to search */
+		continue;
+	    for (len = 0; len < ECE391_NAME_LEN && '\0' != dents[i].name[len]; len++)
+		buf[len] = dents[i].name[len];
+	    buf[len] = '\0';
+	    if (mapped) {
+		if (0 != do_one_file_mapped ((char*)pattern, (char*)buf))
+		    return 3;
+	    } else if (0 != do_one_file ((char*)pattern, (char*)buf))
+		return 3;
+	}
     }
 
     return 0;
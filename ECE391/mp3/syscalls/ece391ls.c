@@ -3,26 +3,37 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
-#define SBUFSIZE 33
+#define NUM_DENTS 16
+#define PATH_LEN  128
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, i, len;
+    ece391_dirent_t dents[NUM_DENTS];
+    uint8_t buf[ECE391_NAME_LEN + 1];
+    uint8_t path[PATH_LEN + 1];
 
-    if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
+    /* list the directory named on the command line, or the root without one */
+    if (0 != ece391_getargs (path, PATH_LEN + 1))
+        ece391_strcpy (path, (uint8_t*)".");
+    if (-1 == (fd = ece391_open (path))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* one system call per NUM_DENTS entries instead of one per entry */
+    while (0 != (cnt = ece391_getdents (fd, dents, sizeof (dents)))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	    for (i = 0; i < cnt / sizeof (ece391_dirent_t); i++) {
+	        for (len = 0; len < ECE391_NAME_LEN && '\0' != dents[i].name[len]; len++)
+	            buf[len] = dents[i].name[len];
+	        buf[len] = '\n';
+	        if (-1 == ece391_write (1, buf, len + 1))
+	            return 3;
+	    }
     }
 
     return 0;
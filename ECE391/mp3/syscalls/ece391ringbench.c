@@ -0,0 +1,126 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+#include "ece391sysnum.h"
+
+#define BUFSIZE 32
+#define CALLS 100000
+#define CHUNK 64
+#define ROUNDS 200
+
+static ece391_ring_t ring;
+static uint8_t chunks[ECE391_RING_ENTRIES][CHUNK];
+
+/* Low 32 bits of the time stamp counter, enough for one run */
+static uint32_t rdtsc ()
+{
+    uint32_t val;
+    asm volatile ("rdtsc" : "=a" (val) : : "edx");
+    return val;
+}
+
+static void report (const char* name, uint32_t cycles, uint32_t calls)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (cycles / calls, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+}
+
+/* Read the whole file CHUNK bytes at a time with one trap per read, returns the number of reads */
+static uint32_t read_plain (const uint8_t* fname)
+{
+    int32_t fd, cnt;
+    uint32_t calls = 0;
+
+    if (-1 == (fd = ece391_open (fname)))
+        return 0;
+    do {
+        cnt = ece391_read (fd, chunks[0], CHUNK);
+	calls++;
+    } while (cnt > 0);
+    ece391_close (fd);
+    return calls;
+}
+
+/* The same through the ring, a whole ring of reads per trap */
+static uint32_t read_ring (const uint8_t* fname)
+{
+    ece391_ring_cqe_t cqe;
+    int32_t fd, i, more;
+    uint32_t calls = 0;
+
+    if (-1 == (fd = ece391_open (fname)))
+        return 0;
+    do {
+        for (i = 0; i < ECE391_RING_ENTRIES; i++)
+	    ece391_ring_push (&ring, SYS_READ, fd, (int32_t)chunks[i], CHUNK, i);
+	ece391_ring_enter ();
+	more = 1;
+	while (ece391_ring_pop (&ring, &cqe)) {
+	    if (cqe.res < CHUNK)
+	        more = 0;
+	    calls++;
+	}
+    } while (more);
+    ece391_close (fd);
+    return calls;
+}
+
+/*
+ * Null system calls and small file reads, one trap per call against a ring
+ * of ECE391_RING_ENTRIES calls per trap.  The file is the argument
+ * (frame0.txt if there is none).
+ */
+int main ()
+{
+    uint8_t fname[BUFSIZE];
+    uint32_t i, j, start, calls, plain_cycles, ring_cycles;
+
+    if (0 != ece391_getargs (fname, BUFSIZE) || '\0' == fname[0])
+        ece391_strcpy (fname, (uint8_t*)"frame0.txt");
+    if (-1 == ece391_ring_setup (&ring)) {
+        ece391_fdputs (1, (uint8_t*)"ring setup failed\n");
+        return 2;
+    }
+
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i++)
+        ece391_nop ();
+    plain_cycles = rdtsc () - start;
+
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i += ECE391_RING_ENTRIES) {
+        for (j = 0; j < ECE391_RING_ENTRIES; j++)
+	    ece391_ring_push (&ring, SYS_NOP, 0, 0, 0, j);
+	ece391_ring_enter ();
+	ring.cq_head = ring.cq_tail;
+    }
+    ring_cycles = rdtsc () - start;
+    report ("nop, one trap each: ", plain_cycles, CALLS);
+    report ("nop, ring:          ", ring_cycles, i);
+
+    calls = 0;
+    start = rdtsc ();
+    for (i = 0; i < ROUNDS; i++)
+        calls += read_plain (fname);
+    plain_cycles = rdtsc () - start;
+    if (0 == calls) {
+        ece391_fdputs (1, (uint8_t*)"file not found\n");
+        return 2;
+    }
+    report ("read, one trap each: ", plain_cycles, calls);
+
+    calls = 0;
+    start = rdtsc ();
+    for (i = 0; i < ROUNDS; i++)
+        calls += read_ring (fname);
+    ring_cycles = rdtsc () - start;
+    report ("read, ring:          ", ring_cycles, calls);
+
+    ece391_ring_setup (0);
+    return 0;
+}
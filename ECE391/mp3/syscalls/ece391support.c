@@ -21,6 +21,55 @@ void ece391_fdputs(int32_t fd, const uint8_t* s)
     (void)ece391_write (fd, s, ece391_strlen(s));
 }
 
+/* Write n strings (at most ECE391_IOV_MAX) with one system call */
+void ece391_fdputsv(int32_t fd, const uint8_t* const* s, int32_t n)
+{
+    ece391_iovec_t iov[ECE391_IOV_MAX];
+    int32_t i;
+
+    if (n > ECE391_IOV_MAX)
+        n = ECE391_IOV_MAX;
+    for (i = 0; i < n; i++)
+        ece391_iovec_set (&iov[i], s[i], ece391_strlen (s[i]));
+    (void)ece391_writev (fd, iov, n);
+}
+
+void ece391_iovec_set(ece391_iovec_t* iov, const void* base, int32_t len)
+{
+    iov->base = (void*)base;
+    iov->len = len;
+}
+
+/* Queue a call on a syscall ring, -1 if the submission queue is full */
+int32_t ece391_ring_push(ece391_ring_t* ring, int32_t op, int32_t a0, int32_t a1, int32_t a2, uint32_t user_data)
+{
+    ece391_ring_sqe_t* sqe;
+
+    if (ring->sq_tail - ring->sq_head >= ECE391_RING_ENTRIES)
+        return -1;
+    sqe = &ring->sq[ring->sq_tail % ECE391_RING_ENTRIES];
+    sqe->op = op;
+    sqe->args[0] = a0;
+    sqe->args[1] = a1;
+    sqe->args[2] = a2;
+    sqe->user_data = user_data;
+    /* The entry has to be filled in before the kernel can see it (a tick can come at any point) */
+    asm volatile ("" : : : "memory");
+    ring->sq_tail++;
+    return 0;
+}
+
+/* Take the oldest completion off a syscall ring, 0 if there is none */
+int32_t ece391_ring_pop(ece391_ring_t* ring, ece391_ring_cqe_t* cqe)
+{
+    if (ring->cq_head == ring->cq_tail)
+        return 0;
+    *cqe = ring->cq[ring->cq_head % ECE391_RING_ENTRIES];
+    asm volatile ("" : : : "memory");
+    ring->cq_head++;
+    return 1;
+}
+
 int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2)
 {
     while (*s1 == *s2) {
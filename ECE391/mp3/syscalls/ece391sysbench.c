@@ -0,0 +1,50 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 32
+#define CALLS 100000
+
+/* Low 32 bits of the time stamp counter, enough for one run of CALLS calls */
+static uint32_t rdtsc ()
+{
+    uint32_t val;
+    asm volatile ("rdtsc" : "=a" (val) : : "edx");
+    return val;
+}
+
+static void report (const char* name, uint32_t cycles)
+{
+    uint8_t buf[BUFSIZE];
+
+    ece391_fdputs (1, (uint8_t*)name);
+    ece391_itoa (cycles / CALLS, buf, 10);
+    ece391_fdputs (1, buf);
+    ece391_fdputs (1, (uint8_t*)" cycles per call\n");
+}
+
+/* Round trip of the null system call through INT 0x80 and through SYSENTER */
+int main ()
+{
+    uint32_t i, start, int_cycles, fast_cycles;
+
+    if (0 != ece391_int_nop () || 0 != ece391_nop ()) {
+        ece391_fdputs (1, (uint8_t*)"nop system call failed\n");
+        return 2;
+    }
+
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i++)
+        ece391_int_nop ();
+    int_cycles = rdtsc () - start;
+
+    start = rdtsc ();
+    for (i = 0; i < CALLS; i++)
+        ece391_nop ();
+    fast_cycles = rdtsc () - start;
+
+    report ("INT 0x80: ", int_cycles);
+    report ("SYSENTER: ", fast_cycles);
+    return 0;
+}
@@ -21,6 +21,120 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_sync (void);
+
+/* 
+ * getdents fills buf with as many of these as fit and returns the number
+ * of bytes it filled in (0 once the whole directory has been read).  The
+ * name is only null terminated if it is shorter than 32 chars.
+ */
+#define ECE391_NAME_LEN 32
+typedef struct ece391_dirent {
+	uint8_t name[ECE391_NAME_LEN];
+	uint32_t type;		/* 0 rtc, 1 directory, 2 regular file */
+	uint32_t inode;
+	uint32_t size;		/* file length in bytes, 0 if not a regular file */
+} ece391_dirent_t;
+extern int32_t ece391_getdents (int32_t fd, ece391_dirent_t* buf, int32_t nbytes);
+
+/*
+ * mmap maps a whole open file read only and returns its length, with
+ * *start set to its first byte.  The mapping lasts until munmap or halt.
+ */
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_munmap (uint8_t* start);
+
+/*
+ * The calls above go through SYSENTER (execute through INT 0x80).  nop does
+ * nothing and returns 0, int_nop is the same call through INT 0x80, for
+ * timing the two ways into the kernel.
+ */
+extern int32_t ece391_nop (void);
+extern int32_t ece391_int_nop (void);
+
+/*
+ * readv and writev move data to or from up to ECE391_IOV_MAX buffers in one
+ * call, in order, and return the total number of bytes.  readv stops at the
+ * first buffer that isn't filled.  writev can take buffers from a mapped file.
+ */
+#define ECE391_IOV_MAX 16
+typedef struct ece391_iovec {
+	void* base;
+	int32_t len;
+} ece391_iovec_t;
+extern int32_t ece391_readv (int32_t fd, ece391_iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+
+/*
+ * A syscall ring runs many read, write, open, close, create, getdents and
+ * nop calls for one trap.  ring_setup registers a ring in the program's
+ * memory (NULL drops it).  Queue calls with ece391_ring_push, then either
+ * call ring_enter, which runs them all and returns how many ran, or leave
+ * them for the kernel to run at the next timer tick (it stops at a read
+ * from the terminal or the RTC).  Each call gets a completion, in order,
+ * with its user_data and what it returned; read them with ece391_ring_pop.
+ * Any other call number completes with -1.
+ */
+#define ECE391_RING_ENTRIES 64
+typedef struct ece391_ring_sqe {
+	int32_t op;		/* SYS_ number from ece391sysnum.h */
+	int32_t args[3];
+	uint32_t user_data;
+} ece391_ring_sqe_t;
+typedef struct ece391_ring_cqe {
+	uint32_t user_data;
+	int32_t res;
+} ece391_ring_cqe_t;
+typedef struct ece391_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	ece391_ring_sqe_t sq[ECE391_RING_ENTRIES];
+	ece391_ring_cqe_t cq[ECE391_RING_ENTRIES];
+} ece391_ring_t;
+extern int32_t ece391_ring_setup (ece391_ring_t* ring);
+extern int32_t ece391_ring_enter (void);
+
+/*
+ * The kernel can count every system call and keep a histogram of how many
+ * TSC cycles each one took: bucket i counts calls that took 2^i to
+ * 2^(i+1) - 1 cycles.  sysstats turns that on or off, clears the tables,
+ * or copies them into buf (up to nbytes, returning the number copied).
+ * Execute is counted but not timed, halt never comes back to be timed.
+ * ECE391_SYSSTATS_SCHED copies the scheduler's numbers instead: PIT ticks
+ * and the cycles spent scheduling in them, and how many tasks a line from
+ * the keyboard woke and the cycles from each wakeup to the task running,
+ * and how many times a task gave up the CPU to sleep (not counted as ticks).
+ * Reset clears those too.
+ * ECE391_SYSSTATS_QUANTUM sets the scheduler's quantum, in PIT ticks, for
+ * each class (boosted, foreground, background) from a uint32_t array of
+ * ECE391_SCHED_CLASSES (0 leaves a class alone) and fills the array with
+ * the quanta in use.
+ */
+#define ECE391_NUM_SYSCALLS 32
+#define ECE391_HIST_BUCKETS 32
+#define ECE391_SYSSTATS_GET 0
+#define ECE391_SYSSTATS_ON 1
+#define ECE391_SYSSTATS_OFF 2
+#define ECE391_SYSSTATS_RESET 3
+#define ECE391_SYSSTATS_SCHED 4
+#define ECE391_SYSSTATS_QUANTUM 5
+#define ECE391_SCHED_CLASSES 3
+typedef struct ece391_sysstats {
+	uint32_t calls[ECE391_NUM_SYSCALLS];
+	uint32_t hist[ECE391_NUM_SYSCALLS][ECE391_HIST_BUCKETS];
+} ece391_sysstats_t;
+typedef struct ece391_schedstats {
+	uint32_t ticks;
+	uint32_t cycles;
+	uint32_t wakeups;
+	uint32_t wake_cycles;
+	uint32_t wake_max;
+	uint32_t yields;
+} ece391_schedstats_t;
+extern int32_t ece391_sysstats (int32_t cmd, void* buf, int32_t nbytes);
 
 enum signums {
 	DIV_ZERO = 0,
@@ -11,5 +11,16 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_CREATE  11
+#define SYS_SYNC    12
+#define SYS_GETDENTS 13
+#define SYS_MMAP    14
+#define SYS_MUNMAP  15
+#define SYS_NOP     16
+#define SYS_READV   17
+#define SYS_WRITEV  18
+#define SYS_RING_SETUP 19
+#define SYS_RING_ENTER 20
+#define SYS_SYSSTATS 21
 
 #endif /* ECE391SYSNUM_H */
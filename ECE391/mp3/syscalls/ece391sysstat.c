@@ -0,0 +1,186 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 32
+#define BAR_MAX 40
+#define NAME_WIDTH 12
+#define NUM_WIDTH 10
+
+/* Names by system call number, NULL for numbers with no call */
+static const char* names[ECE391_NUM_SYSCALLS] = {
+    0, "halt", "execute", "read", "write", "open", "close", "getargs",
+    "vidmap", "set_handler", "sigreturn", "create", "sync", "getdents", "mmap", "munmap",
+    "nop", "readv", "writev", "ring_setup", "ring_enter", "sysstats"
+};
+
+/* Write s, then spaces out to width */
+static void put_padded (const uint8_t* s, uint32_t width)
+{
+    uint32_t len = ece391_strlen (s);
+
+    ece391_fdputs (1, s);
+    while (len++ < width)
+        ece391_fdputs (1, (uint8_t*)" ");
+}
+
+/* Write n right aligned in width */
+static void put_num (uint32_t n, uint32_t width)
+{
+    uint8_t buf[BUFSIZE];
+    uint32_t len;
+
+    ece391_itoa (n, buf, 10);
+    for (len = ece391_strlen (buf); len < width; len++)
+        ece391_fdputs (1, (uint8_t*)" ");
+    ece391_fdputs (1, buf);
+}
+
+/* One line per call that was made, then one per nonzero bucket with a bar scaled to the biggest one */
+static void print_stats (const ece391_sysstats_t* st)
+{
+    uint32_t num, b, max, len;
+    uint8_t bar[BAR_MAX + 2];
+    uint8_t buf[BUFSIZE];
+
+    for (num = 1; num < ECE391_NUM_SYSCALLS; num++) {
+        if (0 == st->calls[num])
+	    continue;
+	if (names[num]) {
+	    put_padded ((uint8_t*)names[num], NAME_WIDTH);
+	} else {
+	    ece391_itoa (num, buf, 10);
+	    put_padded (buf, NAME_WIDTH);
+	}
+	put_num (st->calls[num], NUM_WIDTH);
+	ece391_fdputs (1, (uint8_t*)" calls\n");
+
+	for (b = max = 0; b < ECE391_HIST_BUCKETS; b++)
+	    if (st->hist[num][b] > max)
+	        max = st->hist[num][b];
+	for (b = 0; b < ECE391_HIST_BUCKETS; b++) {
+	    if (0 == st->hist[num][b])
+	        continue;
+	    ece391_fdputs (1, (uint8_t*)"  2^");
+	    ece391_itoa (b, buf, 10);
+	    put_padded (buf, 3);
+	    put_num (st->hist[num][b], NUM_WIDTH);
+	    ece391_fdputs (1, (uint8_t*)" ");
+	    /* At least one mark for a bucket that isn't empty */
+	    len = st->hist[num][b] / ((max + BAR_MAX - 1) / BAR_MAX);
+	    if (len > BAR_MAX)
+	        len = BAR_MAX;
+	    if (0 == len)
+	        len = 1;
+	    bar[len] = '\n';
+	    bar[len + 1] = '\0';
+	    while (len-- > 0)
+	        bar[len] = '#';
+	    ece391_fdputs (1, bar);
+	}
+    }
+}
+
+/* One labelled number per line */
+static void put_line (const char* label, uint32_t n)
+{
+    put_padded ((uint8_t*)label, 2 * NAME_WIDTH);
+    put_num (n, NUM_WIDTH);
+    ece391_fdputs (1, (uint8_t*)"\n");
+}
+
+/* Scheduler cost per tick and how long keyboard wakeups waited for the CPU */
+static void print_sched (const ece391_schedstats_t* st)
+{
+    put_line ("ticks", st->ticks);
+    put_line ("cycles/tick", st->ticks ? st->cycles / st->ticks : 0);
+    put_line ("key wakeups", st->wakeups);
+    put_line ("avg wake-to-run cycles", st->wakeups ? st->wake_cycles / st->wakeups : 0);
+    put_line ("max wake-to-run cycles", st->wake_max);
+    put_line ("sleep yields", st->yields);
+}
+
+/* Parse a decimal number at *s and move *s past it and the spaces after it, -1 if there is no number */
+static int32_t parse_num (uint8_t** s)
+{
+    int32_t n = 0;
+
+    if (**s < '0' || **s > '9')
+        return -1;
+    while (**s >= '0' && **s <= '9')
+        n = n * 10 + (*(*s)++ - '0');
+    while (' ' == **s)
+        (*s)++;
+    return n;
+}
+
+/* sysstat quantum [boost fg bg]: set the quanta if they are given, then print the ones in use */
+static int32_t do_quantum (uint8_t* args)
+{
+    static const char* labels[ECE391_SCHED_CLASSES] = {"boost quantum", "fg quantum", "bg quantum"};
+    uint32_t quanta[ECE391_SCHED_CLASSES] = {0, 0, 0};
+    int32_t cls, n;
+
+    while (' ' == *args)
+        args++;
+    for (cls = 0; '\0' != *args; cls++) {
+        if (cls == ECE391_SCHED_CLASSES || (n = parse_num (&args)) <= 0) {
+            ece391_fdputs (1, (uint8_t*)"usage: sysstat quantum [boost fg bg], in ticks\n");
+            return 3;
+        }
+        quanta[cls] = n;
+    }
+    if (0 != ece391_sysstats (ECE391_SYSSTATS_QUANTUM, quanta, sizeof (quanta))) {
+        ece391_fdputs (1, (uint8_t*)"could not set the quanta\n");
+        return 2;
+    }
+    for (cls = 0; cls < ECE391_SCHED_CLASSES; cls++)
+        put_line (labels[cls], quanta[cls]);
+    return 0;
+}
+
+/*
+ * sysstat [on|off|reset|sched|quantum [boost fg bg]]: turn system call
+ * counting on or off, clear the counts, print the scheduler's numbers, set
+ * or print the scheduler's quanta, or with no argument print the counts with
+ * a latency histogram (in TSC cycles) for every call that was made.
+ */
+int main ()
+{
+    static ece391_sysstats_t st;
+    uint8_t arg[BUFSIZE];
+
+    if (0 != ece391_getargs (arg, BUFSIZE))
+        arg[0] = '\0';
+
+    if (0 == ece391_strcmp (arg, (uint8_t*)"on"))
+        return 0 == ece391_sysstats (ECE391_SYSSTATS_ON, 0, 0) ? 0 : 2;
+    if (0 == ece391_strcmp (arg, (uint8_t*)"off"))
+        return 0 == ece391_sysstats (ECE391_SYSSTATS_OFF, 0, 0) ? 0 : 2;
+    if (0 == ece391_strcmp (arg, (uint8_t*)"reset"))
+        return 0 == ece391_sysstats (ECE391_SYSSTATS_RESET, 0, 0) ? 0 : 2;
+    if (0 == ece391_strcmp (arg, (uint8_t*)"sched")) {
+        static ece391_schedstats_t sst;
+
+        if (sizeof (sst) != ece391_sysstats (ECE391_SYSSTATS_SCHED, &sst, sizeof (sst))) {
+            ece391_fdputs (1, (uint8_t*)"could not read scheduler stats\n");
+	    return 2;
+	}
+	print_sched (&sst);
+	return 0;
+    }
+    if (0 == ece391_strncmp (arg, (uint8_t*)"quantum", 7) && ('\0' == arg[7] || ' ' == arg[7]))
+        return do_quantum (arg + 7);
+    if ('\0' != arg[0]) {
+        ece391_fdputs (1, (uint8_t*)"usage: sysstat [on|off|reset|sched|quantum [boost fg bg]]\n");
+	return 3;
+    }
+
+    if (sizeof (st) != ece391_sysstats (ECE391_SYSSTATS_GET, &st, sizeof (st))) {
+        ece391_fdputs (1, (uint8_t*)"could not read system call stats\n");
+	return 2;
+    }
+    print_stats (&st);
+    return 0;
+}